@@ -6,28 +6,132 @@
 ////////////////////////////////////////////////////////////////////////
 // preproc
 
+#pragma once
+
+#include <algorithm>   // std::copy, std::move, std::remove_if, std::rotate
+#include <atomic>
 #include <cassert>
+#include <cstddef>     // std::max_align_t
+#include <cstdint>     // uintptr_t
+#include <cstdlib>     // std::malloc, std::realloc, std::free
+#include <cstring>     // std::memcpy, std::memset
 #include <iostream>
+#include <iterator>    // std::distance, std::iterator_traits
+#include <memory>      // std::allocator, std::allocator_traits
+#include <new>         // std::align_val_t, std::bad_alloc
+#include <type_traits> // std::is_trivially_copyable
+#include <typeinfo>    // typeid
+#include <utility>     // std::forward, std::move_if_noexcept, std::swap
+
+#if defined(__GNUC__)
+#include <cxxabi.h>    // abi::__cxa_demangle
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>  // madvise, mmap, mremap, munmap
+#endif
 
 #define YOU_HAVE_IMPLEMENTED_ITERATORS 1
 #define ACTIVATE_THIS_FOR_SEEING_THE_CORRECT_RESULT 0
 
-#define DEBUG_ON 0
+#ifndef ARRAY_STATS
+#define ARRAY_STATS 1 // count allocations per element type, see array_stats()
+#endif
 #define DEFAULT_MAGNITUDE 32
-#define NULT (size_t)NULL
+#define MAP_MAGNITUDE (1 << 25)   // bytes from which storage is mmap'd
+#define ARENA_MAGNITUDE (1 << 16) // bytes per arena block
+#define CACHE_LINE 64
+#define HUGE_PAGE (1 << 21)
+
+////////////////////////////////////////////////////////////////////////
+// growth policies
+
+// A policy G gives the capacity of a default-constructed Array as
+// G::initial, and G::grow(c, n, unit) picks the capacity that replaces c
+// once n elements of unit bytes must fit, which has to be at least n.
+
+// index of the highest set bit, n > 0
+constexpr size_t
+msb(size_t n)
+{
+#if defined(__GNUC__)
+  return sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(n);
+#else
+  size_t b = 0;
+  while (n >>= 1)
+    ++b;
+  return b;
+#endif
+}
+
+// next power of two, n at most half the address space
+constexpr size_t
+pow2(size_t n)
+{
+  if (n <= 1)
+    return 1;
+  return (size_t)1 << (msb(n - 1) + 1);
+}
+
+// next power of two, the historical behaviour
+template<size_t I = DEFAULT_MAGNITUDE>
+struct Pow2Growth
+{
+  static constexpr size_t initial = I;
+  static size_t grow(size_t, size_t n, size_t)
+  {
+    return pow2(n);
+  }
+};
+
+// half again, which lets a freed block be reused by a later growth
+template<size_t I = DEFAULT_MAGNITUDE>
+struct SesquiGrowth
+{
+  static constexpr size_t initial = I;
+  static size_t grow(size_t c, size_t n, size_t)
+  {
+    c += c / 2;
+    return c < n ? n : c;
+  }
+};
+
+// half again, rounded up to whole pages, for arrays that outgrow a page
+template<size_t P = 4096, size_t I = 0>
+struct PageGrowth
+{
+  static constexpr size_t initial = I;
+  static size_t grow(size_t c, size_t n, size_t unit)
+  {
+    c += c / 2;
+    if (c < n)
+      c = n;
+    size_t bytes = (c * unit + P - 1) / P * P;
+    return bytes / unit;
+  }
+};
+
+// nothing until the first insertion
+using LazyGrowth = Pow2Growth<0>;
 
 ////////////////////////////////////////////////////////////////////////
 // declaration
 
-template <typename T>
+template <typename T,
+          typename A = std::allocator<T>,
+          typename G = Pow2Growth<>>
 class Array
 {
 
+  using traits = std::allocator_traits<A>;
+
 public:
   // constructors
   Array();
-  Array(size_t n);
-  Array(size_t n, const T& v);
+  explicit Array(const A& alloc);
+  Array(size_t n, const A& alloc = A());
+  Array(size_t n, const T& v, const A& alloc = A());
+  Array(const Array<T, A, G>& a, const A& alloc);
 
   // operators
   T operator[](size_t i) const;
@@ -41,22 +145,39 @@ public:
   T front() const;
   T& back();
   T& front();
+  A get_allocator() const;
 
   // mutators
   void reserve(size_t n);
   void resize(size_t n);
+  void shrink_to_fit();
   void push_back(const T& v);
+  void push_back(T&& v);
+  template<typename... Args>
+  T& emplace_back(Args&&... args);
   void pop_back();
   void clear();
-  void swap(Array<T>& a);
-  void append(Array<T>& a);
+  void release();
+  void swap(Array<T, A, G>& a);
+  void append(const Array<T, A, G>& a);
+  void append(Array<T, A, G>&& a);
+  void append(const T* p, size_t n);
+  template<typename I,
+           typename = typename std::iterator_traits<I>::iterator_category>
+  void append(I first, I last);
+  template<typename I,
+           typename = typename std::iterator_traits<I>::iterator_category>
+  T* insert(const T* pos, I first, I last);
+  T* erase(const T* first, const T* last);
+  template<typename P>
+  size_t erase_if(P pred);
 
   // bonus
   ~Array();
-  Array(const Array<T>& a);
-  Array(Array<T>&& a);
-  Array<T>& operator=(const Array<T>&);
-  Array<T>& operator=(Array<T>&& a);
+  Array(const Array<T, A, G>& a);
+  Array(Array<T, A, G>&& a) noexcept;
+  Array<T, A, G>& operator=(const Array<T, A, G>&);
+  Array<T, A, G>& operator=(Array<T, A, G>&& a) noexcept(steals);
   T const* begin() const;
   T const* end() const;
   T* begin();
@@ -64,111 +185,543 @@ public:
 
 private:
   T* array_;         // head of actual array
-  size_t capacity_;  // declared but not assigned
-  size_t size_;      // assigned
+  size_t capacity_;  // allocated but not constructed
+  size_t size_;      // constructed
+
+  A alloc_;          // source of the above
+
+  // raw storage
+  static constexpr bool trivial = std::is_trivially_copyable<T>::value;
+  static constexpr bool system = std::is_same<A, std::allocator<T>>::value;
+  static constexpr bool steals =
+    traits::propagate_on_container_move_assignment::value ||
+    traits::is_always_equal::value;
+  T* allocate(size_t n);
+  T* reallocate(T* p, size_t on, size_t nn);
+  void deallocate(T* p, size_t n);
+  template<typename... Args>
+  void construct(T* p, Args&&... args);
+  void destroy(T* first, T* last);
+  void relocate(T* from, size_t n, T* to);
+  void adopt(Array<T, A, G>& a);
+  static size_t grow(size_t c, size_t n);
+  template<typename... Args>
+  T& emplace_grow(Args&&... args);
 };
 
 ////////////////////////////////////////////////////////////////////////
-// debug
+// raw memory
+
+// Small blocks come from malloc. On linux, blocks of at least
+// MAP_MAGNITUDE bytes are mapped directly, so that growing them is an
+// mremap which the kernel can often satisfy in place, or else by moving
+// page table entries rather than bytes. Neither promises more than
+// alignof(std::max_align_t), so blocks for anything aligned beyond that
+// come from the aligned operator new, and are never realloc'd or
+// remapped.
+
+inline bool
+raw_overaligned(size_t align)
+{
+  return align > alignof(std::max_align_t);
+}
 
-template<typename T>
-void
-dbg(std::string msg, size_t oc, size_t nc, size_t os, size_t ns, T a)
-{
-  std::cout << msg << ": ";
-  // capacity change
-  if (oc != NULT || nc != NULT) std::cout << "c ";
-  if (oc != NULT)               std::cout << oc;
-  if (oc != NULT && nc != NULT) std::cout << "->";
-  if (nc != NULT)               std::cout << nc;
-  if (oc != NULT || nc != NULT) std::cout << "; ";
-  // size change
-  if (os != NULT || ns != NULT) std::cout << "s ";
-  if (os != NULT)               std::cout << os;
-  if (os != NULT && ns != NULT) std::cout << "->";
-  if (ns != NULT)               std::cout << ns;
-  if (os != NULT || ns != NULT) std::cout << "; ";
-  // array address
-  if (a)                        std::cout << "a " << a;
-  std::cout << std::endl;
+inline bool
+raw_mapped(size_t bytes)
+{
+#ifdef __linux__
+  return bytes >= MAP_MAGNITUDE;
+#else
+  return false;
+#endif
 }
 
-////////////////////////////////////////////////////////////////////////
-// Array constructors
+inline void*
+raw_alloc(size_t bytes, size_t align = alignof(std::max_align_t))
+{
+  if (bytes == 0)
+    return nullptr;
+  if (raw_overaligned(align))
+    return ::operator new(bytes, std::align_val_t(align));
+
+  void* p;
+#ifdef __linux__
+  if (raw_mapped(bytes)) {
+    p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+    return p;
+  }
+#endif
+  p = std::malloc(bytes);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
 
-template<typename T>
-Array<T>::Array()
+inline void
+raw_free(void* p, size_t bytes, size_t align = alignof(std::max_align_t))
 {
-  array_ = new T[DEFAULT_MAGNITUDE];
-  capacity_ = DEFAULT_MAGNITUDE;
-  size_ = 0;
+  if (!p)
+    return;
+  if (raw_overaligned(align)) {
+    ::operator delete(p, bytes, std::align_val_t(align));
+    return;
+  }
+#ifdef __linux__
+  if (raw_mapped(bytes)) {
+    munmap(p, bytes);
+    return;
+  }
+#endif
+  std::free(p);
+}
+
+// Only valid for trivially copyable contents: the bytes are moved as is.
+inline void*
+raw_realloc(void* p, size_t ob, size_t nb,
+            size_t align = alignof(std::max_align_t))
+{
+  if (!p)
+    return raw_alloc(nb, align);
+  if (nb == 0) {
+    raw_free(p, ob, align);
+    return nullptr;
+  }
 
-#if DEBUG_ON
-  dbg("Array()", NULT, capacity_, NULT, size_, array_);
+  void* q;
+  if (!raw_overaligned(align) && raw_mapped(ob) == raw_mapped(nb)) {
+#ifdef __linux__
+    if (raw_mapped(nb)) {
+      q = mremap(p, ob, nb, MREMAP_MAYMOVE);
+      if (q == MAP_FAILED)
+        throw std::bad_alloc();
+      return q;
+    }
 #endif
+    q = std::realloc(p, nb);
+    if (!q)
+      throw std::bad_alloc();
+    return q;
+  }
+
+  // crossing the threshold, or overaligned
+  q = raw_alloc(nb, align);
+  std::memcpy(q, p, ob < nb ? ob : nb);
+  raw_free(p, ob, align);
+  return q;
 }
 
-template<typename T>
-Array<T>::Array(size_t n)
+////////////////////////////////////////////////////////////////////////
+// statistics
+
+// Every element type that an Array is instantiated with gets one set of
+// counters, shared by all its Arrays whatever their allocator or growth
+// policy. Counters are relaxed atomics touched only when storage is
+// obtained, grown or given back, never per element, so they can stay on
+// in production. Sizes are sampled when an array grows, is cleared or
+// goes away, which is where the gap between capacity and size shows.
+// With ARRAY_STATS at 0 nothing is counted.
+
+class ArrayStats
 {
-  assert(n >= 0);
 
-  array_ = new T[n];
-  size_ = n;
+public:
+  ArrayStats(const char* type, size_t unit);
+  ArrayStats(const ArrayStats&) = delete;
+  ArrayStats& operator=(const ArrayStats&) = delete;
 
-  size_t c = 1;
-  while (c < n)
-    c *= 2;
-  capacity_ = c;
+  // accessors
+  const char* type() const;
+  size_t unit() const;
+  size_t allocations() const;
+  size_t bytes() const;
+  size_t reallocations() const;
+  size_t copied() const;
+  size_t live() const;
+  size_t peak() const;
+  size_t peak_capacity() const;
+  size_t peak_size() const;
+  const ArrayStats* next() const;
+  static const ArrayStats* first();
 
-  for (int i = 0; i < n; i++)
-    array_[i] = T {};
+  // mutators
+  void obtained(size_t bytes);
+  void returned(size_t bytes);
+  void moved(size_t bytes);
+  void held(size_t capacity, size_t size);
+  void reset();
+
+private:
+  using counter = std::atomic<size_t>;
+
+  const char* type_;
+  size_t unit_;              // sizeof the element
+  counter allocations_;      // blocks obtained, realloc included
+  counter bytes_;            // bytes obtained in total
+  counter reallocations_;    // blocks replaced by a larger or smaller one
+  counter copied_;           // bytes carried over by those
+  counter live_;             // bytes held right now
+  counter peak_;             // most bytes held at once
+  counter peak_capacity_;    // largest capacity, elements
+  counter peak_size_;        // largest size sampled, elements
+  const ArrayStats* next_;   // registered before this one
+
+  static std::atomic<const ArrayStats*>& head();
+  static void raise(counter& c, size_t v);
+};
+
+inline
+ArrayStats::ArrayStats(const char* type, size_t unit)
+  : type_(type), unit_(unit), allocations_(0), bytes_(0),
+    reallocations_(0), copied_(0), live_(0), peak_(0), peak_capacity_(0),
+    peak_size_(0), next_(head().load(std::memory_order_relaxed))
+{
+  while (!head().compare_exchange_weak(next_, this,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed))
+    ;
+}
+
+inline std::atomic<const ArrayStats*>&
+ArrayStats::head()
+{
+  static std::atomic<const ArrayStats*> h(nullptr);
+  return h;
+}
+
+inline void
+ArrayStats::raise(counter& c, size_t v)
+{
+  size_t m = c.load(std::memory_order_relaxed);
+  while (m < v && !c.compare_exchange_weak(m, v, std::memory_order_relaxed))
+    ;
+}
+
+inline const char* ArrayStats::type() const { return type_; }
+inline size_t ArrayStats::unit() const { return unit_; }
+inline size_t ArrayStats::allocations() const { return allocations_; }
+inline size_t ArrayStats::bytes() const { return bytes_; }
+inline size_t ArrayStats::reallocations() const { return reallocations_; }
+inline size_t ArrayStats::copied() const { return copied_; }
+inline size_t ArrayStats::live() const { return live_; }
+inline size_t ArrayStats::peak() const { return peak_; }
+inline size_t ArrayStats::peak_capacity() const { return peak_capacity_; }
+inline size_t ArrayStats::peak_size() const { return peak_size_; }
+inline const ArrayStats* ArrayStats::next() const { return next_; }
+
+// the most recently registered type; follow next() for the rest
+inline const ArrayStats*
+ArrayStats::first()
+{
+  return head().load(std::memory_order_acquire);
+}
+
+inline void
+ArrayStats::obtained(size_t bytes)
+{
+  if constexpr (!ARRAY_STATS)
+    return;
+  allocations_.fetch_add(1, std::memory_order_relaxed);
+  bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  raise(peak_, live_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+inline void
+ArrayStats::returned(size_t bytes)
+{
+  if constexpr (!ARRAY_STATS)
+    return;
+  live_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+inline void
+ArrayStats::moved(size_t bytes)
+{
+  if constexpr (!ARRAY_STATS)
+    return;
+  reallocations_.fetch_add(1, std::memory_order_relaxed);
+  copied_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+inline void
+ArrayStats::held(size_t capacity, size_t size)
+{
+  if constexpr (!ARRAY_STATS)
+    return;
+  raise(peak_capacity_, capacity);
+  raise(peak_size_, size);
+}
 
-#if DEBUG_ON
-  std::ostringstream s;
-  s << "Array(" << n << ")";
-  dbg(s.str(), NULT, capacity_, NULT, size_, array_);
+// Everything but what is held right now, which is where peak restarts.
+inline void
+ArrayStats::reset()
+{
+  allocations_.store(0, std::memory_order_relaxed);
+  bytes_.store(0, std::memory_order_relaxed);
+  reallocations_.store(0, std::memory_order_relaxed);
+  copied_.store(0, std::memory_order_relaxed);
+  peak_.store(live_.load(std::memory_order_relaxed),
+              std::memory_order_relaxed);
+  peak_capacity_.store(0, std::memory_order_relaxed);
+  peak_size_.store(0, std::memory_order_relaxed);
+}
+
+template<typename T>
+const char*
+type_name()
+{
+  const char* name = typeid(T).name();
+#if defined(__GNUC__)
+  int status;
+  char* s = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+  if (status == 0)
+    return s; // kept for good, like the counters
 #endif
+  return name;
 }
 
 template<typename T>
-Array<T>::Array(size_t n, const T& v)
+ArrayStats&
+array_stats()
 {
-  assert(n >= 0);
+  static ArrayStats s(type_name<T>(), sizeof(T));
+  return s;
+}
 
-  array_ = new T[n];
-  size_ = n;
+inline void
+array_stats_reset()
+{
+  for (const ArrayStats* s = ArrayStats::first(); s; s = s->next())
+    const_cast<ArrayStats*>(s)->reset();
+}
 
-  size_t c = 1;
-  while (c < n)
-    c *= 2;
-  capacity_ = c;
+// {"types": [{"type": ..., ...}, ...], "total": {...}}, one type per line
+inline void
+array_stats_json(std::ostream& o)
+{
+  size_t allocations = 0, bytes = 0, reallocations = 0, copied = 0;
+  size_t live = 0;
+
+  o << "{\"types\": [";
+  for (const ArrayStats* s = ArrayStats::first(); s; s = s->next()) {
+    o << (s == ArrayStats::first() ? "\n" : ",\n") << "  {\"type\": \"";
+    for (const char* c = s->type(); *c; ++c) {
+      if (*c == '"' || *c == '\\')
+        o << '\\';
+      o << *c;
+    }
+    o << "\", \"unit\": " << s->unit()
+      << ", \"allocations\": " << s->allocations()
+      << ", \"bytes\": " << s->bytes()
+      << ", \"reallocations\": " << s->reallocations()
+      << ", \"copied\": " << s->copied()
+      << ", \"live\": " << s->live()
+      << ", \"peak\": " << s->peak()
+      << ", \"peak_capacity\": " << s->peak_capacity()
+      << ", \"peak_size\": " << s->peak_size() << "}";
+    allocations += s->allocations();
+    bytes += s->bytes();
+    reallocations += s->reallocations();
+    copied += s->copied();
+    live += s->live();
+  }
+  o << "],\n \"total\": {\"allocations\": " << allocations
+    << ", \"bytes\": " << bytes
+    << ", \"reallocations\": " << reallocations
+    << ", \"copied\": " << copied
+    << ", \"live\": " << live << "}}\n";
+}
 
-  for (int i = 0; i < n; i++)
-    array_[i] = v;
+////////////////////////////////////////////////////////////////////////
+// Array raw storage
 
-#if DEBUG_ON
-  std::ostringstream s;
-  s << "Array(" << n << ", v)";
-  dbg(s.str(), NULT, capacity_, NULT, size_, array_);
-#endif
+// Slots in [size_, capacity_) are allocated but hold no object; they are
+// constructed in place when they become live and destroyed when they die.
+// The default std::allocator is served by the raw memory above, any
+// other allocator through std::allocator_traits. Both are counted in
+// array_stats<T>().
+
+template<typename T, typename A, typename G>
+T*
+Array<T, A, G>::allocate(size_t n)
+{
+  T* p;
+  if constexpr (system)
+    p = static_cast<T*>(raw_alloc(n * sizeof(T), alignof(T)));
+  else
+    p = n ? traits::allocate(alloc_, n) : nullptr;
+  if (p)
+    array_stats<T>().obtained(n * sizeof(T));
+  return p;
+}
+
+// A realloc that grows in place is still counted as copying the block.
+template<typename T, typename A, typename G>
+T*
+Array<T, A, G>::reallocate(T* p, size_t on, size_t nn)
+{
+  static_assert(trivial, "reallocate() moves raw bytes");
+
+  T* q;
+  if constexpr (system) {
+    q = static_cast<T*>(
+      raw_realloc(p, on * sizeof(T), nn * sizeof(T), alignof(T)));
+    if (p)
+      array_stats<T>().returned(on * sizeof(T));
+    if (q)
+      array_stats<T>().obtained(nn * sizeof(T));
+  } else {
+    q = allocate(nn);
+    if (p && q)
+      std::memcpy(q, p, (on < nn ? on : nn) * sizeof(T));
+    deallocate(p, on);
+  }
+  if (p && q)
+    array_stats<T>().moved((on < nn ? on : nn) * sizeof(T));
+  return q;
+}
+
+template<typename T, typename A, typename G>
+void
+Array<T, A, G>::deallocate(T* p, size_t n)
+{
+  if (!p)
+    return;
+  if constexpr (system)
+    raw_free(p, n * sizeof(T), alignof(T));
+  else
+    traits::deallocate(alloc_, p, n);
+  array_stats<T>().returned(n * sizeof(T));
+}
+
+template<typename T, typename A, typename G>
+template<typename... Args>
+void
+Array<T, A, G>::construct(T* p, Args&&... args)
+{
+  traits::construct(alloc_, p, std::forward<Args>(args)...);
+}
+
+template<typename T, typename A, typename G>
+void
+Array<T, A, G>::destroy(T* first, T* last)
+{
+  if constexpr (!std::is_trivially_destructible<T>::value || !system)
+    for (; first != last; ++first)
+      traits::destroy(alloc_, first);
+}
+
+// Move elements whose move cannot throw, copy the rest, so a throwing
+// relocation leaves the source intact.
+template<typename T, typename A, typename G>
+void
+Array<T, A, G>::relocate(T* from, size_t n, T* to)
+{
+  if constexpr (trivial) {
+    if (n)
+      std::memcpy(to, from, n * sizeof(T));
+    return;
+  }
+
+  size_t i = 0;
+  try {
+    for (; i < n; ++i)
+      construct(to + i, std::move_if_noexcept(from[i]));
+  } catch (...) {
+    destroy(to, to + i);
+    throw;
+  }
+}
+
+// Take over the whole of a, allocator included, and hand it ours.
+template<typename T, typename A, typename G>
+void
+Array<T, A, G>::adopt(Array<T, A, G>& a)
+{
+  std::swap(array_, a.array_);
+  std::swap(capacity_, a.capacity_);
+  std::swap(size_, a.size_);
+  std::swap(alloc_, a.alloc_);
+}
+
+template<typename T, typename A, typename G>
+size_t
+Array<T, A, G>::grow(size_t c, size_t n)
+{
+  return G::grow(c, n, sizeof(T));
+}
+
+////////////////////////////////////////////////////////////////////////
+// Array constructors
+
+template<typename T, typename A, typename G>
+Array<T, A, G>::Array()
+  : Array(A())
+{
+}
+
+template<typename T, typename A, typename G>
+Array<T, A, G>::Array(const A& alloc)
+  : alloc_(alloc)
+{
+  array_ = allocate(G::initial);
+  capacity_ = G::initial;
+  size_ = 0;
+}
+
+template<typename T, typename A, typename G>
+Array<T, A, G>::Array(size_t n, const A& alloc)
+  : alloc_(alloc)
+{
+  capacity_ = grow(0, n);
+  array_ = allocate(capacity_);
+  size_ = 0;
+
+  try {
+    for (; size_ < n; ++size_)
+      construct(array_ + size_);
+  } catch (...) {
+    destroy(array_, array_ + size_);
+    deallocate(array_, capacity_);
+    throw;
+  }
+}
+
+template<typename T, typename A, typename G>
+Array<T, A, G>::Array(size_t n, const T& v, const A& alloc)
+  : alloc_(alloc)
+{
+  capacity_ = grow(0, n);
+  array_ = allocate(capacity_);
+  size_ = 0;
+
+  try {
+    for (; size_ < n; ++size_)
+      construct(array_ + size_, v);
+  } catch (...) {
+    destroy(array_, array_ + size_);
+    deallocate(array_, capacity_);
+    throw;
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////
 // Array operators
 
-template<typename T>
+template<typename T, typename A, typename G>
 T
-Array<T>::operator[](size_t i) const
+Array<T, A, G>::operator[](size_t i) const
 {
   assert((i >= 0) && (i < size_));
 
   return array_[i];
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 T&
-Array<T>::operator[](size_t i)
+Array<T, A, G>::operator[](size_t i)
 {
   assert((i >= 0) && (i < size_));
 
@@ -178,179 +731,243 @@ Array<T>::operator[](size_t i)
 ////////////////////////////////////////////////////////////////////////
 // Array accessors
 
-template<typename T>
+template<typename T, typename A, typename G>
 size_t
-Array<T>::size() const
+Array<T, A, G>::size() const
 {
   return size_;
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 size_t
-Array<T>::capacity() const
+Array<T, A, G>::capacity() const
 {
   return capacity_;
 }
 
-template<typename T>
-bool Array<T>::empty() const
+template<typename T, typename A, typename G>
+bool Array<T, A, G>::empty() const
 {
   return size_ == 0;
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 T
-Array<T>::back() const
+Array<T, A, G>::back() const
 {
   return array_[size_ - 1];
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 T
-Array<T>::front() const
+Array<T, A, G>::front() const
 {
   return array_[0];
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 T&
-Array<T>::back()
+Array<T, A, G>::back()
 {
   return array_[size_ - 1];
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 T&
-Array<T>::front()
+Array<T, A, G>::front()
 {
   return array_[0];
 }
 
+template<typename T, typename A, typename G>
+A
+Array<T, A, G>::get_allocator() const
+{
+  return alloc_;
+}
+
 ////////////////////////////////////////////////////////////////////////
 // Array mutators
 
-template<typename T>
+template<typename T, typename A, typename G>
 void
-Array<T>::reserve(size_t n)
+Array<T, A, G>::reserve(size_t n)
 {
-  assert(n >= 0);
-
-  if (n <= capacity_) {
-#if DEBUG_ON
-    std::cout << "forgo reserve()" << std::endl;
-#endif
+  if (n <= capacity_)
     return;
-  }
-
-#if DEBUG_ON
-  size_t oc = capacity_;
-#endif
 
-  size_t c = 1;
-  while (c < n)
-    c *= 2;
-  capacity_ = c;
-
-  T* a = new T[capacity_];
-
-  for (int i = 0; i < size_; i++)
-    a[i] = array_[i];
-  if (array_)
-    delete[] array_;
-
-  array_ = a;
-
-#if DEBUG_ON
-  std::ostringstream s;
-  s << "reserve(" << n << ")";
-  dbg(s.str(), oc, capacity_, NULT, size_, array_);
-#endif
+  size_t c = grow(capacity_, n);
+
+  if constexpr (trivial) {
+    array_ = reallocate(array_, capacity_, c);
+    capacity_ = c;
+  } else {
+    T* a = allocate(c);
+
+    // only the live prefix is relocated
+    try {
+      relocate(array_, size_, a);
+    } catch (...) {
+      deallocate(a, c);
+      throw;
+    }
+    array_stats<T>().moved(size_ * sizeof(T));
+    destroy(array_, array_ + size_);
+    deallocate(array_, capacity_);
+
+    array_ = a;
+    capacity_ = c;
+  }
+  array_stats<T>().held(capacity_, size_);
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 void
-Array<T>::resize(size_t n)
+Array<T, A, G>::resize(size_t n)
 {
-  assert(n >= 0);
-
-#if DEBUG_ON
-  size_t oc = capacity_;
-  size_t os = size_;
-#endif
-  T* a = new T[n];
-
   if (n > capacity_)
     reserve(n);
-  for (int i = 0; i < std::min(size_, n); i++)
-    a[i] = array_[i];
-  for (int i = size_; i < n; i++)
-    a[i] = T {};
-  if (array_)
-    delete[] array_;
+  if constexpr (std::is_trivial<T>::value) {
+    if (n > size_) {
+      std::memset(array_ + size_, 0, (n - size_) * sizeof(T));
+      size_ = n;
+    }
+  }
+  for (; size_ < n; ++size_)
+    construct(array_ + size_);
+  if (n < size_) {
+    destroy(array_ + n, array_ + size_);
+    size_ = n;
+  }
+}
 
-  array_ = a;
-  size_ = n;
+template<typename T, typename A, typename G>
+void
+Array<T, A, G>::shrink_to_fit()
+{
+  if (size_ == capacity_)
+    return;
 
-#if DEBUG_ON
-  std::ostringstream s;
-  s << "resize(" << n << ")";
-  dbg(s.str(), oc, capacity_, os, size_, array_);
-#endif
+  if constexpr (trivial) {
+    array_ = reallocate(array_, capacity_, size_);
+  } else {
+    T* a = allocate(size_);
+    try {
+      relocate(array_, size_, a);
+    } catch (...) {
+      deallocate(a, size_);
+      throw;
+    }
+    array_stats<T>().moved(size_ * sizeof(T));
+    destroy(array_, array_ + size_);
+    deallocate(array_, capacity_);
+    array_ = a;
+  }
+  capacity_ = size_;
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 void
-Array<T>::push_back(const T& v)
+Array<T, A, G>::push_back(const T& v)
 {
-#if DEBUG_ON
-  size_t oc = capacity_;
-  size_t os = size_;
-#endif
+  emplace_back(v);
+}
+
+template<typename T, typename A, typename G>
+void
+Array<T, A, G>::push_back(T&& v)
+{
+  emplace_back(std::move(v));
+}
 
-  if (size_ >= capacity_)
-    reserve(size_ + 1);
+template<typename T, typename A, typename G>
+template<typename... Args>
+T&
+Array<T, A, G>::emplace_back(Args&&... args)
+{
+  if (size_ < capacity_) {
+    construct(array_ + size_, std::forward<Args>(args)...);
+    return array_[size_++];
+  }
+  return emplace_grow(std::forward<Args>(args)...);
+}
 
-  array_[size_] = v;
-  ++size_;
+// The full case of emplace_back(), kept apart so that the common case
+// stays small enough to inline into loops. The new element is built
+// first, since args may refer into the old buffer.
+template<typename T, typename A, typename G>
+template<typename... Args>
+T&
+Array<T, A, G>::emplace_grow(Args&&... args)
+{
+  size_t c = grow(capacity_, size_ + 1);
+
+  if constexpr (trivial) {
+    T v(std::forward<Args>(args)...);
+    array_ = reallocate(array_, capacity_, c);
+    capacity_ = c;
+    construct(array_ + size_, v);
+  } else {
+    T* a = allocate(c);
+    try {
+      construct(a + size_, std::forward<Args>(args)...);
+    } catch (...) {
+      deallocate(a, c);
+      throw;
+    }
+    try {
+      relocate(array_, size_, a);
+    } catch (...) {
+      a[size_].~T();
+      deallocate(a, c);
+      throw;
+    }
+    array_stats<T>().moved(size_ * sizeof(T));
+    destroy(array_, array_ + size_);
+    deallocate(array_, capacity_);
+
+    array_ = a;
+    capacity_ = c;
+  }
+  array_stats<T>().held(capacity_, size_ + 1);
 
-#if DEBUG_ON
-  dbg("push_back(v)", oc, capacity_, os, size_, array_);
-#endif
+  return array_[size_++];
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 void
-Array<T>::pop_back()
+Array<T, A, G>::pop_back()
 {
-#if DEBUG_ON
-  size_t os = size_;
-#endif
-
   --size_;
-
-#if DEBUG_ON
-  dbg("pop_back()", NULT, capacity_, os, size_, array_);
-#endif
+  destroy(array_ + size_, array_ + size_ + 1);
 }
 
-template<typename T>
+// The capacity stays, so refilling up to it allocates nothing.
+template<typename T, typename A, typename G>
 void
-Array<T>::clear()
+Array<T, A, G>::clear()
 {
-  if (array_)
-    delete[] array_;
-  array_ = new T[size_];
-  for (int i = 0; i < size_; i++)
-    array_[i] = T {};
+  array_stats<T>().held(capacity_, size_);
+  destroy(array_, array_ + size_);
+  size_ = 0;
+}
 
-#if DEBUG_ON
-  dbg("clear()", NULT, capacity_, NULT, size_, array_);
-#endif
+// clear() and hand the buffer back as well.
+template<typename T, typename A, typename G>
+void
+Array<T, A, G>::release()
+{
+  array_stats<T>().held(capacity_, size_);
+  destroy(array_, array_ + size_);
+  deallocate(array_, capacity_);
+  array_ = nullptr;
+  capacity_ = 0;
+  size_ = 0;
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 void
-Array<T>::swap(Array<T>& a)
+Array<T, A, G>::swap(Array<T, A, G>& a)
 {
   T* tmpa = a.array_;
   size_t tmpc = a.capacity_;
@@ -361,142 +978,1326 @@ Array<T>::swap(Array<T>& a)
   array_ = tmpa;
   capacity_ = tmpc;
   size_ = tmps;
-
-#if DEBUG_ON
-  dbg("swap(a)", a.capacity_, capacity_, a.size_, size_, &a);
-#endif
+  if constexpr (traits::propagate_on_container_swap::value)
+    std::swap(alloc_, a.alloc_);
 }
 
-template<typename T>
+template<typename T, typename A, typename G>
 void
-Array<T>::append(Array<T>& a)
+Array<T, A, G>::append(const Array<T, A, G>& a)
 {
-#if DEBUG_ON
-  size_t oc = capacity_;
-  size_t os = size_;
-#endif
+  append(a.array_, a.size_);
+}
 
-  for (int i = 0; i < a.size_; i++) {
-    push_back(a[i]);
+// Leaves a empty but with its capacity. An empty array takes a's buffer
+// outright when the two allocators can share it.
+template<typename T, typename A, typename G>
+void
+Array<T, A, G>::append(Array<T, A, G>&& a)
+{
+  if (this == &a) {
+    append(a.array_, a.size_);
+    return;
   }
 
-#if DEBUG_ON
-  dbg("append(a)", oc, capacity_, os, size_, array_);
-#endif
+  if (size_ == 0 && a.capacity_ >= capacity_ &&
+      (traits::is_always_equal::value || alloc_ == a.alloc_)) {
+    std::swap(array_, a.array_);
+    std::swap(capacity_, a.capacity_);
+    std::swap(size_, a.size_);
+  } else {
+    size_t n = a.size_;
+    reserve(size_ + n);
+    if constexpr (trivial) {
+      if (n)
+        std::memcpy(array_ + size_, a.array_, n * sizeof(T));
+    } else {
+      size_t i = 0;
+      try {
+        for (; i < n; ++i)
+          construct(array_ + size_ + i, std::move(a.array_[i]));
+      } catch (...) {
+        destroy(array_ + size_, array_ + size_ + i);
+        throw;
+      }
+    }
+    size_ += n;
+    a.destroy(a.array_, a.array_ + n);
+    a.size_ = 0;
+  }
 }
 
-////////////////////////////////////////////////////////////////////////
-// Array: bonus
-
+// p may point into the array itself.
+template<typename T, typename A, typename G>
+void
+Array<T, A, G>::append(const T* p, size_t n)
+{
+  if (n == 0)
+    return;
+
+  if (p >= array_ && p < array_ + size_) {
+    size_t o = p - array_;
+    reserve(size_ + n);
+    p = array_ + o;
+  } else {
+    reserve(size_ + n);
+  }
+
+  if constexpr (trivial) {
+    std::memcpy(array_ + size_, p, n * sizeof(T));
+  } else {
+    size_t i = 0;
+    try {
+      for (; i < n; ++i)
+        construct(array_ + size_ + i, p[i]);
+    } catch (...) {
+      destroy(array_ + size_, array_ + size_ + i);
+      throw;
+    }
+  }
+  size_ += n;
+}
+
+// Ranges of pointers go to append(p, n). Other ranges that can be
+// walked twice are counted first, so there is a single reservation;
+// those that cannot are pushed one by one. Except for pointers, the
+// range must not be part of the array.
+template<typename T, typename A, typename G>
+template<typename I, typename>
+void
+Array<T, A, G>::append(I first, I last)
+{
+  using category = typename std::iterator_traits<I>::iterator_category;
+  constexpr bool pointer =
+    std::is_same<I, T*>::value || std::is_same<I, const T*>::value;
+
+  if constexpr (pointer) {
+    append(static_cast<const T*>(first), (size_t)(last - first));
+  } else if constexpr (std::is_base_of<std::forward_iterator_tag,
+                                       category>::value) {
+    size_t n = std::distance(first, last);
+    reserve(size_ + n);
+    size_t i = 0;
+    try {
+      for (; first != last; ++first, ++i)
+        construct(array_ + size_ + i, *first);
+    } catch (...) {
+      destroy(array_ + size_, array_ + size_ + i);
+      throw;
+    }
+    size_ += n;
+  } else {
+    for (; first != last; ++first)
+      emplace_back(*first);
+  }
+}
+
+// Trivially copyable elements from a countable range make room with one
+// memmove of the tail. Anything else is appended and rotated into
+// place. Returns the first inserted element. The same restriction on
+// the range applies as for append().
+template<typename T, typename A, typename G>
+template<typename I, typename>
+T*
+Array<T, A, G>::insert(const T* pos, I first, I last)
+{
+  using category = typename std::iterator_traits<I>::iterator_category;
+  constexpr bool pointer =
+    std::is_same<I, T*>::value || std::is_same<I, const T*>::value;
+
+  assert(pos >= array_ && pos <= array_ + size_);
+
+  size_t i = pos - array_;
+
+  if constexpr (trivial && std::is_base_of<std::forward_iterator_tag,
+                                           category>::value) {
+    if constexpr (pointer) {
+      const T* p = first;
+      if (p < array_ + size_ && last > array_) {
+        Array<T> tmp;
+        tmp.append(p, last - p);
+        return insert(pos, tmp.begin(), tmp.end());
+      }
+    }
+
+    size_t n = std::distance(first, last);
+    reserve(size_ + n);
+    T* at = array_ + i;
+    if (n && i < size_)
+      std::memmove(at + n, at, (size_ - i) * sizeof(T));
+    if constexpr (pointer) {
+      if (n)
+        std::memcpy(at, static_cast<const T*>(first), n * sizeof(T));
+    } else {
+      std::copy(first, last, at);
+    }
+    size_ += n;
+  } else {
+    size_t m = size_;
+    append(first, last);
+    std::rotate(array_ + i, array_ + m, array_ + size_);
+  }
+
+  return array_ + i;
+}
+
+// Returns the element that followed the erased ones.
+template<typename T, typename A, typename G>
+T*
+Array<T, A, G>::erase(const T* first, const T* last)
+{
+  assert(array_ <= first && first <= last && last <= array_ + size_);
+
+  T* f = array_ + (first - array_);
+  T* l = array_ + (last - array_);
+  if (f == l)
+    return f;
+
+  T* e = array_ + size_;
+  T* w;
+  if constexpr (trivial) {
+    std::memmove(f, l, (e - l) * sizeof(T));
+    w = f + (e - l);
+  } else {
+    w = std::move(l, e, f);
+  }
+  destroy(w, e);
+  size_ = w - array_;
+
+  return f;
+}
+
+// Removes every element for which pred holds, keeping the order of the
+// rest, in one pass that asks pred once per element, in order.
+// Trivially copyable elements are moved a run of survivors at a time.
+// Returns how many were removed.
+template<typename T, typename A, typename G>
+template<typename P>
+size_t
+Array<T, A, G>::erase_if(P pred)
+{
+  T* e = array_ + size_;
+  T* w;
+  if constexpr (trivial) {
+    // [k, r) is the run of survivors that r is extending; it moves down
+    // to w when a removed element ends it
+    w = array_;
+    T* k = array_;
+    for (T* r = array_; r != e; ++r) {
+      if (!pred(*r))
+        continue;
+      if (w != k)
+        std::memmove(w, k, (r - k) * sizeof(T));
+      w += r - k;
+      k = r + 1;
+    }
+    if (w != k)
+      std::memmove(w, k, (e - k) * sizeof(T));
+    w += e - k;
+  } else {
+    w = std::remove_if(array_, e, pred);
+  }
+  destroy(w, e);
+  size_t n = e - w;
+  size_ = w - array_;
+
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Array: bonus
+
 //// rule of five
 
 // destructor
-template<typename T>
-Array<T>::~Array()
+template<typename T, typename A, typename G>
+Array<T, A, G>::~Array()
 {
-  if (array_)
-    delete[] array_;
-
-#if DEBUG_ON
-  dbg("~Array()", NULT, NULT, NULT, NULT, array_);
-#endif
+  array_stats<T>().held(capacity_, size_);
+  destroy(array_, array_ + size_);
+  deallocate(array_, capacity_);
 }
 
 // copy constructor
-template<typename T>
-Array<T>::Array(const Array<T>& a)
+template<typename T, typename A, typename G>
+Array<T, A, G>::Array(const Array<T, A, G>& a)
+  : Array(a, traits::select_on_container_copy_construction(a.alloc_))
+{
+}
+
+template<typename T, typename A, typename G>
+Array<T, A, G>::Array(const Array<T, A, G>& a, const A& alloc)
+  : alloc_(alloc)
 {
   capacity_ = a.capacity_;
-  size_ = a.size_;
-  array_ = new T[size_];
-  for (int i = 0; i < size_; i++) {
-    if (!a.array_[i])
-      array_[i] = T {};
-    else
-      array_[i] = a.array_[i];
+  array_ = allocate(capacity_);
+  size_ = 0;
+  if constexpr (trivial) {
+    if (a.size_)
+      std::memcpy(array_, a.array_, a.size_ * sizeof(T));
+    size_ = a.size_;
+  }
+  try {
+    for (; size_ < a.size_; ++size_)
+      construct(array_ + size_, a.array_[size_]);
+  } catch (...) {
+    destroy(array_, array_ + size_);
+    deallocate(array_, capacity_);
+    throw;
   }
-
-#if DEBUG_ON
-  dbg("Array(cp)(a)", NULT, capacity_, NULT, size_, array_);
-#endif
 }
 
 // move constructor
-template<typename T>
-Array<T>::Array(Array<T>&& a)
+template<typename T, typename A, typename G>
+Array<T, A, G>::Array(Array<T, A, G>&& a) noexcept
+  : alloc_(std::move(a.alloc_))
 {
   capacity_ = a.capacity_;
   size_ = a.size_;
   array_ = a.array_;
-  std::__exchange(a.array_, nullptr);
+  a.array_ = nullptr;
+  a.capacity_ = 0;
+  a.size_ = 0;
+}
+// copy assignment
+template<typename T, typename A, typename G>
+Array<T, A, G>&
+Array<T, A, G>::operator=(const Array<T, A, G>& a)
+{
+  if (this == &a)
+    return *this;
+
+  if constexpr (traits::propagate_on_container_copy_assignment::value) {
+    Array<T, A, G> tmp(a, a.alloc_);
+    adopt(tmp);
+  } else {
+    Array<T, A, G> tmp(a, alloc_);
+    adopt(tmp);
+  }
+  return *this;
+}
 
-#if DEBUG_ON
-  dbg("Array(mv)(a)", oc, capacity_, os, size_, array_);
-#endif
+// move assignment
+template<typename T, typename A, typename G>
+Array<T, A, G>&
+Array<T, A, G>::operator=(Array<T, A, G>&& a) noexcept(steals)
+{
+  if (steals || alloc_ == a.alloc_) {
+    adopt(a);
+    return *this;
+  }
+
+  // a's buffer cannot change hands, so its elements move one by one
+  Array<T, A, G> tmp(alloc_);
+  tmp.reserve(a.size_);
+  for (size_t i = 0; i < a.size_; ++i)
+    tmp.emplace_back(std::move(a.array_[i]));
+  adopt(tmp);
+  return *this;
 }
 
-// copy assignment
+//// iterators
+
+template<typename T, typename A, typename G>
+T const*
+Array<T, A, G>::begin() const {
+  return array_;
+}
+
+template<typename T, typename A, typename G>
+T const*
+Array<T, A, G>::end() const {
+  return array_ + size_;
+}
+
+template<typename T, typename A, typename G>
+T*
+Array<T, A, G>::begin() {
+  return array_;
+}
+
+template<typename T, typename A, typename G>
+T*
+Array<T, A, G>::end() {
+  return array_ + size_;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// arena
+
+// A bump allocator for Array<T, ArenaAllocator<T>>: deallocation is a
+// no-op and everything handed out is returned by a single reset(), so a
+// batch of short-lived arrays costs one free instead of one per array.
+
+class Arena
+{
+
+public:
+  explicit Arena(size_t block = ARENA_MAGNITUDE);
+  ~Arena();
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* take(size_t bytes, size_t align);
+  void reset();
+  size_t used() const;
+
+private:
+  struct Block
+  {
+    Block* next;
+    size_t size;
+  };
+
+  Block* head_;  // newest block, the one being bumped
+  char* cur_;    // next free byte in head_
+  char* end_;    // end of head_
+  size_t block_; // minimum block size
+  size_t used_;  // bytes handed out since the last reset
+};
+
 template<typename T>
-Array<T>&
-Array<T>::operator=(const Array<T>& a)
+struct ArenaAllocator
 {
-#if DEBUG_ON
-  size_t oc = capacity_;
-  size_t os = size_;
-#endif
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
 
-  Array<T> tmp(a);
-  tmp.swap(*this);
-  return *this;
+  Arena* arena;
 
-#if DEBUG_ON
-  dbg("operator=(cp)(a)", oc, capacity_, os, size_, array_);
+  ArenaAllocator(Arena& a) : arena(&a) {}
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U>& a) : arena(a.arena) {}
+
+  T* allocate(size_t n)
+  {
+    return static_cast<T*>(arena->take(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+};
+
+template<typename T, typename U>
+bool
+operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+  return a.arena == b.arena;
+}
+
+template<typename T, typename U>
+bool
+operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+  return a.arena != b.arena;
+}
+
+inline
+Arena::Arena(size_t block)
+  : head_(nullptr), cur_(nullptr), end_(nullptr), block_(block), used_(0)
+{
+}
+
+inline
+Arena::~Arena()
+{
+  while (head_) {
+    Block* next = head_->next;
+    std::free(head_);
+    head_ = next;
+  }
+}
+
+inline void*
+Arena::take(size_t bytes, size_t align)
+{
+  uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(align - 1);
+  if (!head_ || p + bytes > reinterpret_cast<uintptr_t>(end_)) {
+    size_t size = sizeof(Block) + align + bytes;
+    if (size < block_)
+      size = block_;
+    Block* b = static_cast<Block*>(std::malloc(size));
+    if (!b)
+      throw std::bad_alloc();
+    b->next = head_;
+    b->size = size;
+    head_ = b;
+    cur_ = reinterpret_cast<char*>(b + 1);
+    end_ = reinterpret_cast<char*>(b) + size;
+    p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(align - 1);
+  }
+  cur_ = reinterpret_cast<char*>(p + bytes);
+  used_ += bytes;
+  return reinterpret_cast<void*>(p);
+}
+
+// Keep the newest block for reuse and free the rest.
+inline void
+Arena::reset()
+{
+  if (!head_)
+    return;
+  while (head_->next) {
+    Block* next = head_->next->next;
+    std::free(head_->next);
+    head_->next = next;
+  }
+  cur_ = reinterpret_cast<char*>(head_ + 1);
+  used_ = 0;
+}
+
+inline size_t
+Arena::used() const
+{
+  return used_;
+}
+
+////////////////////////////////////////////////////////////////////////
+// aligned storage
+
+// An allocator whose blocks start on an Align boundary, through aligned
+// operator new. At CACHE_LINE, no element of a suitably sized T
+// straddles two lines and SIMD loads over the array never split one. On
+// linux, when Align is a whole number of pages, blocks of at least a
+// HUGE_PAGE are also advised to be backed by huge pages, which cuts TLB
+// misses over big arrays; at HUGE_PAGE alignment every such page can be
+// huge.
+
+template<typename T, size_t Align = CACHE_LINE>
+struct AlignedAllocator
+{
+  static_assert(Align && !(Align & (Align - 1)),
+                "alignment must be a power of two");
+  static_assert(Align >= alignof(T), "alignment below that of T");
+
+  using value_type = T;
+  static constexpr size_t alignment = Align;
+
+  template<typename U>
+  struct rebind
+  {
+    using other = AlignedAllocator<U, Align>;
+  };
+
+  AlignedAllocator() = default;
+  template<typename U>
+  AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+  T* allocate(size_t n)
+  {
+    void* p = ::operator new(n * sizeof(T), std::align_val_t(Align));
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if constexpr (Align % 4096 == 0)
+      if (n * sizeof(T) >= HUGE_PAGE)
+        madvise(p, n * sizeof(T) / 4096 * 4096, MADV_HUGEPAGE);
 #endif
+    return static_cast<T*>(p);
+  }
+  void deallocate(T* p, size_t n)
+  {
+    ::operator delete(p, n * sizeof(T), std::align_val_t(Align));
+  }
+};
+
+template<typename T, typename U, size_t Align>
+bool
+operator==(const AlignedAllocator<T, Align>&,
+           const AlignedAllocator<U, Align>&)
+{
+  return true;
 }
 
-// move assignment
+template<typename T, typename U, size_t Align>
+bool
+operator!=(const AlignedAllocator<T, Align>&,
+           const AlignedAllocator<U, Align>&)
+{
+  return false;
+}
+
+// Array storage on an Align boundary, e.g. AlignedArray<float> for SIMD
+// loops. HugeArray also grows in whole huge pages.
+template<typename T, size_t Align = CACHE_LINE>
+using AlignedArray = Array<T, AlignedAllocator<T, Align>>;
+
 template<typename T>
-Array<T>&
-Array<T>::operator=(Array<T>&& a)
+using HugeArray =
+  Array<T, AlignedAllocator<T, HUGE_PAGE>, PageGrowth<HUGE_PAGE>>;
+
+////////////////////////////////////////////////////////////////////////
+// SmallArray declaration
+
+// An Array that keeps up to N elements inside the object itself and only
+// spills to the heap past N, so short arrays never allocate.
+
+template <typename T, size_t N = 8>
+class SmallArray
 {
-#if DEBUG_ON
-  size_t oc = capacity_;
-  size_t os = size_;
-#endif
 
-  std::swap(capacity_, a.capacity_);
-  std::swap(size_, a.size_);
-  std::swap(array_, a.array_);
+  static_assert(N > 0, "SmallArray needs inline room");
+
+public:
+  // constructors
+  SmallArray();
+  SmallArray(size_t n);
+  SmallArray(size_t n, const T& v);
+
+  // operators
+  T operator[](size_t i) const;
+  T& operator[](size_t i);
+
+  // accessors
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+  bool small() const;
+  T back() const;
+  T front() const;
+  T& back();
+  T& front();
+
+  // mutators
+  void reserve(size_t n);
+  void resize(size_t n);
+  void shrink_to_fit();
+  void push_back(const T& v);
+  void push_back(T&& v);
+  template<typename... Args>
+  T& emplace_back(Args&&... args);
+  void pop_back();
+  void clear();
+  void release();
+  void swap(SmallArray<T, N>& a);
+  void append(SmallArray<T, N>& a);
+
+  // bonus
+  ~SmallArray();
+  SmallArray(const SmallArray<T, N>& a);
+  SmallArray(SmallArray<T, N>&& a)
+    noexcept(std::is_nothrow_move_constructible<T>::value);
+  SmallArray<T, N>& operator=(const SmallArray<T, N>& a);
+  SmallArray<T, N>& operator=(SmallArray<T, N>&& a)
+    noexcept(std::is_nothrow_move_constructible<T>::value);
+  T const* begin() const;
+  T const* end() const;
+  T* begin();
+  T* end();
+
+private:
+  T* array_;         // inline_ or a heap block
+  size_t capacity_;  // N while inline
+  size_t size_;      // constructed
+  alignas(T) unsigned char inline_[N * sizeof(T)];
+
+  static constexpr bool trivial = std::is_trivially_copyable<T>::value;
+  T* local();
+  void move_to(T* a, size_t c);
+  static void destroy(T* first, T* last);
+  static void relocate(T* from, size_t n, T* to);
+};
+
+////////////////////////////////////////////////////////////////////////
+// SmallArray storage
+
+template<typename T, size_t N>
+T*
+SmallArray<T, N>::local()
+{
+  return reinterpret_cast<T*>(inline_);
+}
+
+// Relocate the elements into a, which holds c slots, and let go of the
+// old block unless it is the inline one. If relocating throws, nothing
+// has changed and a is still the caller's to free.
+template<typename T, size_t N>
+void
+SmallArray<T, N>::move_to(T* a, size_t c)
+{
+  relocate(array_, size_, a);
+  destroy(array_, array_ + size_);
+  if (array_ != local())
+    raw_free(array_, capacity_ * sizeof(T), alignof(T));
+  array_ = a;
+  capacity_ = c;
+}
+
+template<typename T, size_t N>
+void
+SmallArray<T, N>::destroy(T* first, T* last)
+{
+  if constexpr (!std::is_trivially_destructible<T>::value)
+    for (; first != last; ++first)
+      first->~T();
+}
+
+template<typename T, size_t N>
+void
+SmallArray<T, N>::relocate(T* from, size_t n, T* to)
+{
+  if constexpr (trivial) {
+    if (n)
+      std::memcpy(to, from, n * sizeof(T));
+    return;
+  }
+
+  size_t i = 0;
+  try {
+    for (; i < n; ++i)
+      new (to + i) T(std::move_if_noexcept(from[i]));
+  } catch (...) {
+    destroy(to, to + i);
+    throw;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// SmallArray constructors
+
+template<typename T, size_t N>
+SmallArray<T, N>::SmallArray()
+  : array_(local()), capacity_(N), size_(0)
+{
+}
+
+template<typename T, size_t N>
+SmallArray<T, N>::SmallArray(size_t n)
+  : SmallArray()
+{
+  resize(n);
+}
+
+template<typename T, size_t N>
+SmallArray<T, N>::SmallArray(size_t n, const T& v)
+  : SmallArray()
+{
+  reserve(n);
+  while (size_ < n)
+    push_back(v);
+}
+
+////////////////////////////////////////////////////////////////////////
+// SmallArray operators
+
+template<typename T, size_t N>
+T
+SmallArray<T, N>::operator[](size_t i) const
+{
+  assert(i < size_);
+
+  return array_[i];
+}
+
+template<typename T, size_t N>
+T&
+SmallArray<T, N>::operator[](size_t i)
+{
+  assert(i < size_);
+
+  return array_[i];
+}
+
+////////////////////////////////////////////////////////////////////////
+// SmallArray accessors
+
+template<typename T, size_t N>
+size_t
+SmallArray<T, N>::size() const
+{
+  return size_;
+}
+
+template<typename T, size_t N>
+size_t
+SmallArray<T, N>::capacity() const
+{
+  return capacity_;
+}
+
+template<typename T, size_t N>
+bool
+SmallArray<T, N>::empty() const
+{
+  return size_ == 0;
+}
+
+template<typename T, size_t N>
+bool
+SmallArray<T, N>::small() const
+{
+  return array_ == reinterpret_cast<const T*>(inline_);
+}
+
+template<typename T, size_t N>
+T
+SmallArray<T, N>::back() const
+{
+  return array_[size_ - 1];
+}
+
+template<typename T, size_t N>
+T
+SmallArray<T, N>::front() const
+{
+  return array_[0];
+}
+
+template<typename T, size_t N>
+T&
+SmallArray<T, N>::back()
+{
+  return array_[size_ - 1];
+}
+
+template<typename T, size_t N>
+T&
+SmallArray<T, N>::front()
+{
+  return array_[0];
+}
+
+////////////////////////////////////////////////////////////////////////
+// SmallArray mutators
+
+template<typename T, size_t N>
+void
+SmallArray<T, N>::reserve(size_t n)
+{
+  if (n <= capacity_)
+    return;
+
+  size_t c = pow2(n);
+  T* a = static_cast<T*>(raw_alloc(c * sizeof(T), alignof(T)));
+  try {
+    move_to(a, c);
+  } catch (...) {
+    raw_free(a, c * sizeof(T), alignof(T));
+    throw;
+  }
+}
+
+template<typename T, size_t N>
+void
+SmallArray<T, N>::resize(size_t n)
+{
+  if (n > capacity_)
+    reserve(n);
+  for (; size_ < n; ++size_)
+    new (array_ + size_) T {};
+  if (n < size_) {
+    destroy(array_ + n, array_ + size_);
+    size_ = n;
+  }
+}
+
+// Back inline when the elements fit, otherwise down to an exact block.
+template<typename T, size_t N>
+void
+SmallArray<T, N>::shrink_to_fit()
+{
+  if (small() || size_ == capacity_)
+    return;
+
+  if (size_ <= N) {
+    move_to(local(), N);
+    return;
+  }
+  T* a = static_cast<T*>(raw_alloc(size_ * sizeof(T), alignof(T)));
+  try {
+    move_to(a, size_);
+  } catch (...) {
+    raw_free(a, size_ * sizeof(T), alignof(T));
+    throw;
+  }
+}
+
+template<typename T, size_t N>
+void
+SmallArray<T, N>::push_back(const T& v)
+{
+  emplace_back(v);
+}
+
+template<typename T, size_t N>
+void
+SmallArray<T, N>::push_back(T&& v)
+{
+  emplace_back(std::move(v));
+}
+
+template<typename T, size_t N>
+template<typename... Args>
+T&
+SmallArray<T, N>::emplace_back(Args&&... args)
+{
+  if (size_ < capacity_) {
+    new (array_ + size_) T(std::forward<Args>(args)...);
+    return array_[size_++];
+  }
+
+  // built first, since args may refer into the old block
+  size_t c = pow2(size_ + 1);
+  T* a = static_cast<T*>(raw_alloc(c * sizeof(T), alignof(T)));
+  try {
+    new (a + size_) T(std::forward<Args>(args)...);
+  } catch (...) {
+    raw_free(a, c * sizeof(T), alignof(T));
+    throw;
+  }
+  try {
+    move_to(a, c);
+  } catch (...) {
+    a[size_].~T();
+    raw_free(a, c * sizeof(T), alignof(T));
+    throw;
+  }
+  return array_[size_++];
+}
+
+template<typename T, size_t N>
+void
+SmallArray<T, N>::pop_back()
+{
+  --size_;
+  destroy(array_ + size_, array_ + size_ + 1);
+}
+
+template<typename T, size_t N>
+void
+SmallArray<T, N>::clear()
+{
+  destroy(array_, array_ + size_);
+  size_ = 0;
+}
+
+// clear() and go back inline.
+template<typename T, size_t N>
+void
+SmallArray<T, N>::release()
+{
+  clear();
+  shrink_to_fit();
+}
+
+template<typename T, size_t N>
+void
+SmallArray<T, N>::swap(SmallArray<T, N>& a)
+{
+  if (!small() && !a.small()) {
+    std::swap(array_, a.array_);
+    std::swap(capacity_, a.capacity_);
+    std::swap(size_, a.size_);
+    return;
+  }
+
+  SmallArray<T, N> tmp(std::move(a));
+  a = std::move(*this);
+  *this = std::move(tmp);
+}
+
+template<typename T, size_t N>
+void
+SmallArray<T, N>::append(SmallArray<T, N>& a)
+{
+  size_t n = a.size_; // a may be *this
+  reserve(size_ + n);
+  for (size_t i = 0; i < n; i++)
+    push_back(a.array_[i]);
+}
+
+////////////////////////////////////////////////////////////////////////
+// SmallArray: bonus
+
+//// rule of five
+
+// destructor
+template<typename T, size_t N>
+SmallArray<T, N>::~SmallArray()
+{
+  destroy(array_, array_ + size_);
+  if (!small())
+    raw_free(array_, capacity_ * sizeof(T), alignof(T));
+}
+
+// copy constructor
+template<typename T, size_t N>
+SmallArray<T, N>::SmallArray(const SmallArray<T, N>& a)
+  : SmallArray()
+{
+  reserve(a.size_);
+  if constexpr (trivial) {
+    if (a.size_)
+      std::memcpy(array_, a.array_, a.size_ * sizeof(T));
+    size_ = a.size_;
+  }
+  for (; size_ < a.size_; ++size_)
+    new (array_ + size_) T(a.array_[size_]);
+}
+
+// move constructor
+template<typename T, size_t N>
+SmallArray<T, N>::SmallArray(SmallArray<T, N>&& a)
+  noexcept(std::is_nothrow_move_constructible<T>::value)
+  : SmallArray()
+{
+  *this = std::move(a);
+}
+
+// copy assignment
+template<typename T, size_t N>
+SmallArray<T, N>&
+SmallArray<T, N>::operator=(const SmallArray<T, N>& a)
+{
+  if (this != &a) {
+    SmallArray<T, N> tmp(a);
+    *this = std::move(tmp);
+  }
   return *this;
+}
 
-#if DEBUG_ON
-  dbg("operator=(mv)(a)", oc, capacity_, os, size_, array_);
-#endif
+// move assignment
+template<typename T, size_t N>
+SmallArray<T, N>&
+SmallArray<T, N>::operator=(SmallArray<T, N>&& a)
+  noexcept(std::is_nothrow_move_constructible<T>::value)
+{
+  if (this == &a)
+    return *this;
+
+  destroy(array_, array_ + size_);
+  size_ = 0;
+
+  // a heap block changes hands, inline elements have to move
+  if (!a.small()) {
+    if (!small())
+      raw_free(array_, capacity_ * sizeof(T), alignof(T));
+    array_ = a.array_;
+    capacity_ = a.capacity_;
+    size_ = a.size_;
+    a.array_ = a.local();
+    a.capacity_ = N;
+    a.size_ = 0;
+    return *this;
+  }
+
+  for (; size_ < a.size_; ++size_)
+    new (array_ + size_) T(std::move(a.array_[size_]));
+  destroy(a.array_, a.array_ + a.size_);
+  a.size_ = 0;
+  return *this;
 }
 
 //// iterators
 
-template<typename T>
+template<typename T, size_t N>
 T const*
-Array<T>::begin() const {
+SmallArray<T, N>::begin() const {
   return array_;
 }
 
-template<typename T>
+template<typename T, size_t N>
 T const*
-Array<T>::end() const {
+SmallArray<T, N>::end() const {
   return array_ + size_;
 }
 
-template<typename T>
+template<typename T, size_t N>
 T*
-Array<T>::begin() {
+SmallArray<T, N>::begin() {
   return array_;
 }
 
-template<typename T>
+template<typename T, size_t N>
 T*
-Array<T>::end() {
+SmallArray<T, N>::end() {
   return array_ + size_;
 }
 
+////////////////////////////////////////////////////////////////////////
+// StaticArray declaration
+
+// An Array with a fixed bound of N that never allocates. Every member is
+// constexpr, so tables can be filled at compile time, and loops over it
+// see a bound the compiler knows. T must be default constructible: all
+// N slots hold an object, the ones past size() a default one.
+
+template <typename T, size_t N>
+class StaticArray
+{
+
+public:
+  // constructors
+  constexpr StaticArray();
+  constexpr StaticArray(size_t n);
+  constexpr StaticArray(size_t n, const T& v);
+
+  // operators
+  constexpr T operator[](size_t i) const;
+  constexpr T& operator[](size_t i);
+
+  // accessors
+  constexpr size_t size() const;
+  constexpr size_t capacity() const;
+  constexpr bool empty() const;
+  constexpr bool full() const;
+  constexpr T back() const;
+  constexpr T front() const;
+  constexpr T& back();
+  constexpr T& front();
+
+  // mutators
+  constexpr void reserve(size_t n);
+  constexpr void resize(size_t n);
+  constexpr void push_back(const T& v);
+  constexpr void push_back(T&& v);
+  template<typename... Args>
+  constexpr T& emplace_back(Args&&... args);
+  constexpr void pop_back();
+  constexpr void clear();
+  constexpr void swap(StaticArray<T, N>& a);
+  template<size_t M>
+  constexpr void append(const StaticArray<T, M>& a);
+
+  // iterators
+  constexpr T const* begin() const;
+  constexpr T const* end() const;
+  constexpr T* begin();
+  constexpr T* end();
+
+private:
+  T array_[N];  // all slots, live up to size_
+  size_t size_;
+};
+
+////////////////////////////////////////////////////////////////////////
+// StaticArray constructors
+
+template<typename T, size_t N>
+constexpr
+StaticArray<T, N>::StaticArray()
+  : array_ {}, size_(0)
+{
+}
+
+template<typename T, size_t N>
+constexpr
+StaticArray<T, N>::StaticArray(size_t n)
+  : array_ {}, size_(n)
+{
+  assert(n <= N);
+}
+
+template<typename T, size_t N>
+constexpr
+StaticArray<T, N>::StaticArray(size_t n, const T& v)
+  : array_ {}, size_(n)
+{
+  assert(n <= N);
+
+  for (size_t i = 0; i < n; i++)
+    array_[i] = v;
+}
+
+////////////////////////////////////////////////////////////////////////
+// StaticArray operators
+
+template<typename T, size_t N>
+constexpr T
+StaticArray<T, N>::operator[](size_t i) const
+{
+  assert(i < size_);
+
+  return array_[i];
+}
+
+template<typename T, size_t N>
+constexpr T&
+StaticArray<T, N>::operator[](size_t i)
+{
+  assert(i < size_);
+
+  return array_[i];
+}
+
+////////////////////////////////////////////////////////////////////////
+// StaticArray accessors
+
+template<typename T, size_t N>
+constexpr size_t
+StaticArray<T, N>::size() const
+{
+  return size_;
+}
+
+template<typename T, size_t N>
+constexpr size_t
+StaticArray<T, N>::capacity() const
+{
+  return N;
+}
+
+template<typename T, size_t N>
+constexpr bool
+StaticArray<T, N>::empty() const
+{
+  return size_ == 0;
+}
+
+template<typename T, size_t N>
+constexpr bool
+StaticArray<T, N>::full() const
+{
+  return size_ == N;
+}
+
+template<typename T, size_t N>
+constexpr T
+StaticArray<T, N>::back() const
+{
+  return array_[size_ - 1];
+}
+
+template<typename T, size_t N>
+constexpr T
+StaticArray<T, N>::front() const
+{
+  return array_[0];
+}
+
+template<typename T, size_t N>
+constexpr T&
+StaticArray<T, N>::back()
+{
+  return array_[size_ - 1];
+}
+
+template<typename T, size_t N>
+constexpr T&
+StaticArray<T, N>::front()
+{
+  return array_[0];
+}
+
+////////////////////////////////////////////////////////////////////////
+// StaticArray mutators
+
+template<typename T, size_t N>
+constexpr void
+StaticArray<T, N>::reserve(size_t n)
+{
+  assert(n <= N);
+}
+
+template<typename T, size_t N>
+constexpr void
+StaticArray<T, N>::resize(size_t n)
+{
+  assert(n <= N);
+
+  for (size_t i = n; i < size_; i++)
+    array_[i] = T {};
+  size_ = n;
+}
+
+template<typename T, size_t N>
+constexpr void
+StaticArray<T, N>::push_back(const T& v)
+{
+  assert(size_ < N);
+
+  array_[size_++] = v;
+}
+
+template<typename T, size_t N>
+constexpr void
+StaticArray<T, N>::push_back(T&& v)
+{
+  assert(size_ < N);
+
+  array_[size_++] = std::move(v);
+}
+
+template<typename T, size_t N>
+template<typename... Args>
+constexpr T&
+StaticArray<T, N>::emplace_back(Args&&... args)
+{
+  assert(size_ < N);
+
+  array_[size_] = T(std::forward<Args>(args)...);
+  return array_[size_++];
+}
+
+// The slot is reset so that it lets go of whatever it owned.
+template<typename T, size_t N>
+constexpr void
+StaticArray<T, N>::pop_back()
+{
+  assert(size_ > 0);
+
+  array_[--size_] = T {};
+}
+
+// As pop_back(), every slot is reset.
+template<typename T, size_t N>
+constexpr void
+StaticArray<T, N>::clear()
+{
+  for (size_t i = 0; i < size_; i++)
+    array_[i] = T {};
+  size_ = 0;
+}
+
+template<typename T, size_t N>
+constexpr void
+StaticArray<T, N>::swap(StaticArray<T, N>& a)
+{
+  size_t n = size_ > a.size_ ? size_ : a.size_;
+  for (size_t i = 0; i < n; i++) {
+    T tmp = std::move(array_[i]);
+    array_[i] = std::move(a.array_[i]);
+    a.array_[i] = std::move(tmp);
+  }
+  size_t tmps = size_;
+  size_ = a.size_;
+  a.size_ = tmps;
+}
+
+template<typename T, size_t N>
+template<size_t M>
+constexpr void
+StaticArray<T, N>::append(const StaticArray<T, M>& a)
+{
+  size_t n = a.size(); // a may be *this
+  assert(size_ + n <= N);
+
+  for (size_t i = 0; i < n; i++)
+    array_[size_ + i] = a.begin()[i];
+  size_ += n;
+}
+
+////////////////////////////////////////////////////////////////////////
+// StaticArray iterators
+
+template<typename T, size_t N>
+constexpr T const*
+StaticArray<T, N>::begin() const {
+  return array_;
+}
+
+template<typename T, size_t N>
+constexpr T const*
+StaticArray<T, N>::end() const {
+  return array_ + size_;
+}
+
+template<typename T, size_t N>
+constexpr T*
+StaticArray<T, N>::begin() {
+  return array_;
+}
+
+template<typename T, size_t N>
+constexpr T*
+StaticArray<T, N>::end() {
+  return array_ + size_;
+}
@@ -0,0 +1,371 @@
+// file: array/bench.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h> // getrusage
+
+#include "array.hpp"
+
+#define BENCH_MAGNITUDE 10000000 // element operations per measurement
+#define BENCH_ROUNDS 3
+#define BENCH_SMALL 1000         // elements in a small container
+#define BENCH_LARGE 1000000      // elements in a large container
+
+////////////////////////////////////////////////////////////////////////
+// element types
+
+// A double that is not trivially copyable, which forces Array onto the
+// element-by-element path.
+struct Boxed
+{
+  double v;
+  Boxed() : v(0) {}
+  Boxed(double d) : v(d) {}
+  Boxed(const Boxed& b) : v(b.v) {}
+  Boxed& operator=(const Boxed& b) { v = b.v; return *this; }
+  operator double() const { return v; }
+};
+
+// a cache line of plain data
+struct Wide
+{
+  double v[8];
+  Wide() = default;
+  Wide(double d) : v {d} {}
+  operator double() const { return v[0]; }
+};
+
+// owns a string short enough to stay inline, so moves are cheap but not
+// memcpy
+struct Named
+{
+  std::string s;
+  Named() {}
+  Named(double d) : s(8, 'a' + (long)d % 26) {}
+  operator double() const { return s[0]; }
+};
+
+////////////////////////////////////////////////////////////////////////
+// containers
+
+// std::allocator with a count of the blocks it hands out; Array keeps
+// its own in array_stats().
+size_t vector_allocations = 0;
+
+template<typename T>
+struct Counted : std::allocator<T>
+{
+  template<typename U>
+  struct rebind
+  {
+    using other = Counted<U>;
+  };
+
+  Counted() = default;
+  template<typename U>
+  Counted(const Counted<U>&) {}
+
+  T* allocate(size_t n)
+  {
+    ++vector_allocations;
+    return std::allocator<T>::allocate(n);
+  }
+};
+
+template<typename T>
+using Vector = std::vector<T, Counted<T>>;
+
+template<typename T>
+size_t
+allocations(const Array<T>*)
+{
+  return array_stats<T>().allocations();
+}
+
+template<typename T>
+size_t
+allocations(const Vector<T>*)
+{
+  return vector_allocations;
+}
+
+template<typename T>
+void
+append(Array<T>& a, const Array<T>& b)
+{
+  a.append(b);
+}
+
+template<typename T>
+void
+append(Vector<T>& a, const Vector<T>& b)
+{
+  a.insert(a.end(), b.begin(), b.end());
+}
+
+////////////////////////////////////////////////////////////////////////
+// measurement
+
+// Peak resident set in MB. On linux the peak is reset before every
+// measurement through clear_refs; elsewhere it is the peak of the run
+// so far.
+void
+reset_peak()
+{
+#ifdef __linux__
+  if (FILE* f = std::fopen("/proc/self/clear_refs", "w")) {
+    std::fputs("5", f);
+    std::fclose(f);
+  }
+#endif
+}
+
+double
+peak_mb()
+{
+#ifdef __linux__
+  if (FILE* f = std::fopen("/proc/self/status", "r")) {
+    char line[256];
+    long kb = -1;
+    while (std::fgets(line, sizeof(line), f))
+      if (std::sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+        break;
+    std::fclose(f);
+    if (kb >= 0)
+      return kb / 1024.0;
+  }
+#endif
+  struct rusage u;
+  getrusage(RUSAGE_SELF, &u);
+  return u.ru_maxrss / 1024.0;
+}
+
+struct Result
+{
+  double ns;     // per element operation, best round
+  size_t allocs; // per round
+  double peak;   // MB
+};
+
+double sink = 0; // keeps the optimizer from dropping the work
+
+// Runs f BENCH_ROUNDS times; f does ops element operations a round.
+template<typename C, typename F>
+Result
+measure(size_t ops, F f)
+{
+  Result r {0, 0, 0};
+  size_t a0 = allocations((C*)nullptr);
+  reset_peak();
+  for (int k = 0; k < BENCH_ROUNDS; ++k) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    double d = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    if (k == 0 || d < r.ns)
+      r.ns = d;
+  }
+  r.ns /= ops;
+  r.allocs = (allocations((C*)nullptr) - a0) / BENCH_ROUNDS;
+  r.peak = peak_mb();
+  return r;
+}
+
+////////////////////////////////////////////////////////////////////////
+// operations
+
+// Each operation works on containers of n elements, reps times over.
+// The source container a and the random index order are built
+// beforehand and not counted.
+
+template<typename C>
+struct Suite
+{
+  using T = typename std::decay<decltype(*std::declval<C>().begin())>::type;
+
+  size_t n, reps;
+  C a;
+  std::vector<size_t> order;
+
+  Suite(size_t n, size_t reps) : n(n), reps(reps)
+  {
+    for (size_t i = 0; i < n; ++i)
+      a.push_back(T(double(i)));
+    std::srand(1);
+    for (size_t i = 0; i < n; ++i)
+      order.push_back(std::rand() % n);
+  }
+
+  Result push_back()
+  {
+    return measure<C>(n * reps, [&] {
+      for (size_t r = 0; r < reps; ++r) {
+        C c;
+        for (size_t i = 0; i < n; ++i)
+          c.push_back(T(double(i)));
+        sink += c.back();
+      }
+    });
+  }
+
+  Result reserve_fill()
+  {
+    return measure<C>(n * reps, [&] {
+      for (size_t r = 0; r < reps; ++r) {
+        C c;
+        c.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+          c.push_back(T(double(i)));
+        sink += c.back();
+      }
+    });
+  }
+
+  Result iterate()
+  {
+    return measure<C>(n * reps, [&] {
+      for (size_t r = 0; r < reps; ++r) {
+        double s = 0;
+        for (const T& x : a)
+          s += x;
+        sink += s;
+      }
+    });
+  }
+
+  Result random()
+  {
+    return measure<C>(n * reps, [&] {
+      for (size_t r = 0; r < reps; ++r) {
+        double s = 0;
+        for (size_t i : order)
+          s += a[i];
+        sink += s;
+      }
+    });
+  }
+
+  // the second append grows a container that is already full
+  Result append()
+  {
+    return measure<C>(2 * n * reps, [&] {
+      for (size_t r = 0; r < reps; ++r) {
+        C c;
+        ::append(c, a);
+        ::append(c, a);
+        sink += c.size();
+      }
+    });
+  }
+
+  Result copy()
+  {
+    return measure<C>(n * reps, [&] {
+      for (size_t r = 0; r < reps; ++r) {
+        C c(a);
+        sink += c.size();
+      }
+    });
+  }
+
+  Result move()
+  {
+    return measure<C>(n * reps, [&] {
+      for (size_t r = 0; r < reps; ++r) {
+        C c(std::move(a));
+        a = std::move(c);
+        sink += a.size();
+      }
+    });
+  }
+
+  // the first fill grows, every later one should reuse its capacity
+  Result clear_refill()
+  {
+    return measure<C>(n * reps, [&] {
+      C c;
+      for (size_t r = 0; r < reps; ++r) {
+        c.clear();
+        for (size_t i = 0; i < n; ++i)
+          c.push_back(T(double(i)));
+        sink += c.size();
+      }
+    });
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+// report
+
+void
+row(const char* type, const char* op, Result a, Result v)
+{
+  std::printf("%-7s %-13s %8.2f %8.2f %9zu %9zu %9.1f %9.1f\n",
+              type, op, a.ns, v.ns, a.allocs, v.allocs, a.peak, v.peak);
+}
+
+template<typename T>
+void
+run(const char* type, size_t n)
+{
+  size_t reps = BENCH_MAGNITUDE / n;
+  if (reps == 0)
+    reps = 1;
+
+  Suite<Array<T>> a(n, reps);
+  Suite<Vector<T>> v(n, reps);
+
+  row(type, "push_back", a.push_back(), v.push_back());
+  row(type, "reserve_fill", a.reserve_fill(), v.reserve_fill());
+  row(type, "iterate", a.iterate(), v.iterate());
+  row(type, "random", a.random(), v.random());
+  row(type, "append", a.append(), v.append());
+  row(type, "copy", a.copy(), v.copy());
+  row(type, "move", a.move(), v.move());
+  row(type, "clear_refill", a.clear_refill(), v.clear_refill());
+}
+
+void
+table(size_t n)
+{
+  std::printf("\nn = %zu, %d rounds\n", n, BENCH_ROUNDS);
+  std::printf("%-7s %-13s %17s %19s %19s\n",
+              "", "", "ns/op", "allocations", "peak rss MB");
+  std::printf("%-7s %-13s %8s %8s %9s %9s %9s %9s\n",
+              "type", "operation", "Array", "vector", "Array", "vector",
+              "Array", "vector");
+
+  run<double>("double", n); // small, trivial
+  run<Wide>("Wide", n);     // large, trivial
+  run<Boxed>("Boxed", n);   // small, non-trivial
+  run<Named>("Named", n);   // large, non-trivial
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+// bench [n...]: one table per container size, by default a small and a
+// large one
+int
+main(int argc, char** argv)
+{
+  if (argc > 1) {
+    for (int i = 1; i < argc; ++i)
+      table(std::strtoull(argv[i], nullptr, 10));
+  } else {
+    table(BENCH_SMALL);
+    table(BENCH_LARGE);
+  }
+  std::printf("(%g)\n", sink);
+  return 0;
+}
@@ -0,0 +1,515 @@
+// file: array/bits.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <cstdint>
+
+#include "simd.hpp"
+
+#define BITS_WORD 64 // bits per word
+
+////////////////////////////////////////////////////////////////////////
+// kernels
+
+// Word-level loops for BitArray, dispatched like the ones in simd.hpp.
+// The avx2 and avx512 builds count with the popcnt instruction.
+
+struct PopcountKernel
+{
+  using type = uint64_t;
+
+  template<size_t B>
+  static SIMD_INLINE size_t run(const uint64_t* p, size_t n)
+  {
+    size_t c[SIMD_UNROLL] = {};
+    size_t i = 0;
+    for (; i + SIMD_UNROLL <= n; i += SIMD_UNROLL)
+      for (size_t u = 0; u < SIMD_UNROLL; ++u)
+        c[u] += __builtin_popcountll(p[i + u]);
+    for (; i < n; ++i)
+      c[0] += __builtin_popcountll(p[i]);
+    for (size_t u = 1; u < SIMD_UNROLL; ++u)
+      c[0] += c[u];
+    return c[0];
+  }
+};
+
+// x = x Op y, Op one of & | ^
+template<char Op>
+struct BitKernel
+{
+  using type = uint64_t;
+
+  template<size_t B>
+  static SIMD_INLINE int run(uint64_t* x, const uint64_t* y, size_t n)
+  {
+    using V = typename Vec<uint64_t, B>::type;
+    constexpr size_t W = Vec<uint64_t, B>::lanes;
+
+    V a, b;
+    size_t i = 0;
+    for (; i + W <= n; i += W) {
+      vload(a, x + i);
+      vload(b, y + i);
+      a = Op == '&' ? a & b : Op == '|' ? a | b : a ^ b;
+      vstore(x + i, a);
+    }
+    for (; i < n; ++i)
+      x[i] = Op == '&' ? x[i] & y[i] : Op == '|' ? x[i] | y[i] : x[i] ^ y[i];
+    return 0;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+// declaration
+
+// An array of bools packed 64 to a word in an Array<uint64_t>, so it
+// takes an eighth of the room of one byte per flag, and counting, search
+// and the set operations go a word at a time. Bits past size() in the
+// last word are always zero, which lets count() and friends work on
+// whole words.
+
+class BitArray
+{
+
+public:
+  class Reference;
+
+  // constructors
+  BitArray();
+  BitArray(size_t n, bool v = false);
+
+  // operators
+  bool operator[](size_t i) const;
+  Reference operator[](size_t i);
+  BitArray& operator&=(const BitArray& a);
+  BitArray& operator|=(const BitArray& a);
+  BitArray& operator^=(const BitArray& a);
+
+  // accessors
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+  bool test(size_t i) const;
+  size_t count() const;
+  size_t find_next(size_t i) const;
+  size_t words() const;
+  const uint64_t* data() const;
+  uint64_t* data();
+
+  // mutators
+  void set(size_t i);
+  void set(size_t i, bool v);
+  void reset(size_t i);
+  void flip(size_t i);
+  void fill(bool v);
+  void reserve(size_t n);
+  void resize(size_t n, bool v = false);
+  void shrink_to_fit();
+  void push_back(bool v);
+  void pop_back();
+  void clear();
+  void release();
+  void swap(BitArray& a);
+  void append(const BitArray& a);
+
+  // bonus
+  BitArray(const BitArray& a) = default;
+  BitArray(BitArray&& a) noexcept;
+  BitArray& operator=(const BitArray& a) = default;
+  BitArray& operator=(BitArray&& a) noexcept;
+
+private:
+  // not allocated at all until the first bit
+  Array<uint64_t, std::allocator<uint64_t>, LazyGrowth> words_;
+  size_t size_; // bits, in ceil(size_ / BITS_WORD) words
+
+  static size_t word(size_t i);
+  static uint64_t mask(size_t i);
+  void trim();
+};
+
+BitArray operator&(BitArray a, const BitArray& b);
+BitArray operator|(BitArray a, const BitArray& b);
+BitArray operator^(BitArray a, const BitArray& b);
+
+////////////////////////////////////////////////////////////////////////
+// reference
+
+// A single bit that can be read and assigned, as returned by the
+// non-const operator[].
+
+class BitArray::Reference
+{
+
+public:
+  Reference(uint64_t* w, uint64_t m) : w_(w), m_(m) {}
+
+  operator bool() const { return *w_ & m_; }
+  Reference& operator=(bool v)
+  {
+    if (v)
+      *w_ |= m_;
+    else
+      *w_ &= ~m_;
+    return *this;
+  }
+  Reference& operator=(const Reference& r) { return *this = bool(r); }
+  void flip() { *w_ ^= m_; }
+
+private:
+  uint64_t* w_;
+  uint64_t m_;
+};
+
+////////////////////////////////////////////////////////////////////////
+// words
+
+inline size_t
+BitArray::word(size_t i)
+{
+  return i / BITS_WORD;
+}
+
+inline uint64_t
+BitArray::mask(size_t i)
+{
+  return (uint64_t)1 << (i % BITS_WORD);
+}
+
+// Restore the zero tail after a whole-word write.
+inline void
+BitArray::trim()
+{
+  if (size_ % BITS_WORD)
+    words_.back() &= mask(size_) - 1;
+}
+
+////////////////////////////////////////////////////////////////////////
+// constructors
+
+inline
+BitArray::BitArray()
+  : words_(), size_(0)
+{
+}
+
+inline
+BitArray::BitArray(size_t n, bool v)
+  : words_(), size_(0)
+{
+  resize(n, v);
+}
+
+////////////////////////////////////////////////////////////////////////
+// operators
+
+inline bool
+BitArray::operator[](size_t i) const
+{
+  return test(i);
+}
+
+inline BitArray::Reference
+BitArray::operator[](size_t i)
+{
+  assert(i < size_);
+
+  return Reference(&words_[word(i)], mask(i));
+}
+
+inline BitArray&
+BitArray::operator&=(const BitArray& a)
+{
+  assert(a.size_ == size_);
+
+  simd<BitKernel<'&'>>(words_.begin(), a.words_.begin(), words_.size());
+  return *this;
+}
+
+inline BitArray&
+BitArray::operator|=(const BitArray& a)
+{
+  assert(a.size_ == size_);
+
+  simd<BitKernel<'|'>>(words_.begin(), a.words_.begin(), words_.size());
+  return *this;
+}
+
+inline BitArray&
+BitArray::operator^=(const BitArray& a)
+{
+  assert(a.size_ == size_);
+
+  simd<BitKernel<'^'>>(words_.begin(), a.words_.begin(), words_.size());
+  return *this;
+}
+
+inline BitArray
+operator&(BitArray a, const BitArray& b)
+{
+  return a &= b;
+}
+
+inline BitArray
+operator|(BitArray a, const BitArray& b)
+{
+  return a |= b;
+}
+
+inline BitArray
+operator^(BitArray a, const BitArray& b)
+{
+  return a ^= b;
+}
+
+////////////////////////////////////////////////////////////////////////
+// accessors
+
+inline size_t
+BitArray::size() const
+{
+  return size_;
+}
+
+inline size_t
+BitArray::capacity() const
+{
+  return words_.capacity() * BITS_WORD;
+}
+
+inline bool
+BitArray::empty() const
+{
+  return size_ == 0;
+}
+
+inline bool
+BitArray::test(size_t i) const
+{
+  assert(i < size_);
+
+  return words_.begin()[word(i)] & mask(i);
+}
+
+inline size_t
+BitArray::count() const
+{
+  return simd<PopcountKernel>(words_.begin(), words_.size());
+}
+
+// The first set bit at or after i, or size() if there is none.
+inline size_t
+BitArray::find_next(size_t i) const
+{
+  if (i >= size_)
+    return size_;
+
+  const uint64_t* w = words_.begin();
+  size_t k = word(i);
+  uint64_t b = w[k] & ~(mask(i) - 1);
+  while (!b) {
+    if (++k == words_.size())
+      return size_;
+    b = w[k];
+  }
+  return k * BITS_WORD + __builtin_ctzll(b);
+}
+
+inline size_t
+BitArray::words() const
+{
+  return words_.size();
+}
+
+inline const uint64_t*
+BitArray::data() const
+{
+  return words_.begin();
+}
+
+// Writers must leave the bits past size() zero.
+inline uint64_t*
+BitArray::data()
+{
+  return words_.begin();
+}
+
+////////////////////////////////////////////////////////////////////////
+// mutators
+
+inline void
+BitArray::set(size_t i)
+{
+  assert(i < size_);
+
+  words_[word(i)] |= mask(i);
+}
+
+inline void
+BitArray::set(size_t i, bool v)
+{
+  if (v)
+    set(i);
+  else
+    reset(i);
+}
+
+inline void
+BitArray::reset(size_t i)
+{
+  assert(i < size_);
+
+  words_[word(i)] &= ~mask(i);
+}
+
+inline void
+BitArray::flip(size_t i)
+{
+  assert(i < size_);
+
+  words_[word(i)] ^= mask(i);
+}
+
+inline void
+BitArray::fill(bool v)
+{
+  if (words_.size())
+    std::memset(words_.begin(), v ? 0xff : 0, words_.size() * 8);
+  trim();
+}
+
+inline void
+BitArray::reserve(size_t n)
+{
+  words_.reserve((n + BITS_WORD - 1) / BITS_WORD);
+}
+
+// New bits take v; the tail of the old last word is filled by hand and
+// whole new words in one go.
+inline void
+BitArray::resize(size_t n, bool v)
+{
+  size_t old = size_;
+  size_t w = (n + BITS_WORD - 1) / BITS_WORD;
+  size_t ow = words_.size();
+
+  words_.resize(w);
+  size_ = n;
+  if (n > old) {
+    if (v) {
+      if (old % BITS_WORD)
+        words_[word(old)] |= ~(mask(old) - 1);
+      if (w > ow)
+        std::memset(words_.begin() + ow, 0xff, (w - ow) * 8);
+    }
+  }
+  trim();
+}
+
+inline void
+BitArray::shrink_to_fit()
+{
+  words_.shrink_to_fit();
+}
+
+inline void
+BitArray::push_back(bool v)
+{
+  if (size_ % BITS_WORD == 0)
+    words_.push_back(0);
+  if (v)
+    words_.back() |= mask(size_);
+  ++size_;
+}
+
+inline void
+BitArray::pop_back()
+{
+  assert(size_ > 0);
+
+  --size_;
+  words_.back() &= ~mask(size_);
+  if (size_ % BITS_WORD == 0)
+    words_.pop_back();
+}
+
+inline void
+BitArray::clear()
+{
+  words_.clear();
+  size_ = 0;
+}
+
+inline void
+BitArray::release()
+{
+  words_.release();
+  size_ = 0;
+}
+
+inline void
+BitArray::swap(BitArray& a)
+{
+  words_.swap(a.words_);
+  std::swap(size_, a.size_);
+}
+
+// Word-aligned appends copy words; otherwise each of a's words is split
+// across two of ours.
+inline void
+BitArray::append(const BitArray& a)
+{
+  if (&a == this) {
+    BitArray tmp(a);
+    append(tmp);
+    return;
+  }
+
+  size_t n = a.size_;
+  size_t nw = a.words_.size();
+  size_t s = size_ % BITS_WORD;
+
+  if (s == 0) {
+    words_.append(a.words_.begin(), nw);
+    size_ += n;
+    return;
+  }
+
+  words_.reserve((size_ + n + BITS_WORD - 1) / BITS_WORD);
+  const uint64_t* src = a.words_.begin();
+  for (size_t k = 0; k < nw; ++k) {
+    uint64_t x = src[k];
+    words_.back() |= x << s;
+    words_.push_back(x >> (BITS_WORD - s));
+  }
+  size_ += n;
+  words_.resize((size_ + BITS_WORD - 1) / BITS_WORD);
+}
+
+////////////////////////////////////////////////////////////////////////
+// bonus
+
+//// rule of five
+
+// move constructor
+inline
+BitArray::BitArray(BitArray&& a) noexcept
+  : words_(std::move(a.words_)), size_(a.size_)
+{
+  a.size_ = 0;
+}
+
+// move assignment
+inline BitArray&
+BitArray::operator=(BitArray&& a) noexcept
+{
+  swap(a);
+  return *this;
+}
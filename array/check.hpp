@@ -0,0 +1,80 @@
+// file: array/check.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+// Unlike assert, on whatever NDEBUG says, and it says where.
+#define CHECK(c) ((c) ? (void)0 : check_fail(#c, __FILE__, __LINE__))
+
+////////////////////////////////////////////////////////////////////////
+// reporting
+
+[[noreturn]] inline void
+check_fail(const char* what, const char* file, int line)
+{
+  std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+  std::exit(1);
+}
+
+inline void
+check_done(const char* name)
+{
+  std::printf("%s: ok\n", name);
+}
+
+////////////////////////////////////////////////////////////////////////
+// element types
+
+// i as a T, for checks written once for numbers and strings
+template<typename T>
+T
+element(int i)
+{
+  return T(i);
+}
+
+template<>
+inline std::string
+element(int i)
+{
+  return std::to_string(i);
+}
+
+// An int that counts its live instances and throws from a copy or move
+// once budget of them have been made, for driving containers down their
+// failure paths. A negative budget never runs out. After the dust
+// settles, live must be back to what the container holds, or something
+// was leaked or destroyed twice.
+struct Fragile
+{
+  static inline long live = 0;
+  static inline long budget = -1;
+
+  int v;
+
+  Fragile(int i = 0) : v(i) { ++live; }
+  Fragile(const Fragile& f) : v(f.v) { spend(); ++live; }
+  Fragile(Fragile&& f) : v(f.v) { spend(); ++live; }
+  ~Fragile() { --live; }
+  Fragile& operator=(const Fragile& f) { v = f.v; return *this; }
+  Fragile& operator=(Fragile&& f) { v = f.v; return *this; }
+  bool operator==(const Fragile& f) const { return v == f.v; }
+
+  static void spend()
+  {
+    if (budget == 0)
+      throw std::runtime_error("Fragile: out of budget");
+    if (budget > 0)
+      --budget;
+  }
+};
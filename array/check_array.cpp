@@ -0,0 +1,243 @@
+// file: array/check_array.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "array.hpp"
+#include "check.hpp"
+#include "concurrent.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// erase_if
+
+// Against std::remove_if, on both the trivial and the general path,
+// with a predicate that counts its calls and removes only the first
+// few matches, which goes wrong if any element is asked twice.
+template<typename T>
+void
+check_erase_if(std::mt19937& g)
+{
+  for (int round = 0; round < 200; ++round) {
+    size_t n = g() % 100;
+    Array<T> a;
+    std::vector<T> v;
+    for (size_t i = 0; i < n; ++i) {
+      T x = element<T>(g() % 4);
+      a.push_back(x);
+      v.push_back(x);
+    }
+    size_t quota = g() % 10;
+    size_t calls = 0;
+    auto take = [&](size_t& left) {
+      return [&calls, &left](const T& x) {
+        ++calls;
+        if (x != element<T>(0) || left == 0)
+          return false;
+        --left;
+        return true;
+      };
+    };
+    size_t left = quota;
+    size_t removed = a.erase_if(take(left));
+    CHECK(calls == n);
+    left = quota;
+    v.erase(std::remove_if(v.begin(), v.end(), take(left)), v.end());
+    CHECK(removed == n - v.size());
+    CHECK(a.size() == v.size() && std::equal(v.begin(), v.end(), a.begin()));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// SmallArray
+
+// whether a holds 0, 1, ..., n - 1 and nothing else is alive
+template<size_t N>
+bool
+holds(SmallArray<Fragile, N>& a, size_t n)
+{
+  if (a.size() != n || Fragile::live != (long)n)
+    return false;
+  for (size_t i = 0; i < n; ++i)
+    if (a[i].v != (int)i)
+      return false;
+  return true;
+}
+
+// Every way of spilling out of the inline slots, or moving between
+// blocks, with a copy that throws at each step in turn: the array must
+// be as it was, and nothing leaked or freed twice.
+void
+check_small_throws()
+{
+  for (long k = 0; k < 8; ++k) {
+    {
+      SmallArray<Fragile, 2> a;
+      a.push_back(0);
+      a.push_back(1);
+      Fragile::budget = k;
+      bool threw = false;
+      try {
+        a.push_back(a[1]); // aliases the block being left
+      } catch (const std::runtime_error&) {
+        threw = true;
+      }
+      Fragile::budget = -1;
+      if (threw) {
+        CHECK(holds(a, 2));
+      } else {
+        CHECK(a.size() == 3 && a[2].v == 1);
+        a[2].v = 2;
+        CHECK(holds(a, 3));
+      }
+    }
+    CHECK(Fragile::live == 0);
+
+    {
+      SmallArray<Fragile, 2> a;
+      for (int i = 0; i < 5; ++i)
+        a.push_back(i);
+      size_t c = a.capacity();
+      Fragile::budget = k;
+      try {
+        a.reserve(64);
+      } catch (const std::runtime_error&) {
+        CHECK(a.capacity() == c);
+      }
+      Fragile::budget = -1;
+      CHECK(holds(a, 5));
+
+      a.pop_back();
+      a.pop_back();
+      a.pop_back();
+      Fragile::budget = k;
+      try {
+        a.shrink_to_fit();
+      } catch (const std::runtime_error&) {
+      }
+      Fragile::budget = -1;
+      CHECK(holds(a, 2));
+    }
+    CHECK(Fragile::live == 0);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// alignment
+
+// a whole cache line to itself, more than malloc promises
+struct alignas(CACHE_LINE) Line
+{
+  int v;
+};
+
+bool
+aligned(const void* p)
+{
+  return (uintptr_t)p % alignof(Line) == 0;
+}
+
+// Overaligned elements stay aligned in every container on raw storage,
+// through growth by realloc, across the mapping threshold, and in a
+// SmallArray spilled to the heap.
+void
+check_overaligned()
+{
+  Array<Line> a(3);
+  CHECK(aligned(a.begin()));
+  for (int i = 0; i < 1000; ++i) {
+    a.push_back(Line {i});
+    CHECK(aligned(a.begin()));
+  }
+  a.resize(MAP_MAGNITUDE / sizeof(Line) + 1);
+  CHECK(aligned(a.begin()) && a[3 + 999].v == 999);
+  a.resize(10);
+  a.shrink_to_fit();
+  CHECK(aligned(a.begin()) && a[9].v == 6);
+
+  SmallArray<Line, 2> s;
+  for (int i = 0; i < 100; ++i)
+    s.push_back(Line {i});
+  CHECK(aligned(s.begin()) && s[99].v == 99);
+  s.resize(2);
+  s.shrink_to_fit();
+  CHECK(aligned(s.begin()) && s[1].v == 1);
+
+  SegmentedArray<Line> g;
+  ConcurrentArray<Line> c;
+  for (int i = 0; i < 5000; ++i) {
+    g.push_back(Line {i});
+    c.push_back(Line {i});
+  }
+  for (size_t i = 0; i < 5000; i += 37)
+    CHECK(aligned(&g[i]) && aligned(&c[i]) && g[i].v == c[i].v);
+}
+
+// on an Align boundary however the array got its block
+template<typename T, typename A, typename G>
+bool
+on(const Array<T, A, G>& a, size_t align)
+{
+  return (uintptr_t)a.begin() % align == 0;
+}
+
+// AlignedArray and HugeArray keep their alignment and their contents
+// through growth, copies, moves and shrinking, for trivial elements and
+// for ones that are moved one by one; HugeArray grows in whole huge
+// pages.
+void
+check_aligned_arrays()
+{
+  AlignedArray<float> f;
+  AlignedArray<double, 4096> d;
+  AlignedArray<std::string, 256> s;
+  for (int i = 0; i < 5000; ++i) {
+    f.push_back(i);
+    d.push_back(i);
+    s.push_back(element<std::string>(i));
+    if (i % 499 == 0)
+      CHECK(on(f, CACHE_LINE) && on(d, 4096) && on(s, 256));
+  }
+  AlignedArray<std::string, 256> t = s;
+  AlignedArray<float> m(std::move(f));
+  CHECK(on(t, 256) && on(m, CACHE_LINE));
+  CHECK(t[4999] == "4999" && m[4999] == 4999 && d[4999] == 4999);
+  d.resize(3);
+  d.shrink_to_fit();
+  CHECK(on(d, 4096) && d.capacity() == 3 && d[2] == 2);
+
+  HugeArray<int> h;
+  h.push_back(7);
+  CHECK(on(h, HUGE_PAGE) && h.capacity() * sizeof(int) == HUGE_PAGE);
+  size_t n = 3 * HUGE_PAGE / sizeof(int);
+  for (size_t i = 1; i < n; ++i)
+    h.push_back(int(i));
+  CHECK(on(h, HUGE_PAGE) && h.capacity() * sizeof(int) % HUGE_PAGE == 0);
+  bool kept = h[0] == 7;
+  for (size_t i = 1; i < n; i += 4093)
+    kept &= h[i] == int(i);
+  CHECK(kept && h.size() == n);
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937 g(1);
+  check_erase_if<int>(g);
+  check_erase_if<std::string>(g);
+  check_small_throws();
+  check_overaligned();
+  check_aligned_arrays();
+  check_done("check_array");
+  return 0;
+}
@@ -0,0 +1,171 @@
+// file: array/check_bits.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <random>
+#include <vector>
+
+#include "bits.hpp"
+#include "check.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// checks
+
+// Bit by bit, by count, by a walk of find_next from every set bit, and
+// with the bits past size() still zero.
+bool
+same(const BitArray& a, const std::vector<bool>& v)
+{
+  if (a.size() != v.size())
+    return false;
+  if (a.words() != (v.size() + BITS_WORD - 1) / BITS_WORD)
+    return false;
+  size_t ones = 0;
+  for (size_t i = 0; i < v.size(); ++i) {
+    if (a[i] != v[i])
+      return false;
+    ones += v[i];
+  }
+  if (a.count() != ones)
+    return false;
+  if (v.size() % BITS_WORD &&
+      a.data()[a.words() - 1] >> (v.size() % BITS_WORD))
+    return false;
+
+  size_t i = a.find_next(0);
+  for (size_t j = 0; j <= v.size(); ++j) {
+    if (j < v.size() && !v[j])
+      continue;
+    if (i != j)
+      return false;
+    if (j < v.size())
+      i = a.find_next(j + 1);
+  }
+  return a.find_next(v.size()) == v.size();
+}
+
+// a size just below, at, or just past a multiple of 64
+size_t
+near_word(std::mt19937& g)
+{
+  size_t n = g() % 5 * BITS_WORD + g() % 3;
+  return n ? n - 1 : 0;
+}
+
+// Random pushes, pops, resizes, appends, writes and word-wise operators
+// against a std::vector<bool>, with sizes kept crossing word boundaries.
+void
+check_against_vector(std::mt19937& g)
+{
+  BitArray a;
+  std::vector<bool> v;
+  for (int step = 0; step < 50000; ++step) {
+    unsigned op = g() % 12;
+    bool b = g() % 2;
+    if (op < 3) {
+      a.push_back(b);
+      v.push_back(b);
+    } else if (op < 5 && !v.empty()) {
+      a.pop_back();
+      v.pop_back();
+    } else if (op < 6) {
+      size_t n = near_word(g);
+      a.resize(n, b);
+      v.resize(n, b);
+    } else if (op < 7) {
+      BitArray c(near_word(g), b);
+      std::vector<bool> w(c.size(), b);
+      for (size_t k = 0; k < 5 && !w.empty(); ++k) {
+        size_t i = g() % w.size();
+        c.flip(i);
+        w[i] = !w[i];
+      }
+      a.append(c);
+      v.insert(v.end(), w.begin(), w.end());
+    } else if (op < 8 && v.size() < 2000) {
+      a.append(a);
+      std::vector<bool> w = v;
+      v.insert(v.end(), w.begin(), w.end());
+    } else if (op < 9 && !v.empty()) {
+      size_t i = g() % v.size();
+      switch (g() % 4) {
+      case 0: a.set(i); v[i] = true; break;
+      case 1: a.reset(i); v[i] = false; break;
+      case 2: a.flip(i); v[i] = !v[i]; break;
+      default: a[i] = b; v[i] = b; break;
+      }
+    } else if (op < 10) {
+      BitArray c(v.size());
+      std::vector<bool> w(v.size());
+      for (size_t i = 0; i < w.size(); ++i)
+        if (g() % 3 == 0) {
+          c.set(i);
+          w[i] = true;
+        }
+      unsigned o = g() % 3;
+      for (size_t i = 0; i < w.size(); ++i)
+        v[i] = o == 0 ? v[i] && w[i] : o == 1 ? v[i] || w[i] : v[i] != w[i];
+      a = o == 0 ? a & c : o == 1 ? a | c : a ^ c;
+    } else if (op < 11 && g() % 20 == 0) {
+      a.fill(b);
+      v.assign(v.size(), b);
+    } else if (g() % 50 == 0) {
+      BitArray c = a;
+      CHECK(same(c, v));
+      a.clear();
+      CHECK(a.empty() && a.count() == 0 && a.find_next(0) == 0);
+      a = std::move(c);
+    }
+    if (step % 53 == 0)
+      CHECK(same(a, v));
+  }
+  CHECK(same(a, v));
+}
+
+// every size up to a few words, filled by push_back and by resize
+void
+check_sizes()
+{
+  for (size_t n = 0; n <= 4 * BITS_WORD + 1; ++n) {
+    for (int v = 0; v < 2; ++v) {
+      BitArray a(n, v);
+      BitArray b;
+      for (size_t i = 0; i < n; ++i)
+        b.push_back(v);
+      std::vector<bool> w(n, v);
+      CHECK(same(a, w) && same(b, w));
+      CHECK(a.find_next(0) == (v ? 0 : n));
+      a.resize(n + 1, !v);
+      w.push_back(!v);
+      CHECK(same(a, w));
+      while (!w.empty()) {
+        a.pop_back();
+        w.pop_back();
+      }
+      CHECK(same(a, w));
+    }
+  }
+
+  BitArray e;
+  CHECK(e.capacity() == 0 && e.find_next(0) == 0 && e.count() == 0);
+  e.fill(true);
+  e.release();
+  CHECK(e.capacity() == 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937 g(1);
+  check_sizes();
+  check_against_vector(g);
+  check_done("check_bits");
+  return 0;
+}
@@ -0,0 +1,172 @@
+// file: array/check_concurrent.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "concurrent.hpp"
+
+#define PUSHERS 4
+#define PUSHES 20000 // per pusher
+
+////////////////////////////////////////////////////////////////////////
+// Picky
+
+// Refuses to be made from a multiple of 97 or copied from a multiple of
+// 89, so that some pushes and some bulk copies throw on every thread.
+struct Picky
+{
+  static inline std::atomic<long> live {0};
+  int v;
+
+  Picky(int x, bool fussy = true) : v(x)
+  {
+    if (fussy && x % 97 == 0)
+      throw std::runtime_error("picky");
+    ++live;
+  }
+
+  Picky(const Picky& o) : v(o.v)
+  {
+    if (v % 89 == 0)
+      throw std::runtime_error("picky");
+    ++live;
+  }
+
+  ~Picky() { --live; }
+};
+
+////////////////////////////////////////////////////////////////////////
+// ConcurrentArray
+
+// Pushers push their own values one at a time and in runs, some of which
+// throw part way; a reader keeps indexing and iterating what is
+// published meanwhile. Every value that went in must come out once, and
+// every throw must leave a hole that publication went past.
+void
+check_pushers()
+{
+  {
+    ConcurrentArray<Picky, 64> c;
+    std::vector<int> in[PUSHERS];
+    std::atomic<bool> done {false};
+
+    std::thread reader([&] {
+      bool sane = true;
+      while (!done.load(std::memory_order_acquire)) {
+        size_t n = c.size();
+        for (size_t i = 0; i < n; ++i)
+          if (c.has(i))
+            sane &= c[i].v >= 0 && c[i].v < PUSHERS * PUSHES;
+        size_t k = 0;
+        for (const Picky& x : c) {
+          sane &= x.v >= 0 && x.v < PUSHERS * PUSHES;
+          ++k;
+        }
+        sane &= k <= c.claimed();
+      }
+      CHECK(sane);
+    });
+
+    std::vector<std::thread> pushers;
+    for (int t = 0; t < PUSHERS; ++t)
+      pushers.emplace_back([&, t] {
+        for (int i = 0; i < PUSHES;) {
+          int v = t * PUSHES + i;
+          if (i % 7) {
+            try {
+              c.emplace_back(v);
+              in[t].push_back(v);
+            } catch (const std::runtime_error&) {
+            }
+            ++i;
+            continue;
+          }
+          std::vector<Picky> p;
+          p.reserve(5);
+          int k = std::min(5, PUSHES - i);
+          for (int j = 0; j < k; ++j)
+            p.emplace_back(v + j, false);
+          try {
+            c.append(p.data(), k);
+            for (int j = 0; j < k; ++j)
+              in[t].push_back(v + j);
+          } catch (const std::runtime_error&) {
+            // copied up to the one that threw
+            for (int j = 0; j < k && (v + j) % 89; ++j)
+              in[t].push_back(v + j);
+          }
+          i += k;
+        }
+      });
+    for (std::thread& p : pushers)
+      p.join();
+    done.store(true, std::memory_order_release);
+    reader.join();
+
+    std::vector<int> want, got;
+    for (int t = 0; t < PUSHERS; ++t)
+      want.insert(want.end(), in[t].begin(), in[t].end());
+    for (const Picky& x : c)
+      got.push_back(x.v);
+    std::sort(want.begin(), want.end());
+    std::sort(got.begin(), got.end());
+    CHECK(c.size() == c.claimed());
+    CHECK(c.claimed() == size_t(PUSHERS) * PUSHES);
+    CHECK(got == want && want.size() < c.size());
+
+    size_t holes = 0;
+    for (size_t i = 0; i < c.size(); ++i)
+      holes += !c.has(i);
+    CHECK(holes == c.size() - want.size());
+    CHECK(Picky::live == long(want.size()));
+  }
+  CHECK(Picky::live == 0);
+}
+
+// a hole at the front, and an array of nothing but holes
+void
+check_holes()
+{
+  ConcurrentArray<Picky, 4> c;
+  for (int v : {0, 97, 1, 194, 2})
+    try {
+      c.emplace_back(v);
+    } catch (const std::runtime_error&) {
+    }
+  CHECK(c.size() == 5 && !c.has(0) && c.has(2) && !c.has(3));
+  std::vector<int> got;
+  for (const Picky& x : c)
+    got.push_back(x.v);
+  CHECK((got == std::vector<int> {1, 2}));
+
+  ConcurrentArray<Picky, 4> h;
+  for (int i = 0; i < 9; ++i)
+    try {
+      h.emplace_back(97 * i);
+    } catch (const std::runtime_error&) {
+    }
+  CHECK(h.size() == 9 && h.begin() == h.end());
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  check_pushers();
+  check_holes();
+  CHECK(Picky::live == 0);
+  check_done("check_concurrent");
+  return 0;
+}
@@ -0,0 +1,200 @@
+// file: array/check_flat.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "flat.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// FlatSet
+
+// in order, and bounds at random keys in and around it agreeing
+template<typename K, typename C>
+bool
+same(const FlatSet<K, C>& f, const std::set<K, C>& s, std::mt19937& g)
+{
+  if (f.size() != s.size() ||
+      !std::equal(f.begin(), f.end(), s.begin(), s.end()))
+    return false;
+  for (int k = 0; k < 64; ++k) {
+    K q = element<K>(int(g() % 1100) - 50);
+    if (f.lower_bound(q) - f.begin() !=
+          std::distance(s.begin(), s.lower_bound(q)) ||
+        f.upper_bound(q) - f.begin() !=
+          std::distance(s.begin(), s.upper_bound(q)) ||
+        f.contains(q) != (s.count(q) == 1))
+      return false;
+  }
+  return true;
+}
+
+// Single and bulk inserts, the bulk ones full of repeats of each other
+// and of keys already there, and erases by key and by position, against
+// a std::set.
+template<typename K, typename C = std::less<K>>
+void
+check_set(std::mt19937& g)
+{
+  FlatSet<K, C> f;
+  std::set<K, C> s;
+  CHECK(same(f, s, g));
+  for (int step = 0; step < 3000; ++step) {
+    unsigned op = g() % 8;
+    K k = element<K>(g() % 1000);
+    if (op < 3) {
+      auto r = f.insert(k);
+      CHECK(r.second == s.insert(k).second && *r.first == k);
+    } else if (op < 4) {
+      std::vector<K> in;
+      size_t n = g() % 40;
+      for (size_t i = 0; i < n; ++i)
+        in.push_back(element<K>(g() % (i % 2 ? 1000 : 20)));
+      f.insert(in.begin(), in.end());
+      s.insert(in.begin(), in.end());
+    } else if (op < 6) {
+      CHECK(f.erase(k) == s.erase(k));
+    } else if (op < 7 && !s.empty()) {
+      size_t i = g() % s.size();
+      const K* next = f.erase(f.begin() + i);
+      auto it = s.erase(std::next(s.begin(), i));
+      CHECK(next - f.begin() == std::distance(s.begin(), it));
+    } else if (g() % 40 == 0) {
+      FlatSet<K, C> c(s.begin(), s.end());
+      CHECK(same(c, s, g));
+      f.swap(c);
+      f.shrink_to_fit();
+    }
+    if (step % 37 == 0)
+      CHECK(same(f, s, g));
+  }
+  CHECK(same(f, s, g));
+  f.clear();
+  CHECK(f.empty() && f.lower_bound(element<K>(0)) == f.end());
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatMap
+
+template<typename K, typename V>
+bool
+same(const FlatMap<K, V>& f, const std::map<K, V>& m, std::mt19937& g)
+{
+  if (f.size() != m.size())
+    return false;
+  size_t i = 0;
+  for (const auto& [k, v] : m)
+    if (!(f.key(i) == k) || !(f.value(i++) == v))
+      return false;
+  for (int k = 0; k < 64; ++k) {
+    K q = element<K>(int(g() % 1100) - 50);
+    const V* v = f.get(q);
+    auto it = m.find(q);
+    if (f.lower_bound(q) - f.begin() !=
+          std::distance(m.begin(), m.lower_bound(q)) ||
+        f.upper_bound(q) - f.begin() !=
+          std::distance(m.begin(), m.upper_bound(q)) ||
+        (v ? it == m.end() || !(*v == it->second) : it != m.end()))
+      return false;
+  }
+  return true;
+}
+
+// As for the set, with values riding along: a bulk insert keeps the
+// first of repeated keys and the value of a key already there, as
+// std::map::insert does.
+template<typename K, typename V>
+void
+check_map(std::mt19937& g)
+{
+  FlatMap<K, V> f;
+  std::map<K, V> m;
+  for (int step = 0; step < 3000; ++step) {
+    unsigned op = g() % 9;
+    K k = element<K>(g() % 1000);
+    V v = element<V>(g() % 100);
+    if (op < 2) {
+      auto r = f.insert({k, v});
+      CHECK(r.second == m.insert({k, v}).second && r.first.key() == k);
+    } else if (op < 3) {
+      f[k] = v;
+      m[k] = v;
+    } else if (op < 4) {
+      std::vector<std::pair<K, V>> in;
+      size_t n = g() % 40;
+      for (size_t i = 0; i < n; ++i)
+        in.push_back({element<K>(g() % (i % 2 ? 1000 : 20)),
+                      element<V>(g() % 100)});
+      f.insert(in.begin(), in.end());
+      m.insert(in.begin(), in.end());
+    } else if (op < 6) {
+      CHECK(f.erase(k) == m.erase(k));
+    } else if (op < 7 && !m.empty()) {
+      size_t i = g() % m.size();
+      auto next = f.erase(f.begin() + i);
+      auto it = m.erase(std::next(m.begin(), i));
+      CHECK(next - f.begin() == std::distance(m.begin(), it));
+    } else if (op < 8) {
+      auto r = f.emplace(k, v);
+      CHECK(r.second == m.emplace(k, v).second);
+    } else if (V* p = f.get(k)) {
+      *p = v;
+      m[k] = v;
+    }
+    if (step % 37 == 0)
+      CHECK(same(f, m, g));
+  }
+  CHECK(same(f, m, g));
+}
+
+////////////////////////////////////////////////////////////////////////
+// search
+
+// flat_bound on every length over a few cache lines, with runs of
+// equal keys, at every key and around them, against std::lower_bound
+// and std::upper_bound.
+void
+check_bounds()
+{
+  std::vector<int> v;
+  for (int n = 0; n < 300; ++n) {
+    const int* p = v.data();
+    for (int q = -1; q <= n / 3 + 1; ++q) {
+      auto lo = std::lower_bound(v.begin(), v.end(), q);
+      auto hi = std::upper_bound(v.begin(), v.end(), q);
+      CHECK(flat_bound<false>(p, v.size(), q, std::less<int>()) ==
+            p + (lo - v.begin()));
+      CHECK(flat_bound<true>(p, v.size(), q, std::less<int>()) ==
+            p + (hi - v.begin()));
+    }
+    v.push_back(n / 3);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937 g(1);
+  check_bounds();
+  check_set<int>(g);
+  check_set<int, std::greater<int>>(g);
+  check_set<std::string>(g);
+  check_map<int, std::string>(g);
+  check_map<std::string, int>(g);
+  check_done("check_flat");
+  return 0;
+}
@@ -0,0 +1,171 @@
+// file: array/check_hash.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "check.hpp"
+#include "hash.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// checks
+
+template<typename M, typename R>
+bool
+same(const M& m, const R& r)
+{
+  if (m.size() != r.size())
+    return false;
+  size_t n = 0;
+  for (auto kv : m) {
+    auto f = r.find(kv.first);
+    if (f == r.end() || !(f->second == kv.second))
+      return false;
+    ++n;
+  }
+  return n == r.size();
+}
+
+// Random inserts, lookups by string_view, erases by key and by iterator
+// and updates against std::unordered_map, over few enough keys that
+// erasing leaves tombstones for inserts to reuse and rebuilds to sweep.
+// One insert in eight copies its value from an entry already in the
+// map, or views one as its key, so that a rebuild moves what it is
+// built from.
+void
+check_against_unordered_map(std::mt19937_64& g)
+{
+  HashMap<std::string, std::string> m;
+  std::unordered_map<std::string, std::string> r;
+  CHECK(m.capacity() == 0 && !m.contains("x") && m.begin() == m.end());
+
+  for (int step = 0; step < 100000; ++step) {
+    unsigned op = g() % 16;
+    std::string k = "k" + std::to_string(g() % 3000);
+    std::string v(g() % 40, 'a' + g() % 26);
+    if (op < 4) {
+      auto a = m.emplace(k, v);
+      bool b = r.emplace(k, v).second;
+      CHECK(a.second == b && (*a.first).second == r[k]);
+    } else if (op < 5 && !m.empty()) {
+      auto any = m.begin();
+      std::string_view from = (*any).second;
+      bool b = r.emplace(k, std::string(from)).second;
+      CHECK(m.emplace(k, *m.get((*any).first)).second == b);
+    } else if (op < 6 && !m.empty()) {
+      std::string_view from = (*m.begin()).second;
+      bool b = r.emplace(std::string(from), v).second;
+      CHECK(m.emplace(from, v).second == b);
+    } else if (op < 9) {
+      CHECK(m.erase(std::string_view(k)) == r.erase(k));
+    } else if (op < 10) {
+      auto f = m.find(k);
+      if (f != m.end()) {
+        m.erase(f);
+        r.erase(k);
+      }
+    } else if (op < 13) {
+      const std::string* p = m.get(std::string_view(k));
+      auto f = r.find(k);
+      CHECK((p != nullptr) == (f != r.end()) && (!p || *p == f->second));
+      CHECK(m.contains(k.c_str()) == (p != nullptr));
+    } else if (op < 15) {
+      m[k] += v;
+      r[k] += v;
+    } else if (g() % 500 == 0) {
+      m.clear();
+      r.clear();
+    }
+    CHECK(m.size() == r.size());
+    if (step % 5000 == 0)
+      CHECK(same(m, r));
+  }
+  CHECK(same(m, r));
+
+  HashMap<std::string, std::string> c(m);
+  CHECK(same(c, r));
+  HashMap<std::string, std::string> d(std::move(c));
+  CHECK(same(d, r) && c.empty() && c.capacity() == 0 && !c.contains("k1"));
+  c["x"] = "y";
+  CHECK(c.size() == 1 && *c.get("x") == "y");
+  c = d;
+  CHECK(same(c, r));
+  d.release();
+  CHECK(d.empty() && d.capacity() == 0);
+}
+
+// reserve() makes room for exactly that many without a rebuild, and
+// churn through tombstones does not grow the table
+void
+check_capacity()
+{
+  HashMap<int, int> m;
+  m.reserve(1000);
+  size_t c = m.capacity();
+  for (int i = 0; i < 1000; ++i)
+    m[i] = i;
+  CHECK(m.capacity() == c);
+
+  HashMap<int, int> t;
+  for (int i = 0; i < 200000; ++i) {
+    t[i] = i;
+    if (i >= 100)
+      CHECK(t.erase(i - 100) == 1);
+  }
+  CHECK(t.size() == 100 && t.capacity() <= 1024);
+
+  // nothing allocated, and nothing touched, for a map never inserted to
+  HashMap<int, int> e;
+  e.clear();
+  HashMap<int, int> f(e);
+  HashMap<int, int> l(std::initializer_list<std::pair<int, int>> {});
+  CHECK(e.empty() && f.capacity() == 0 && l.capacity() == 0);
+  f.clear();
+  f[1] = 1;
+  CHECK(f.size() == 1 && e.find(1) == e.end());
+}
+
+// every value built is destroyed once, through growth, erase and clear
+void
+check_lifetimes(std::mt19937_64& g)
+{
+  {
+    HashMap<int, Fragile> m;
+    for (int i = 0; i < 5000; ++i) {
+      int k = g() % 2000;
+      if (g() % 3)
+        m.emplace(k, k);
+      else
+        m.erase(k);
+      if (!m.empty() && g() % 7 == 0)
+        m.emplace(-k - 1, *m.get((*m.begin()).first));
+    }
+    CHECK(Fragile::live == (long)m.size());
+    m.clear();
+    CHECK(Fragile::live == 0);
+    for (int i = 0; i < 100; ++i)
+      m.emplace(i, i);
+  }
+  CHECK(Fragile::live == 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937_64 g(1);
+  check_against_unordered_map(g);
+  check_capacity();
+  check_lifetimes(g);
+  check_done("check_hash");
+  return 0;
+}
@@ -0,0 +1,171 @@
+// file: array/check_mapped.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "mapped.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// checks
+
+struct Point
+{
+  double x;
+  int32_t id;
+};
+
+bool
+operator==(const Point& a, const Point& b)
+{
+  return a.x == b.x && a.id == b.id;
+}
+
+// a fresh path of our own in the temporary directory
+std::string
+scratch(const char* name)
+{
+  std::string path = "/tmp/check_mapped." + std::to_string(getpid()) + "." +
+                     name;
+  unlink(path.c_str());
+  return path;
+}
+
+template<typename T, typename G>
+bool
+same(const MappedArray<T, G>& a, const std::vector<T>& v)
+{
+  return a.size() == v.size() &&
+         std::equal(a.begin(), a.end(), v.begin(), v.end());
+}
+
+// Random pushes, appends, resizes and pops against a std::vector, with
+// the file closed and opened again now and then: whatever was there
+// when it was closed must be there when it is opened.
+template<typename G>
+void
+check_round_trip(std::mt19937& g)
+{
+  std::string path = scratch("points");
+  std::vector<Point> v;
+  for (int round = 0; round < 20; ++round) {
+    MappedArray<Point, G> a(path.c_str());
+    CHECK(same(a, v));
+    for (int step = 0; step < 500; ++step) {
+      unsigned op = g() % 8;
+      Point p {double(g() % 1000) / 8, int32_t(g())};
+      if (op < 3) {
+        a.push_back(p);
+        v.push_back(p);
+      } else if (op < 4) {
+        Point q[7];
+        size_t n = g() % 8;
+        for (size_t i = 0; i < n; ++i)
+          q[i] = Point {double(i), int32_t(g())};
+        a.append(q, n);
+        v.insert(v.end(), q, q + n);
+      } else if (op < 5 && !v.empty()) {
+        a.emplace_back(a.front()); // from the mapping itself
+        v.push_back(v.front());
+      } else if (op < 6 && !v.empty()) {
+        a.pop_back();
+        v.pop_back();
+      } else if (op < 7) {
+        size_t n = v.size() + g() % 9 - 4;
+        if (n <= v.size() + 4) {
+          a.resize(n);
+          v.resize(n, Point {0, 0});
+        }
+      } else if (!v.empty()) {
+        size_t i = g() % v.size();
+        a[i].id = v[i].id = int32_t(g());
+      }
+    }
+    CHECK(same(a, v));
+    if (round % 5 == 4) {
+      a.shrink_to_fit();
+      CHECK(a.capacity() == v.size());
+    }
+    if (round % 3 == 0)
+      a.sync();
+  }
+
+  // a moved array keeps the file open; the one left behind holds nothing
+  {
+    MappedArray<Point, G> a(path.c_str());
+    MappedArray<Point, G> b(std::move(a));
+    CHECK(same(b, v));
+    b.release();
+    CHECK(b.empty() && b.capacity() == 0);
+  }
+  {
+    MappedArray<Point, G> a(path.c_str(), 100);
+    CHECK(a.empty() && a.capacity() >= 100);
+  }
+  unlink(path.c_str());
+}
+
+// Files that are not an array of this type are refused, and the
+// refusal leaks nothing.
+void
+check_refused()
+{
+  std::string path = scratch("ints");
+  {
+    MappedArray<int32_t> a(path.c_str());
+    a.push_back(7);
+  }
+  bool refused = false;
+  try {
+    MappedArray<int64_t> b(path.c_str());
+  } catch (const std::system_error&) {
+    refused = true;
+  }
+  CHECK(refused);
+  {
+    MappedArray<int32_t> a(path.c_str());
+    CHECK(a.size() == 1 && a[0] == 7);
+  }
+
+  int fd = open(path.c_str(), O_RDWR | O_TRUNC);
+  CHECK(fd >= 0 && write(fd, "arraymap", 8) == 8);
+  close(fd);
+  refused = false;
+  try {
+    MappedArray<int32_t> c(path.c_str());
+  } catch (const std::system_error&) {
+    refused = true;
+  }
+  CHECK(refused);
+  unlink(path.c_str());
+
+  refused = false;
+  try {
+    MappedArray<int32_t> d("/nonexistent/check_mapped");
+  } catch (const std::system_error&) {
+    refused = true;
+  }
+  CHECK(refused);
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937 g(1);
+  check_round_trip<Pow2Growth<>>(g);
+  check_round_trip<LazyGrowth>(g);
+  check_refused();
+  check_done("check_mapped");
+  return 0;
+}
@@ -0,0 +1,151 @@
+// file: array/check_packed.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "packed.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// checks
+
+// a value of at most w bits, often exactly w
+uint64_t
+value(std::mt19937_64& g, unsigned w)
+{
+  uint64_t v = g() & packed_mask(w);
+  return g() % 2 && w ? v | (uint64_t)1 << (w - 1) : v;
+}
+
+// element by element, and in decoded runs starting anywhere
+template<typename P>
+bool
+same(const P& a, const std::vector<uint64_t>& v, std::mt19937_64& g)
+{
+  if (a.size() != v.size())
+    return false;
+  for (size_t i = 0; i < v.size(); ++i)
+    if (a[i] != v[i])
+      return false;
+  std::vector<uint64_t> out(v.size() + 1);
+  for (int k = 0; k < 8 && !v.empty(); ++k) {
+    size_t first = g() % v.size();
+    size_t n = g() % (v.size() - first + 1);
+    out[n] = 12345;
+    a.decode(first, n, out.data());
+    for (size_t i = 0; i < n; ++i)
+      if (out[i] != v[first + i])
+        return false;
+    if (out[n] != 12345)
+      return false; // wrote past the run
+  }
+  Array<uint64_t> u = a.unpack();
+  return u.size() == v.size() &&
+         std::equal(v.begin(), v.end(), u.begin());
+}
+
+// Random pushes, sets, appends and resizes that keep forcing the width
+// up, against a std::vector.
+void
+check_packed_array(std::mt19937_64& g)
+{
+  for (int round = 0; round < 40; ++round) {
+    PackedArray a(g() % 4);
+    std::vector<uint64_t> v;
+    unsigned w = 1;
+    for (int step = 0; step < 2000; ++step) {
+      unsigned op = g() % 16;
+      if (op == 0 && w < 64)
+        ++w;
+      if (op < 8) {
+        uint64_t x = value(g, w);
+        a.push_back(x);
+        v.push_back(x);
+      } else if (op < 11 && !v.empty()) {
+        size_t i = g() % v.size();
+        uint64_t x = value(g, w);
+        a.set(i, x);
+        v[i] = x;
+      } else if (op < 13) {
+        std::vector<uint64_t> p(g() % 70);
+        for (uint64_t& x : p)
+          x = value(g, w);
+        a.append(p.data(), p.size());
+        v.insert(v.end(), p.begin(), p.end());
+      } else if (op < 14) {
+        size_t n = g() % (v.size() + 10);
+        a.resize(n);
+        v.resize(n);
+      } else if (op < 15) {
+        a.widen(a.width() + (g() % 3 ? 0 : 64 - a.width()));
+      } else {
+        a.shrink_to_fit();
+      }
+    }
+    CHECK(same(a, v, g));
+    PackedArray b(v.data(), v.size());
+    CHECK(b.width() <= a.width());
+    CHECK(same(b, v, g));
+    b.clear();
+    CHECK(b.empty());
+  }
+}
+
+// Sequences that pack well and ones that do not, including steps that
+// wrap around, in lengths that end on and off a block boundary.
+void
+check_delta_array(std::mt19937_64& g)
+{
+  for (int round = 0; round < 60; ++round) {
+    size_t n = round % 3 == 0 ? DELTA_BLOCK * (g() % 8)
+                              : g() % (10 * DELTA_BLOCK);
+    unsigned kind = g() % 4;
+    std::vector<uint64_t> v;
+    uint64_t x = kind == 3 ? -(uint64_t)n / 2 : g();
+    for (size_t i = 0; i < n; ++i) {
+      if (kind == 0)
+        x += 1 + (g() % 16 == 0);
+      else if (kind == 1)
+        x = g();
+      else if (kind == 2)
+        x -= g() % 3;
+      else
+        x += 1;
+      v.push_back(x);
+    }
+
+    DeltaArray a;
+    size_t split = n ? g() % n : 0;
+    for (size_t i = 0; i < split; ++i)
+      a.push_back(v[i]);
+    a.append(v.data() + split, n - split);
+    CHECK(same(a, v, g));
+    DeltaArray b(v.data(), v.size());
+    CHECK(same(b, v, g));
+    b.shrink_to_fit();
+    CHECK(same(b, v, g));
+    a.swap(b);
+    a.clear();
+    CHECK(a.empty() && same(b, v, g));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937_64 g(1);
+  check_packed_array(g);
+  check_delta_array(g);
+  check_done("check_packed");
+  return 0;
+}
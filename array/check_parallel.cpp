@@ -0,0 +1,141 @@
+// file: array/check_parallel.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "parallel.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// pool
+
+// Tasks pushed from outside and from inside the pool, nested groups
+// that wait by helping, and the first exception coming back out.
+void
+check_pool(ParallelPool& p)
+{
+  std::atomic<long> sum {0};
+  {
+    ParallelGroup g(p);
+    for (int i = 0; i < 100; ++i)
+      g.run([&p, &sum, i] {
+        ParallelGroup h(p);
+        for (int j = 0; j < 10; ++j)
+          h.run([&sum, i, j] { sum += i * 10 + j; });
+        h.wait();
+      });
+    g.wait();
+  }
+  CHECK(sum == 999 * 1000 / 2);
+
+  bool thrown = false;
+  std::atomic<int> ran {0};
+  try {
+    ParallelGroup g(p);
+    for (int i = 0; i < 50; ++i)
+      g.run([&ran, i] {
+        ++ran;
+        if (i % 7 == 3)
+          throw std::runtime_error("task");
+      });
+    g.wait();
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  CHECK(thrown && ran == 50);
+  CHECK(!p.help());
+}
+
+////////////////////////////////////////////////////////////////////////
+// algorithms
+
+// The algorithms against their serial loops, on sizes from nothing to
+// enough to be split many times over. Reduction is by an associative
+// op that does not commute, so chunks combined out of order show.
+void
+check_algorithms(ParallelPool& p, std::mt19937& g)
+{
+  for (size_t n : {0, 1, 7, 4096, 4097, 50000, 300000}) {
+    Array<int> a;
+    for (size_t i = 0; i < n; ++i)
+      a.push_back(int(g() % 100000) - 50000);
+
+    Array<long> b;
+    parallel_transform(a, b, [](int x) { return 3L * x; }, p);
+    bool tripled = b.size() == n;
+    for (size_t i = 0; tripled && i < n; ++i)
+      tripled = b[i] == 3L * a[i];
+    CHECK(tripled);
+
+    parallel_for(b, [](long& x) { x -= 1; }, p);
+    long want = 0;
+    for (size_t i = 0; i < n; ++i)
+      want += 3L * a[i] - 1;
+    CHECK(parallel_reduce(b, 0L, std::plus<long>(), p) == want);
+
+    // runs of indices, joined only when adjacent; (-1, -1) is the empty
+    // run and (-2, -2) a broken one
+    using Run = std::pair<long, long>;
+    Array<Run> runs;
+    for (size_t i = 0; i < n; ++i)
+      runs.push_back({long(i), long(i)});
+    auto join = [](Run l, Run r) {
+      if (l.first == -1)
+        return r;
+      if (r.first == -1)
+        return l;
+      if (l.first == -2 || r.first == -2 || l.second + 1 != r.first)
+        return Run {-2, -2};
+      return Run {l.first, r.second};
+    };
+    Run whole = parallel_reduce(runs, Run {-1, -1}, join, p);
+    CHECK(whole == (n ? Run {0, long(n) - 1} : Run {-1, -1}));
+
+    std::vector<int> s(a.begin(), a.end());
+    std::sort(s.begin(), s.end());
+    Array<int> c = a;
+    parallel_sort(c, std::less<int>(), p);
+    CHECK(std::equal(c.begin(), c.end(), s.begin(), s.end()));
+    c = a;
+    parallel_sort(c, std::greater<int>(), p);
+    CHECK(std::equal(c.begin(), c.end(), s.rbegin(), s.rend()));
+  }
+
+  // elements that are not trivially copied, through the scratch Array
+  Array<std::string> w;
+  for (int i = 0; i < 20000; ++i)
+    w.push_back(std::to_string(g() % 5000));
+  std::vector<std::string> v(w.begin(), w.end());
+  std::sort(v.begin(), v.end());
+  parallel_sort(w, std::less<std::string>(), p);
+  CHECK(std::equal(w.begin(), w.end(), v.begin(), v.end()));
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937 g(1);
+  for (size_t workers : {1, 2, 4}) {
+    ParallelPool p(workers);
+    CHECK(p.size() == workers);
+    check_pool(p);
+    check_algorithms(p, g);
+  }
+  check_algorithms(parallel_pool(), g);
+  check_done("check_parallel");
+  return 0;
+}
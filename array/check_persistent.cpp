@@ -0,0 +1,116 @@
+// file: array/check_persistent.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "check.hpp"
+#include "persistent.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// checks
+
+template<typename T>
+bool
+same(const PersistentArray<T>& a, const std::vector<T>& v)
+{
+  if (a.size() != v.size())
+    return false;
+  size_t i = 0;
+  for (const T& x : a)
+    if (!(x == v[i++]))
+      return false;
+  for (i = 0; i < v.size(); ++i)
+    if (!(a[i] == v[i]))
+      return false;
+  return true;
+}
+
+// Random pushes, pops, writes and resizes against a std::vector, deep
+// enough for the tree to gain and lose levels. Snapshots are taken all
+// along and must keep what they saw however the original changes.
+// Pushes copy elements of the array itself, so that the copy is made
+// from a leaf that the push may be about to move or share.
+template<typename T>
+void
+check_against_vector(std::mt19937& g, size_t most)
+{
+  PersistentArray<T> a;
+  std::vector<T> v;
+  std::vector<std::pair<PersistentArray<T>, std::vector<T>>> snaps;
+
+  for (int step = 0; step < 40000; ++step) {
+    unsigned op = g() % 16;
+    if (v.size() >= most)
+      op = 8;
+    if (op < 6) {
+      T x = element<T>(g());
+      a.push_back(x);
+      v.push_back(x);
+    } else if (op < 7 && !v.empty()) {
+      size_t i = g() % v.size();
+      a.push_back(a[i]);
+      v.push_back(v[i]);
+    } else if (op < 8 && !v.empty()) {
+      a.emplace_back(a.back());
+      v.push_back(v.back());
+    } else if (op < 11 && !v.empty()) {
+      a.pop_back();
+      v.pop_back();
+    } else if (op < 13 && !v.empty()) {
+      size_t i = g() % v.size();
+      T x = element<T>(g());
+      if (g() % 2)
+        a.set(i, x);
+      else
+        a[i] = x;
+      v[i] = x;
+    } else if (op < 14) {
+      size_t n = g() % (2 * v.size() + 2);
+      n = n < most ? n : most;
+      a.resize(n);
+      v.resize(n);
+    } else if (op < 15 && snaps.size() < 16) {
+      snaps.emplace_back(a.snapshot(), v);
+    } else if (!snaps.empty()) {
+      size_t k = g() % snaps.size();
+      CHECK(same(snaps[k].first, snaps[k].second));
+      snaps.erase(snaps.begin() + k);
+    }
+  }
+  CHECK(same(a, v));
+  for (auto& s : snaps)
+    CHECK(same(s.first, s.second));
+
+  // copies share until written, then part
+  PersistentArray<T> b = a;
+  std::vector<T> w = v;
+  for (size_t i = 0; i < w.size(); i += 7) {
+    b.set(i, element<T>(-1));
+    w[i] = element<T>(-1);
+  }
+  CHECK(same(a, v));
+  CHECK(same(b, w));
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937 g(1);
+  check_against_vector<int>(g, 40000);
+  check_against_vector<std::string>(g, 3000);
+  check_against_vector<Fragile>(g, 3000);
+  CHECK(Fragile::live == 0);
+  check_done("check_persistent");
+  return 0;
+}
@@ -0,0 +1,293 @@
+// file: array/check_ring.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "check.hpp"
+#include "ring.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// RingArray
+
+// by index, by iterator, and through the two spans
+template<typename T>
+bool
+same(const RingArray<T>& r, const std::deque<T>& d)
+{
+  if (r.size() != d.size())
+    return false;
+  for (size_t i = 0; i < d.size(); ++i)
+    if (!(r[i] == d[i]))
+      return false;
+  auto halves = r.spans();
+  if (halves.first.size() + halves.second.size() != d.size())
+    return false;
+  size_t i = 0;
+  for (const T& x : halves.first)
+    if (!(x == d[i++]))
+      return false;
+  for (const T& x : halves.second)
+    if (!(x == d[i++]))
+      return false;
+  return std::equal(r.begin(), r.end(), d.begin(), d.end());
+}
+
+// Random pushes and pops at both ends, bulk appends and drains, against
+// a std::deque. Some pushes copy an element of the ring itself, which
+// is what growing could pull out from under them.
+template<typename T>
+void
+check_against_deque(std::mt19937& g)
+{
+  RingArray<T> r;
+  std::deque<T> d;
+  for (int step = 0; step < 100000; ++step) {
+    unsigned op = g() % 12;
+    T v = element<T>(g() % 1000);
+    if (op < 2) {
+      r.push_back(v);
+      d.push_back(v);
+    } else if (op < 4) {
+      r.emplace_front(v);
+      d.push_front(v);
+    } else if (op < 5 && !d.empty()) {
+      r.push_back(r.front());
+      d.push_back(d.front());
+    } else if (op < 6 && !d.empty()) {
+      r.push_front(r.back());
+      d.push_front(d.back());
+    } else if (op < 7 && !d.empty()) {
+      r.pop_back();
+      d.pop_back();
+    } else if (op < 8 && !d.empty()) {
+      r.pop_front();
+      d.pop_front();
+    } else if (op < 9) {
+      T p[9];
+      size_t n = g() % 10;
+      for (size_t i = 0; i < n; ++i)
+        p[i] = element<T>(g() % 1000);
+      r.append(p, n);
+      d.insert(d.end(), p, p + n);
+    } else if (op < 10) {
+      T out[11];
+      size_t n = g() % 12;
+      size_t k = r.pop_front(out, n);
+      CHECK(k == std::min(n, d.size()));
+      for (size_t i = 0; i < k; ++i) {
+        CHECK(out[i] == d.front());
+        d.pop_front();
+      }
+    } else if (op < 11) {
+      size_t n = std::min<size_t>(g() % 4, d.size());
+      if (g() % 2) {
+        r.pop_back(n);
+        d.erase(d.end() - n, d.end());
+      } else {
+        r.pop_front(n);
+        d.erase(d.begin(), d.begin() + n);
+      }
+    } else if (g() % 50 == 0) {
+      RingArray<T> c = r;
+      CHECK(same(c, d));
+      RingArray<T> m(std::move(c));
+      CHECK(same(m, d) && c.empty());
+      c = m;
+      CHECK(same(c, d));
+      if (g() % 4 == 0) {
+        r.clear();
+        d.clear();
+      }
+    }
+    if (step % 97 == 0)
+      CHECK(same(r, d));
+  }
+  CHECK(same(r, d));
+  r.release();
+  CHECK(r.empty() && r.capacity() == 0);
+}
+
+// A ring full of elements whose copies and moves throw at every step in
+// turn, pushed to at both ends with one of its own elements: a throw
+// must leave it as it was, and nothing leaked or destroyed twice.
+void
+check_throws()
+{
+  for (long k = 0; k < 2 * RING_MAGNITUDE + 8; ++k) {
+    for (int front = 0; front < 2; ++front) {
+      {
+        RingArray<Fragile> r;
+        std::deque<Fragile> d;
+        for (int i = 0; i < RING_MAGNITUDE; ++i) {
+          r.push_front(i);
+          d.push_front(i);
+        }
+        CHECK(r.size() == r.capacity());
+        long live = Fragile::live;
+        Fragile::budget = k;
+        try {
+          if (front)
+            r.emplace_front(r.back());
+          else
+            r.emplace_back(r.front());
+          Fragile::budget = -1;
+          if (front)
+            d.push_front(d.back());
+          else
+            d.push_back(d.front());
+          live += 2; // one in each
+        } catch (const std::runtime_error&) {
+          Fragile::budget = -1;
+        }
+        CHECK(same(r, d));
+        CHECK(Fragile::live == live);
+      }
+      CHECK(Fragile::live == 0);
+    }
+  }
+}
+
+// sorting through the iterators, with the contents wrapped around
+void
+check_iterators()
+{
+  RingArray<int> r {5, 3, 1, 4, 2};
+  r.pop_front(2);
+  int more[] = {7, 0, 6};
+  r.append(more, 3);
+  r.push_front(9);
+  std::sort(r.begin(), r.end());
+  int want[] = {0, 1, 2, 4, 6, 7, 9};
+  CHECK(std::equal(r.begin(), r.end(), std::begin(want), std::end(want)));
+  CHECK(r.end() - r.begin() == 7 && r.begin()[3] == 4);
+
+  RingArray<int> w(100);
+  CHECK(w.capacity() == 128 && w.empty());
+}
+
+// Appending a run of its own elements to a full ring, which has to grow
+// before it copies them.
+void
+check_self_append()
+{
+  for (size_t k = 1; k <= 2 * RING_MAGNITUDE; ++k) {
+    RingArray<std::string> r;
+    std::deque<std::string> d;
+    for (int i = 0; i < RING_MAGNITUDE; ++i) {
+      r.push_back(std::to_string(i) + " is long enough to be on the heap");
+      d.push_back(r.back());
+    }
+    r.pop_front(3);
+    d.erase(d.begin(), d.begin() + 3);
+    for (int i = 0; i < 3; ++i) {
+      r.push_back(std::to_string(i));
+      d.push_back(r.back());
+    }
+    CHECK(r.size() == r.capacity());
+    size_t n = std::min(k, r.spans().first.size());
+    r.append(&r[0], n);
+    d.insert(d.end(), d.begin(), d.begin() + n);
+    CHECK(same(r, d));
+  }
+}
+
+// Moves that may throw and no copy at all: growing has to move.
+struct Stubborn
+{
+  std::unique_ptr<int> p;
+
+  Stubborn(int v) : p(new int(v)) {}
+  Stubborn(Stubborn&& s) noexcept(false) : p(std::move(s.p)) {}
+  Stubborn& operator=(Stubborn&& s) noexcept(false)
+  {
+    p = std::move(s.p);
+    return *this;
+  }
+};
+
+void
+check_move_only()
+{
+  RingArray<Stubborn> r;
+  for (int i = 0; i < 1000; ++i) {
+    if (i % 2)
+      r.emplace_back(i);
+    else
+      r.emplace_front(i);
+  }
+  bool kept = r.size() == 1000;
+  for (size_t i = 0; i < r.size(); ++i)
+    kept &= *r[i].p == int(i < 500 ? 998 - 2 * i : 2 * i - 999);
+  CHECK(kept);
+}
+
+////////////////////////////////////////////////////////////////////////
+// SpscRing
+
+// A producer and a consumer passing strings in order, one at a time and
+// in runs, through a ring small enough to fill up.
+void
+check_spsc()
+{
+  const int n = 100000;
+  SpscRing<std::string> s(64);
+  std::thread producer([&] {
+    for (int i = 0; i < n;) {
+      if (i % 3) {
+        i += s.try_push(std::to_string(i));
+        continue;
+      }
+      std::string p[4];
+      int k = std::min(4, n - i);
+      for (int j = 0; j < k; ++j)
+        p[j] = std::to_string(i + j);
+      i += s.try_push(p, k);
+    }
+  });
+
+  bool ordered = true;
+  for (int next = 0; next < n;) {
+    std::string out[5];
+    size_t k = next % 2 ? s.try_pop(out, 5) : s.try_pop(out[0]);
+    for (size_t j = 0; j < k; ++j)
+      ordered &= out[j] == std::to_string(next++);
+  }
+  producer.join();
+  CHECK(ordered && s.empty());
+
+  // left over at destruction, and refused when full
+  SpscRing<Fragile> f(3);
+  CHECK(f.capacity() == 4);
+  for (int i = 0; i < 6; ++i)
+    CHECK(f.try_push(i) == (i < 4));
+  CHECK(f.size() == 4);
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937 g(1);
+  check_against_deque<int>(g);
+  check_against_deque<std::string>(g);
+  check_throws();
+  check_iterators();
+  check_self_append();
+  check_move_only();
+  check_spsc();
+  CHECK(Fragile::live == 0);
+  check_done("check_ring");
+  return 0;
+}
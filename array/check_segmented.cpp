@@ -0,0 +1,117 @@
+// file: array/check_segmented.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "segmented.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// checks
+
+// by index and by iterator
+template<typename T, size_t B>
+bool
+same(SegmentedArray<T, B>& a, const std::vector<T>& v)
+{
+  if (a.size() != v.size() || a.capacity() < a.size())
+    return false;
+  for (size_t i = 0; i < v.size(); ++i)
+    if (!(a[i] == v[i]))
+      return false;
+  const SegmentedArray<T, B>& c = a;
+  return std::equal(c.begin(), c.end(), v.begin(), v.end()) &&
+         std::equal(a.begin(), a.end(), v.begin(), v.end());
+}
+
+// Random pushes, pops, resizes, self-appends and shrinks against a
+// std::vector, on segments small enough that most operations cross
+// one. Every element keeps its address for as long as it lives, which
+// is the point of the container, and pushes of an element of the array
+// itself are safe.
+template<typename T, size_t B>
+void
+check_against_vector(std::mt19937& g)
+{
+  SegmentedArray<T, B> a;
+  std::vector<T> v;
+  std::vector<const T*> where;
+  for (int step = 0; step < 20000; ++step) {
+    unsigned op = g() % 16;
+    if (v.size() > 3000)
+      op = 9;
+    if (op < 6) {
+      T x = element<T>(g() % 1000);
+      a.push_back(x);
+      v.push_back(x);
+    } else if (op < 7 && !v.empty()) {
+      size_t i = g() % v.size();
+      a.emplace_back(a[i]);
+      v.push_back(v[i]);
+    } else if (op < 10 && !v.empty()) {
+      a.pop_back();
+      v.pop_back();
+    } else if (op < 11) {
+      size_t n = g() % (v.size() + 20);
+      a.resize(n);
+      v.resize(n);
+    } else if (op < 12 && v.size() < 500) {
+      a.append(a);
+      std::vector<T> w = v;
+      v.insert(v.end(), w.begin(), w.end());
+    } else if (op < 13) {
+      a.shrink_to_fit();
+    } else if (op < 14) {
+      a.reserve(v.size() + g() % 100);
+    } else if (op < 15 && g() % 20 == 0) {
+      SegmentedArray<T, B> c(a);
+      CHECK(same(c, v));
+      SegmentedArray<T, B> m(std::move(c));
+      CHECK(same(m, v) && c.empty());
+      c = m;
+      a.swap(c);
+      CHECK(same(a, v));
+      where.clear();
+    } else if (g() % 200 == 0) {
+      a.clear();
+      v.clear();
+    }
+
+    // addresses of the survivors never change
+    if (where.size() > v.size())
+      where.resize(v.size());
+    for (size_t i = 0; i < where.size(); ++i)
+      CHECK(where[i] == &a[i]);
+    for (size_t i = where.size(); i < v.size(); ++i)
+      where.push_back(&a[i]);
+    if (step % 101 == 0)
+      CHECK(same(a, v));
+  }
+  CHECK(same(a, v));
+  a.release();
+  CHECK(a.empty() && a.capacity() == 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937 g(1);
+  check_against_vector<int, 1>(g);
+  check_against_vector<int, 8>(g);
+  check_against_vector<std::string, 4>(g);
+  check_against_vector<Fragile, 2>(g);
+  CHECK(Fragile::live == 0);
+  check_done("check_segmented");
+  return 0;
+}
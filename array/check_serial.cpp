@@ -0,0 +1,123 @@
+// file: array/check_serial.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <random>
+#include <string>
+#include <system_error>
+
+#include <unistd.h> // getpid, truncate, unlink
+
+#include "check.hpp"
+#include "serial.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// checks
+
+struct Point
+{
+  double x, y;
+  int tag;
+};
+
+// whether f throws a system_error
+template<typename F>
+bool
+fails(F f)
+{
+  try {
+    f();
+  } catch (const std::system_error&) {
+    return true;
+  }
+  return false;
+}
+
+// Round trips of every size up past a few checksum blocks, through load
+// and through a view.
+void
+check_round_trip(const char* path, std::mt19937& g)
+{
+  for (size_t n : {0, 1, 3, 4, 5, 31, 1000, 100003}) {
+    Array<Point> a;
+    for (size_t i = 0; i < n; ++i)
+      a.push_back(Point {(double)g(), -(double)i, (int)i});
+    save(a, path);
+
+    Array<Point> b(7);
+    load(b, path);
+    CHECK(b.size() == n);
+    for (size_t i = 0; i < n; ++i)
+      CHECK(b[i].x == a[i].x && b[i].y == a[i].y && b[i].tag == a[i].tag);
+
+    ArrayView<Point> v(path);
+    CHECK(v.size() == n && v.verify());
+    for (size_t i = 0; i < n; ++i)
+      CHECK(v[i].x == a[i].x && v[i].tag == a[i].tag);
+  }
+}
+
+// Damaged, truncated and mistyped files are refused, and a failed load
+// leaves its array alone.
+void
+check_refusals(const char* path)
+{
+  Array<int> a;
+  for (int i = 0; i < 5000; ++i)
+    a.push_back(i * i);
+  save(a, path);
+
+  CHECK(fails([&] { ArrayView<double> v(path); }));
+  CHECK(fails([&] {
+    Array<double> d;
+    load(d, path);
+  }));
+
+  // one flipped byte in the elements
+  {
+    int fd = open(path, O_RDWR);
+    CHECK(fd >= 0);
+    char c;
+    CHECK(pread(fd, &c, 1, sizeof(SerialHeader) + 4321) == 1);
+    c ^= 0x10;
+    CHECK(pwrite(fd, &c, 1, sizeof(SerialHeader) + 4321) == 1);
+    close(fd);
+  }
+  ArrayView<int> v(path);
+  CHECK(!v.verify());
+  Array<int> b(3, 9);
+  CHECK(fails([&] { load(b, path); }));
+  CHECK(b.size() == 3 && b[0] == 9);
+
+  // cut short, in the elements and in the header
+  save(a, path);
+  CHECK(truncate(path, sizeof(SerialHeader) + 100) == 0);
+  CHECK(fails([&] { load(b, path); }));
+  CHECK(fails([&] { ArrayView<int> w(path); }));
+  CHECK(truncate(path, 10) == 0);
+  CHECK(fails([&] { load(b, path); }));
+  CHECK(fails([&] { ArrayView<int> w(path); }));
+
+  unlink(path);
+  CHECK(fails([&] { load(b, path); }));
+  CHECK(b.size() == 3 && b[0] == 9);
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::string path = "/tmp/check_serial." + std::to_string(getpid());
+  std::mt19937 g(1);
+  check_round_trip(path.c_str(), g);
+  check_refusals(path.c_str());
+  unlink(path.c_str());
+  check_done("check_serial");
+  return 0;
+}
@@ -0,0 +1,114 @@
+// file: array/check_simd.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "simd.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// checks
+
+// Every kernel against a plain loop, on every length up to a few of the
+// widest vectors and from an odd start, so that the unrolled body, the
+// single vectors and the scalar tail all get their turn. The values are
+// small whole numbers, so floating point sums come out exact however
+// they are reassociated.
+template<typename T>
+void
+check_kernels(std::mt19937& g)
+{
+  const size_t most = 4 * SIMD_UNROLL * 64 / sizeof(T) + 3;
+  std::vector<T> x(most + 2), y(most + 2);
+  for (size_t i = 0; i < x.size(); ++i) {
+    x[i] = T(int(g() % 15) - (std::is_signed<T>::value ? 7 : 0));
+    y[i] = T(int(g() % 15) - (std::is_signed<T>::value ? 7 : 0));
+  }
+
+  for (size_t n = 0; n <= most; ++n) {
+    for (size_t first = 0; first < 2; ++first) {
+      const T* p = x.data() + first;
+      const T* q = y.data() + first;
+
+      T sum = 0, dot = 0;
+      for (size_t i = 0; i < n; ++i) {
+        sum += p[i];
+        dot += p[i] * q[i];
+      }
+      CHECK(vsum(p, n) == sum);
+      CHECK(vdot(p, q, n) == dot);
+
+      if (n) {
+        T lo = p[0], hi = p[0];
+        for (size_t i = 1; i < n; ++i) {
+          lo = p[i] < lo ? p[i] : lo;
+          hi = p[i] > hi ? p[i] : hi;
+        }
+        CHECK(vmin(p, n) == lo && vmax(p, n) == hi);
+      }
+
+      // the element right after the run is there to be left alone
+      std::vector<T> z(q, q + n + 1), w = z;
+      vaxpy(T(3), p, z.data(), n);
+      for (size_t i = 0; i < n; ++i)
+        w[i] = T(3) * p[i] + w[i];
+      CHECK(z == w);
+      vscale(T(2), z.data(), n);
+      for (size_t i = 0; i < n; ++i)
+        w[i] *= T(2);
+      CHECK(z == w);
+
+      std::vector<uint8_t> m(n + 1, 9);
+      vless(p, T(3), m.data(), n);
+      bool less = m[n] == 9;
+      for (size_t i = 0; i < n; ++i)
+        less &= m[i] == (p[i] < T(3));
+      CHECK(less);
+    }
+  }
+}
+
+// the Array overloads go to the same kernels
+void
+check_arrays()
+{
+  Array<int> a, b;
+  for (int i = 0; i < 37; ++i) {
+    a.push_back(i - 18);
+    b.push_back(2);
+  }
+  CHECK(vsum(a) == 0 && vmin(a) == -18 && vmax(a) == 18);
+  CHECK(vdot(a, b) == 0);
+  vaxpy(1, a, b);
+  vscale(2, b);
+  CHECK(b[0] == -32 && b[36] == 40);
+  Array<uint8_t> m = vless(a, 0);
+  CHECK(m.size() == 37 && vsum(m) == 18);
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937 g(1);
+  for (Simd cap : {Simd::scalar, Simd::sse2, Simd::avx2, Simd::avx512}) {
+    simd_cap() = cap;
+    check_kernels<int8_t>(g);
+    check_kernels<uint8_t>(g);
+    check_kernels<int32_t>(g);
+    check_kernels<int64_t>(g);
+    check_kernels<float>(g);
+    check_kernels<double>(g);
+    check_arrays();
+  }
+  check_done("check_simd");
+  return 0;
+}
@@ -0,0 +1,185 @@
+// file: array/check_soa.cpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "check.hpp"
+#include "soa.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// checks
+
+using Row = std::tuple<int, std::string, double>;
+using Table = SoAArray<int, std::string, double>;
+
+// row by row, and column by column through the spans
+bool
+same(Table& t, const std::vector<Row>& v)
+{
+  if (t.size() != v.size())
+    return false;
+  for (size_t i = 0; i < v.size(); ++i)
+    if (Row(t[i]) != v[i])
+      return false;
+  Span<int> a = t.column<0>();
+  Span<const std::string> b = static_cast<const Table&>(t).column<1>();
+  Span<double> c = t.column<2>();
+  if (a.size() != v.size() || b.size() != v.size() || c.size() != v.size())
+    return false;
+  for (size_t i = 0; i < v.size(); ++i)
+    if (a[i] != std::get<0>(v[i]) || b[i] != std::get<1>(v[i]) ||
+        c[i] != std::get<2>(v[i]))
+      return false;
+  return std::equal(t.begin(), t.end(), v.begin(), v.end(),
+                    [](auto r, const Row& w) { return Row(r) == w; });
+}
+
+Row
+row(std::mt19937& g)
+{
+  int k = g() % 50;
+  return Row(k, std::to_string(g() % 50), k / 4.0);
+}
+
+// Random pushes of every kind, pops, resizes, appends of itself, writes
+// through rows and columns, swaps of rows, and sorts through the row
+// proxy, against a std::vector of tuples.
+void
+check_against_vector(std::mt19937& g)
+{
+  Table t;
+  std::vector<Row> v;
+  for (int step = 0; step < 20000; ++step) {
+    unsigned op = g() % 12;
+    Row r = row(g);
+    if (op < 2) {
+      t.push_back(std::get<0>(r), std::get<1>(r), std::get<2>(r));
+      v.push_back(r);
+    } else if (op < 4) {
+      t.push_back(r);
+      v.push_back(r);
+    } else if (op < 5 && !v.empty()) {
+      // from a row of its own, which growing could move away
+      auto f = t.front();
+      t.emplace_back(std::get<0>(f), std::get<1>(f), std::get<2>(f));
+      v.push_back(v.front());
+    } else if (op < 6 && !v.empty()) {
+      t.pop_back();
+      v.pop_back();
+    } else if (op < 7) {
+      size_t n = g() % (v.size() + 4);
+      t.resize(n);
+      v.resize(n);
+    } else if (op < 8 && v.size() < 1000) {
+      t.append(t);
+      std::vector<Row> w = v;
+      v.insert(v.end(), w.begin(), w.end());
+    } else if (op < 9 && !v.empty()) {
+      size_t i = g() % v.size();
+      t[i] = r;
+      v[i] = r;
+      std::get<1>(t[i]) += "x";
+      std::get<1>(v[i]) += "x";
+      t.column<2>()[i] = -1;
+      std::get<2>(v[i]) = -1;
+    } else if (op < 10 && !v.empty()) {
+      size_t i = g() % v.size();
+      size_t j = g() % v.size();
+      swap(t[i], t[j]);
+      std::swap(v[i], v[j]);
+    } else if (op < 11) {
+      std::sort(t.begin(), t.end());
+      std::sort(v.begin(), v.end());
+    } else {
+      // descending, through rows that are only references
+      auto by = [](const auto& a, const auto& b) { return Row(a) > Row(b); };
+      std::sort(t.begin(), t.end(), by);
+      std::sort(v.begin(), v.end(), by);
+    }
+    if (step % 101 == 0)
+      CHECK(same(t, v));
+  }
+  CHECK(same(t, v));
+
+  auto [k, s, d] = t.back();
+  CHECK(Row(k, s, d) == v.back());
+  Table u;
+  u.swap(t);
+  CHECK(t.empty() && same(u, v));
+  u.release();
+  CHECK(u.empty() && u.capacity() == 0);
+}
+
+// Columns start on cache lines and all grow in lockstep, and the spans
+// feed straight into loops over one field.
+void
+check_columns()
+{
+  SoAArray<float, char, double> t;
+  for (int i = 0; i < 1000; ++i) {
+    t.push_back(float(i), char(i), i * 2.0);
+    CHECK((uintptr_t)t.column<0>().data() % CACHE_LINE == 0);
+    CHECK((uintptr_t)t.column<1>().data() % CACHE_LINE == 0);
+    CHECK((uintptr_t)t.column<2>().data() % CACHE_LINE == 0);
+  }
+  double sum = 0;
+  for (double x : t.column<2>())
+    sum += x;
+  CHECK(sum == 999.0 * 1000.0);
+  for (float& x : t.column<0>())
+    x = -x;
+  CHECK(std::get<0>(t[10]) == -10.0f && std::get<1>(t[10]) == char(10));
+  t.resize(5);
+  t.shrink_to_fit();
+  CHECK(t.capacity() == 5 && t.column<1>().size() == 5);
+  CHECK(!t.column<2>().empty() && t.column<2>().end()[-1] == 8.0);
+}
+
+// A field that throws part way through a push leaves no column longer
+// than the others, and nothing leaked.
+void
+check_throws()
+{
+  {
+    SoAArray<std::string, Fragile, int> t;
+    for (int i = 0; i < 100; ++i) {
+      long live = Fragile::live;
+      Fragile f(i);
+      Fragile::budget = i % 3 ? -1 : 0;
+      try {
+        t.push_back(std::to_string(i), f, i);
+      } catch (const std::runtime_error&) {
+      }
+      Fragile::budget = -1;
+      CHECK(t.size() == size_t(i - i / 3));
+      CHECK(t.column<0>().size() == t.size() &&
+            t.column<1>().size() == t.size() &&
+            t.column<2>().size() == t.size());
+      CHECK(Fragile::live == live + 1 + long(i % 3 != 0));
+    }
+  }
+  CHECK(Fragile::live == 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// main
+
+int
+main()
+{
+  std::mt19937 g(1);
+  check_against_vector(g);
+  check_columns();
+  check_throws();
+  check_done("check_soa");
+  return 0;
+}
@@ -0,0 +1,466 @@
+// file: array/concurrent.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <atomic>
+
+#include "segmented.hpp"
+
+#define CONCURRENT_MAGNITUDE 1024 // elements in the first segment
+#define CONCURRENT_BUILT 1        // slot states; 0 is still being built
+#define CONCURRENT_HOLE 2
+
+////////////////////////////////////////////////////////////////////////
+// declaration
+
+// An append-only Array that any number of threads may push to at once
+// without a lock. A push claims its slot with one fetch_add and builds
+// the element there; segments are laid out as in SegmentedArray and
+// installed with a compare-and-swap, so nothing is ever relocated.
+//
+// Every slot carries a state flag. size() is the published prefix: the
+// longest run of slots from 0 that are all settled. Readers may index
+// and iterate below size() while pushes go on; only the destructor
+// requires that no thread is pushing. A push whose constructor throws
+// cannot give its slot back, as later ones may have been claimed, so
+// it settles the slot as a hole instead: publication goes on past it,
+// has() is false there, and iteration skips it.
+
+template <typename T, size_t B = CONCURRENT_MAGNITUDE>
+class ConcurrentArray
+{
+
+  using seg = Segments<B>;
+
+public:
+  class Iterator;
+  using const_iterator = Iterator;
+
+  // constructors
+  ConcurrentArray();
+  ConcurrentArray(size_t n);
+
+  // operators
+  const T& operator[](size_t i) const;
+  T& operator[](size_t i);
+
+  // accessors
+  size_t size() const;
+  size_t claimed() const;
+  size_t capacity() const;
+  bool empty() const;
+  const T& front() const;
+  bool has(size_t i) const;
+
+  // mutators
+  void reserve(size_t n);
+  void push_back(const T& v);
+  void push_back(T&& v);
+  template<typename... Args>
+  T& emplace_back(Args&&... args);
+  size_t append(const T* p, size_t n);
+
+  // bonus
+  ~ConcurrentArray();
+  ConcurrentArray(const ConcurrentArray<T, B>&) = delete;
+  ConcurrentArray<T, B>& operator=(const ConcurrentArray<T, B>&) = delete;
+  const_iterator begin() const;
+  const_iterator end() const;
+
+private:
+  using flag = std::atomic<unsigned char>;
+
+  std::atomic<T*> segments_[seg::count]; // installed once, never moved
+
+  // apart, so that pushers and readers do not share a line
+  alignas(CACHE_LINE) std::atomic<size_t> next_;              // claimed
+  alignas(CACHE_LINE) mutable std::atomic<size_t> published_; // built
+
+  T* segment(size_t k);
+  static flag* flags(T* s, size_t k);
+  unsigned char state(size_t i) const;
+  static size_t bytes(size_t k);
+  void commit(size_t i, unsigned char state);
+};
+
+////////////////////////////////////////////////////////////////////////
+// iterator
+
+// Iterates the prefix that was published when end() was called,
+// skipping holes. Skipping may run past that end while pushes go on, so
+// end() compares equal to anything at or beyond it.
+
+template<typename T, size_t B>
+class ConcurrentArray<T, B>::Iterator
+{
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const T*;
+  using reference = const T&;
+
+  Iterator(const ConcurrentArray<T, B>* a, size_t i, bool end = false)
+    : a_(a), i_(i), k_(0), p_(nullptr), last_(nullptr), end_(end)
+  {
+    locate();
+    if (!end_)
+      skip();
+  }
+
+  reference operator*() const { return *slot(); }
+  pointer operator->() const { return slot(); }
+
+  Iterator& operator++()
+  {
+    ++i_;
+    if (!p_ || ++p_ == last_)
+      locate();
+    skip();
+    return *this;
+  }
+
+  Iterator operator++(int)
+  {
+    Iterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+
+  bool operator==(const Iterator& it) const
+  {
+    if (end_ != it.end_)
+      return end_ ? it.i_ >= i_ : i_ >= it.i_;
+    return i_ == it.i_;
+  }
+
+  bool operator!=(const Iterator& it) const { return !(*this == it); }
+
+private:
+  // A segment is only looked up when it is reached, and again on
+  // dereference if it was missing then: begin() may well come before
+  // the first push, and end() after it.
+  void locate()
+  {
+    k_ = seg::segment(i_);
+    T* s = a_->segments_[k_].load(std::memory_order_acquire);
+    p_ = s ? s + seg::offset(i_, k_) : nullptr;
+    last_ = s ? s + seg::length(k_) : nullptr;
+  }
+
+  // past any holes, which are all settled, so they are all there
+  void skip()
+  {
+    while (p_ && a_->state(i_) == CONCURRENT_HOLE) {
+      ++i_;
+      if (++p_ == last_)
+        locate();
+    }
+  }
+
+  pointer slot() const
+  {
+    if (p_)
+      return p_;
+    return a_->segments_[k_].load(std::memory_order_acquire)
+           + seg::offset(i_, k_);
+  }
+
+  const ConcurrentArray<T, B>* a_;
+  size_t i_;     // index
+  size_t k_;     // segment of i_
+  pointer p_;    // slot of i_
+  pointer last_; // end of segment k_
+  bool end_;     // made by end()
+};
+
+////////////////////////////////////////////////////////////////////////
+// storage
+
+// A segment is its elements followed by one state flag per element.
+template<typename T, size_t B>
+size_t
+ConcurrentArray<T, B>::bytes(size_t k)
+{
+  return seg::length(k) * (sizeof(T) + sizeof(flag));
+}
+
+template<typename T, size_t B>
+typename ConcurrentArray<T, B>::flag*
+ConcurrentArray<T, B>::flags(T* s, size_t k)
+{
+  return reinterpret_cast<flag*>(s + seg::length(k));
+}
+
+// Whoever finds segment k missing builds one and races to install it;
+// the losers throw theirs away.
+template<typename T, size_t B>
+T*
+ConcurrentArray<T, B>::segment(size_t k)
+{
+  T* s = segments_[k].load(std::memory_order_acquire);
+  if (s)
+    return s;
+
+  T* mine = static_cast<T*>(raw_alloc(bytes(k), alignof(T)));
+  flag* f = flags(mine, k);
+  for (size_t j = 0; j < seg::length(k); ++j)
+    new (f + j) flag(0);
+
+  if (segments_[k].compare_exchange_strong(s, mine,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire))
+    return mine;
+  raw_free(mine, bytes(k), alignof(T));
+  return s;
+}
+
+// Settle slot i. A hole may be in a segment that failed to come in, so
+// this may have to make it.
+template<typename T, size_t B>
+void
+ConcurrentArray<T, B>::commit(size_t i, unsigned char state)
+{
+  size_t k = seg::segment(i);
+  flags(segment(k), k)[seg::offset(i, k)].store(state,
+                                                std::memory_order_release);
+}
+
+// the state of slot i, 0 if its segment is not there yet
+template<typename T, size_t B>
+unsigned char
+ConcurrentArray<T, B>::state(size_t i) const
+{
+  size_t k = seg::segment(i);
+  T* s = segments_[k].load(std::memory_order_acquire);
+  return s ? flags(s, k)[seg::offset(i, k)].load(std::memory_order_acquire)
+           : 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+// constructors
+
+template<typename T, size_t B>
+ConcurrentArray<T, B>::ConcurrentArray()
+  : next_(0), published_(0)
+{
+  for (auto& s : segments_)
+    s.store(nullptr, std::memory_order_relaxed);
+}
+
+template<typename T, size_t B>
+ConcurrentArray<T, B>::ConcurrentArray(size_t n)
+  : ConcurrentArray()
+{
+  reserve(n);
+}
+
+////////////////////////////////////////////////////////////////////////
+// operators
+
+template<typename T, size_t B>
+const T&
+ConcurrentArray<T, B>::operator[](size_t i) const
+{
+  assert(i < size() && has(i));
+
+  size_t k = seg::segment(i);
+  return segments_[k].load(std::memory_order_acquire)[seg::offset(i, k)];
+}
+
+template<typename T, size_t B>
+T&
+ConcurrentArray<T, B>::operator[](size_t i)
+{
+  assert(i < size() && has(i));
+
+  size_t k = seg::segment(i);
+  return segments_[k].load(std::memory_order_acquire)[seg::offset(i, k)];
+}
+
+////////////////////////////////////////////////////////////////////////
+// accessors
+
+// Advance the published prefix over every settled slot, built or hole.
+// Any reader may do it, so no pusher ever waits for another.
+template<typename T, size_t B>
+size_t
+ConcurrentArray<T, B>::size() const
+{
+  size_t p = published_.load(std::memory_order_acquire);
+  size_t n = next_.load(std::memory_order_acquire);
+  size_t q = p;
+  while (q < n && state(q))
+    ++q;
+  while (q > p && !published_.compare_exchange_weak(
+                    p, q, std::memory_order_acq_rel,
+                    std::memory_order_acquire))
+    ;
+  return q > p ? q : p;
+}
+
+// slots handed out, including ones still being built
+template<typename T, size_t B>
+size_t
+ConcurrentArray<T, B>::claimed() const
+{
+  return next_.load(std::memory_order_relaxed);
+}
+
+template<typename T, size_t B>
+size_t
+ConcurrentArray<T, B>::capacity() const
+{
+  size_t k = 0;
+  while (k < seg::count && segments_[k].load(std::memory_order_relaxed))
+    ++k;
+  return seg::start(k);
+}
+
+template<typename T, size_t B>
+bool
+ConcurrentArray<T, B>::empty() const
+{
+  return size() == 0;
+}
+
+template<typename T, size_t B>
+const T&
+ConcurrentArray<T, B>::front() const
+{
+  return (*this)[0];
+}
+
+// whether slot i, below size(), holds an element rather than a hole
+template<typename T, size_t B>
+bool
+ConcurrentArray<T, B>::has(size_t i) const
+{
+  assert(i < size());
+
+  return state(i) == CONCURRENT_BUILT;
+}
+
+////////////////////////////////////////////////////////////////////////
+// mutators
+
+template<typename T, size_t B>
+void
+ConcurrentArray<T, B>::reserve(size_t n)
+{
+  for (size_t k = 0; seg::start(k) < n; ++k)
+    segment(k);
+}
+
+template<typename T, size_t B>
+void
+ConcurrentArray<T, B>::push_back(const T& v)
+{
+  emplace_back(v);
+}
+
+template<typename T, size_t B>
+void
+ConcurrentArray<T, B>::push_back(T&& v)
+{
+  emplace_back(std::move(v));
+}
+
+template<typename T, size_t B>
+template<typename... Args>
+T&
+ConcurrentArray<T, B>::emplace_back(Args&&... args)
+{
+  size_t i = next_.fetch_add(1, std::memory_order_relaxed);
+  size_t k = seg::segment(i);
+  T* p;
+  try {
+    p = segment(k) + seg::offset(i, k);
+    new (p) T(std::forward<Args>(args)...);
+  } catch (...) {
+    commit(i, CONCURRENT_HOLE);
+    throw;
+  }
+  commit(i, CONCURRENT_BUILT);
+  return *p;
+}
+
+// Claims n consecutive slots with a single fetch_add, which keeps the
+// shared counter out of the way of bulk producers. Returns the index of
+// the first. If a copy throws, the slots from there on become holes.
+template<typename T, size_t B>
+size_t
+ConcurrentArray<T, B>::append(const T* p, size_t n)
+{
+  size_t i = next_.fetch_add(n, std::memory_order_relaxed);
+  size_t j = 0;
+  try {
+    while (j < n) {
+      size_t k = seg::segment(i + j);
+      size_t o = seg::offset(i + j, k);
+      size_t m = seg::length(k) - o;
+      if (m > n - j)
+        m = n - j;
+      T* s = segment(k);
+      flag* f = flags(s, k) + o;
+      if constexpr (std::is_trivially_copyable<T>::value) {
+        std::memcpy(s + o, p + j, m * sizeof(T));
+        for (size_t r = 0; r < m; ++r)
+          f[r].store(CONCURRENT_BUILT, std::memory_order_release);
+        j += m;
+      } else {
+        for (size_t r = 0; r < m; ++r, ++j) {
+          new (s + o + r) T(p[j]);
+          f[r].store(CONCURRENT_BUILT, std::memory_order_release);
+        }
+      }
+    }
+  } catch (...) {
+    for (; j < n; ++j)
+      commit(i + j, CONCURRENT_HOLE);
+    throw;
+  }
+  return i;
+}
+
+////////////////////////////////////////////////////////////////////////
+// bonus
+
+// destructor
+template<typename T, size_t B>
+ConcurrentArray<T, B>::~ConcurrentArray()
+{
+  for (size_t k = 0; k < seg::count; ++k) {
+    T* s = segments_[k].load(std::memory_order_acquire);
+    if (!s)
+      break;
+    if constexpr (!std::is_trivially_destructible<T>::value) {
+      flag* f = flags(s, k);
+      for (size_t j = 0; j < seg::length(k); ++j)
+        if (f[j].load(std::memory_order_relaxed) == CONCURRENT_BUILT)
+          s[j].~T();
+    }
+    raw_free(s, bytes(k), alignof(T));
+  }
+}
+
+//// iterators
+
+template<typename T, size_t B>
+typename ConcurrentArray<T, B>::const_iterator
+ConcurrentArray<T, B>::begin() const {
+  return const_iterator(this, 0);
+}
+
+template<typename T, size_t B>
+typename ConcurrentArray<T, B>::const_iterator
+ConcurrentArray<T, B>::end() const {
+  return const_iterator(this, size(), true);
+}
@@ -0,0 +1,859 @@
+// file: array/flat.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <functional>       // std::less
+#include <initializer_list>
+#include <iterator>         // std::random_access_iterator_tag
+#include <utility>          // std::pair
+
+#include "array.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// search
+
+// Binary search without a branch in the loop: each step halves the
+// range with a conditional move, so a lookup is log2(n) dependent loads
+// and no mispredictions. Both places the next step may load from are
+// prefetched, which hides most of the misses once the keys no longer
+// fit in cache. They are exactly where the next step looks, so they
+// never point past the range.
+//
+// Upper is false for the first element not less than k, true for the
+// first element greater than k.
+template<bool Upper, typename K, typename Q, typename C>
+const K*
+flat_bound(const K* p, size_t n, const Q& k, const C& comp)
+{
+  if (n == 0)
+    return p;
+
+  while (n > 1) {
+    size_t h = n / 2;
+    size_t q = (n - h) / 2; // the next step's h
+    __builtin_prefetch(p + q);
+    __builtin_prefetch(p + h + q);
+    p = (Upper ? !comp(k, p[h]) : comp(p[h], k)) ? p + h : p;
+    n -= h;
+  }
+  return p + (Upper ? !comp(k, *p) : comp(*p, k));
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatSet declaration
+
+// A set kept as a sorted Array of keys. Lookups search the keys in
+// place and iteration is a walk down the array, so there is one
+// allocation for the whole set and no pointer to chase. Single inserts
+// and erases shift the tail and cost O(n); building from a range or
+// inserting many keys at once sorts them and merges in one pass, so
+// prefer that for anything bigger than a handful:
+//
+//   FlatSet<int> s {5, 1, 3, 1};  // 1 3 5
+//   s.insert(v.begin(), v.end());
+//   bool b = s.contains(3);
+//
+// Keys are equal when neither is less than the other under C.
+
+template<typename K, typename C = std::less<K>>
+class FlatSet
+{
+
+public:
+  using value_type = K;
+  using iterator = const K*;
+
+  // constructors
+  FlatSet(const C& comp = C());
+  FlatSet(std::initializer_list<K> l, const C& comp = C());
+  template<typename I,
+           typename = typename std::iterator_traits<I>::iterator_category>
+  FlatSet(I first, I last, const C& comp = C());
+
+  // operators
+  const K& operator[](size_t i) const;
+
+  // accessors
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+  const K* find(const K& k) const;
+  bool contains(const K& k) const;
+  size_t count(const K& k) const;
+  const K* lower_bound(const K& k) const;
+  const K* upper_bound(const K& k) const;
+  const Array<K>& keys() const;
+
+  // mutators
+  void reserve(size_t n);
+  void shrink_to_fit();
+  std::pair<const K*, bool> insert(const K& k);
+  std::pair<const K*, bool> insert(K&& k);
+  template<typename I,
+           typename = typename std::iterator_traits<I>::iterator_category>
+  void insert(I first, I last);
+  size_t erase(const K& k);
+  const K* erase(const K* pos);
+  void clear();
+  void release();
+  void swap(FlatSet<K, C>& s);
+
+  // bonus
+  const K* begin() const;
+  const K* end() const;
+
+private:
+  Array<K> keys_; // sorted, no two equal
+  C comp_;
+
+  bool equal(const K& a, const K& b) const;
+  void settle(size_t from);
+};
+
+////////////////////////////////////////////////////////////////////////
+// FlatSet helpers
+
+template<typename K, typename C>
+bool
+FlatSet<K, C>::equal(const K& a, const K& b) const
+{
+  return !comp_(a, b) && !comp_(b, a);
+}
+
+// Sort the keys from index from on, merge them into the sorted ones
+// before, and drop repeats. The merge is stable, so of two equal keys
+// the one already in the set stays.
+template<typename K, typename C>
+void
+FlatSet<K, C>::settle(size_t from)
+{
+  K* b = keys_.begin();
+  K* m = b + from;
+  K* e = keys_.end();
+  if (m == e)
+    return;
+
+  std::stable_sort(m, e, comp_);
+  if (m != b && comp_(*m, m[-1]))
+    std::inplace_merge(b, m, e, comp_);
+  keys_.erase(std::unique(b, e, [this](const K& x, const K& y) {
+    return equal(x, y);
+  }), e);
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatSet constructors
+
+template<typename K, typename C>
+FlatSet<K, C>::FlatSet(const C& comp)
+  : keys_(), comp_(comp)
+{
+}
+
+template<typename K, typename C>
+FlatSet<K, C>::FlatSet(std::initializer_list<K> l, const C& comp)
+  : keys_(), comp_(comp)
+{
+  insert(l.begin(), l.end());
+}
+
+template<typename K, typename C>
+template<typename I, typename>
+FlatSet<K, C>::FlatSet(I first, I last, const C& comp)
+  : keys_(), comp_(comp)
+{
+  insert(first, last);
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatSet operators
+
+template<typename K, typename C>
+const K&
+FlatSet<K, C>::operator[](size_t i) const
+{
+  assert(i < size());
+
+  return keys_.begin()[i];
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatSet accessors
+
+template<typename K, typename C>
+size_t
+FlatSet<K, C>::size() const
+{
+  return keys_.size();
+}
+
+template<typename K, typename C>
+size_t
+FlatSet<K, C>::capacity() const
+{
+  return keys_.capacity();
+}
+
+template<typename K, typename C>
+bool
+FlatSet<K, C>::empty() const
+{
+  return keys_.empty();
+}
+
+template<typename K, typename C>
+const K*
+FlatSet<K, C>::find(const K& k) const
+{
+  const K* p = lower_bound(k);
+  return p != end() && !comp_(k, *p) ? p : end();
+}
+
+template<typename K, typename C>
+bool
+FlatSet<K, C>::contains(const K& k) const
+{
+  return find(k) != end();
+}
+
+template<typename K, typename C>
+size_t
+FlatSet<K, C>::count(const K& k) const
+{
+  return contains(k);
+}
+
+template<typename K, typename C>
+const K*
+FlatSet<K, C>::lower_bound(const K& k) const
+{
+  return flat_bound<false>(keys_.begin(), keys_.size(), k, comp_);
+}
+
+template<typename K, typename C>
+const K*
+FlatSet<K, C>::upper_bound(const K& k) const
+{
+  return flat_bound<true>(keys_.begin(), keys_.size(), k, comp_);
+}
+
+template<typename K, typename C>
+const Array<K>&
+FlatSet<K, C>::keys() const
+{
+  return keys_;
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatSet mutators
+
+template<typename K, typename C>
+void
+FlatSet<K, C>::reserve(size_t n)
+{
+  keys_.reserve(n);
+}
+
+template<typename K, typename C>
+void
+FlatSet<K, C>::shrink_to_fit()
+{
+  keys_.shrink_to_fit();
+}
+
+template<typename K, typename C>
+std::pair<const K*, bool>
+FlatSet<K, C>::insert(const K& k)
+{
+  const K* p = lower_bound(k);
+  if (p != end() && !comp_(k, *p))
+    return {p, false};
+  return {keys_.insert(p, &k, &k + 1), true};
+}
+
+template<typename K, typename C>
+std::pair<const K*, bool>
+FlatSet<K, C>::insert(K&& k)
+{
+  const K* p = lower_bound(k);
+  if (p != end() && !comp_(k, *p))
+    return {p, false};
+  return {keys_.insert(p, std::make_move_iterator(&k),
+                       std::make_move_iterator(&k + 1)), true};
+}
+
+template<typename K, typename C>
+template<typename I, typename>
+void
+FlatSet<K, C>::insert(I first, I last)
+{
+  size_t from = keys_.size();
+  keys_.append(first, last);
+  settle(from);
+}
+
+template<typename K, typename C>
+size_t
+FlatSet<K, C>::erase(const K& k)
+{
+  const K* p = find(k);
+  if (p == end())
+    return 0;
+  erase(p);
+  return 1;
+}
+
+template<typename K, typename C>
+const K*
+FlatSet<K, C>::erase(const K* pos)
+{
+  assert(pos >= begin() && pos < end());
+
+  return keys_.erase(pos, pos + 1);
+}
+
+template<typename K, typename C>
+void
+FlatSet<K, C>::clear()
+{
+  keys_.clear();
+}
+
+template<typename K, typename C>
+void
+FlatSet<K, C>::release()
+{
+  keys_.release();
+}
+
+template<typename K, typename C>
+void
+FlatSet<K, C>::swap(FlatSet<K, C>& s)
+{
+  keys_.swap(s.keys_);
+  std::swap(comp_, s.comp_);
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatSet bonus
+
+template<typename K, typename C>
+const K*
+FlatSet<K, C>::begin() const
+{
+  return keys_.begin();
+}
+
+template<typename K, typename C>
+const K*
+FlatSet<K, C>::end() const
+{
+  return keys_.end();
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatMap declaration
+
+// A map kept as two parallel Arrays, the sorted keys and their values.
+// A lookup searches only the keys, so it touches a few cache lines of
+// keys however big the values are, and iteration walks both arrays in
+// order. Inserting and erasing behave as in FlatSet. A range of pairs
+// is sorted and merged in one go; of repeated keys the first one
+// wins, and a key already in the map keeps its value, as with
+// std::map::insert.
+//
+//   FlatMap<std::string, int> m {{"b", 2}, {"a", 1}};
+//   m["c"] = 3;
+//   if (int* v = m.get("a"))
+//     ++*v;
+//   for (auto [k, v] : m)  // k is const K&, v is V&
+//     v *= 2;
+
+template<typename K, typename V, typename C = std::less<K>>
+class FlatMap
+{
+
+public:
+  template<bool Const>
+  class Iterator;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+  using value_type = std::pair<K, V>;
+  using reference = std::pair<const K&, V&>;
+  using const_reference = std::pair<const K&, const V&>;
+
+  // constructors
+  FlatMap(const C& comp = C());
+  FlatMap(std::initializer_list<value_type> l, const C& comp = C());
+  template<typename I,
+           typename = typename std::iterator_traits<I>::iterator_category>
+  FlatMap(I first, I last, const C& comp = C());
+
+  // operators
+  V& operator[](const K& k);
+
+  // accessors
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+  const V* get(const K& k) const;
+  V* get(const K& k);
+  const_iterator find(const K& k) const;
+  iterator find(const K& k);
+  bool contains(const K& k) const;
+  size_t count(const K& k) const;
+  const_iterator lower_bound(const K& k) const;
+  const_iterator upper_bound(const K& k) const;
+  const Array<K>& keys() const;
+  const K& key(size_t i) const;
+  const V& value(size_t i) const;
+  V& value(size_t i);
+
+  // mutators
+  void reserve(size_t n);
+  void shrink_to_fit();
+  template<typename... Args>
+  std::pair<iterator, bool> emplace(const K& k, Args&&... args);
+  std::pair<iterator, bool> insert(const value_type& kv);
+  std::pair<iterator, bool> insert(value_type&& kv);
+  template<typename I,
+           typename = typename std::iterator_traits<I>::iterator_category>
+  void insert(I first, I last);
+  size_t erase(const K& k);
+  iterator erase(const_iterator pos);
+  void clear();
+  void release();
+  void swap(FlatMap<K, V, C>& m);
+
+  // bonus
+  const_iterator begin() const;
+  const_iterator end() const;
+  iterator begin();
+  iterator end();
+
+private:
+  Array<K> keys_;   // sorted, no two equal
+  Array<V> values_; // values_[i] belongs to keys_[i]
+  C comp_;
+
+  size_t index(const K& k) const;
+};
+
+////////////////////////////////////////////////////////////////////////
+// FlatMap iterator
+
+// Random access over entries, yielding a pair of references into the
+// two arrays. There is no operator->, as the pair is made on the fly;
+// use *it, or key() and value().
+
+template<typename K, typename V, typename C>
+template<bool Const>
+class FlatMap<K, V, C>::Iterator
+{
+
+  using owner = typename std::conditional<Const, const FlatMap<K, V, C>,
+                                          FlatMap<K, V, C>>::type;
+  using value_ref = typename std::conditional<Const, const V&, V&>::type;
+
+public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = std::pair<K, V>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = std::pair<const K&, value_ref>;
+
+  Iterator() : m_(nullptr), i_(0) {}
+  Iterator(owner* m, size_t i) : m_(m), i_(i) {}
+  operator Iterator<true>() const { return Iterator<true>(m_, i_); }
+
+  reference operator*() const { return reference(key(), value()); }
+  reference operator[](difference_type d) const { return *(*this + d); }
+  const K& key() const { return m_->keys_.begin()[i_]; }
+  value_ref value() const { return m_->values_.begin()[i_]; }
+  size_t index() const { return i_; }
+
+  Iterator& operator++() { ++i_; return *this; }
+  Iterator& operator--() { --i_; return *this; }
+  Iterator operator++(int) { Iterator t = *this; ++i_; return t; }
+  Iterator operator--(int) { Iterator t = *this; --i_; return t; }
+  Iterator& operator+=(difference_type d) { i_ += d; return *this; }
+  Iterator& operator-=(difference_type d) { i_ -= d; return *this; }
+  Iterator operator+(difference_type d) const { return Iterator(m_, i_ + d); }
+  Iterator operator-(difference_type d) const { return Iterator(m_, i_ - d); }
+  friend Iterator operator+(difference_type d, const Iterator& it)
+  {
+    return it + d;
+  }
+  difference_type operator-(const Iterator& it) const
+  {
+    return (difference_type)i_ - (difference_type)it.i_;
+  }
+
+  bool operator==(const Iterator& it) const { return i_ == it.i_; }
+  bool operator!=(const Iterator& it) const { return i_ != it.i_; }
+  bool operator<(const Iterator& it) const { return i_ < it.i_; }
+  bool operator>(const Iterator& it) const { return i_ > it.i_; }
+  bool operator<=(const Iterator& it) const { return i_ <= it.i_; }
+  bool operator>=(const Iterator& it) const { return i_ >= it.i_; }
+
+private:
+  owner* m_;
+  size_t i_;
+};
+
+////////////////////////////////////////////////////////////////////////
+// FlatMap helpers
+
+// the position of k, or size() if it is not there
+template<typename K, typename V, typename C>
+size_t
+FlatMap<K, V, C>::index(const K& k) const
+{
+  const K* b = keys_.begin();
+  const K* p = flat_bound<false>(b, keys_.size(), k, comp_);
+  return p != keys_.end() && !comp_(k, *p) ? p - b : size();
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatMap constructors
+
+template<typename K, typename V, typename C>
+FlatMap<K, V, C>::FlatMap(const C& comp)
+  : keys_(), values_(), comp_(comp)
+{
+}
+
+template<typename K, typename V, typename C>
+FlatMap<K, V, C>::FlatMap(std::initializer_list<value_type> l,
+                          const C& comp)
+  : keys_(), values_(), comp_(comp)
+{
+  insert(l.begin(), l.end());
+}
+
+template<typename K, typename V, typename C>
+template<typename I, typename>
+FlatMap<K, V, C>::FlatMap(I first, I last, const C& comp)
+  : keys_(), values_(), comp_(comp)
+{
+  insert(first, last);
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatMap operators
+
+template<typename K, typename V, typename C>
+V&
+FlatMap<K, V, C>::operator[](const K& k)
+{
+  return emplace(k).first.value();
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatMap accessors
+
+template<typename K, typename V, typename C>
+size_t
+FlatMap<K, V, C>::size() const
+{
+  return keys_.size();
+}
+
+template<typename K, typename V, typename C>
+size_t
+FlatMap<K, V, C>::capacity() const
+{
+  return keys_.capacity();
+}
+
+template<typename K, typename V, typename C>
+bool
+FlatMap<K, V, C>::empty() const
+{
+  return keys_.empty();
+}
+
+// the value of k, or null
+template<typename K, typename V, typename C>
+const V*
+FlatMap<K, V, C>::get(const K& k) const
+{
+  size_t i = index(k);
+  return i < size() ? values_.begin() + i : nullptr;
+}
+
+template<typename K, typename V, typename C>
+V*
+FlatMap<K, V, C>::get(const K& k)
+{
+  size_t i = index(k);
+  return i < size() ? values_.begin() + i : nullptr;
+}
+
+template<typename K, typename V, typename C>
+typename FlatMap<K, V, C>::const_iterator
+FlatMap<K, V, C>::find(const K& k) const
+{
+  return const_iterator(this, index(k));
+}
+
+template<typename K, typename V, typename C>
+typename FlatMap<K, V, C>::iterator
+FlatMap<K, V, C>::find(const K& k)
+{
+  return iterator(this, index(k));
+}
+
+template<typename K, typename V, typename C>
+bool
+FlatMap<K, V, C>::contains(const K& k) const
+{
+  return index(k) < size();
+}
+
+template<typename K, typename V, typename C>
+size_t
+FlatMap<K, V, C>::count(const K& k) const
+{
+  return contains(k);
+}
+
+template<typename K, typename V, typename C>
+typename FlatMap<K, V, C>::const_iterator
+FlatMap<K, V, C>::lower_bound(const K& k) const
+{
+  const K* b = keys_.begin();
+  return const_iterator(this,
+                        flat_bound<false>(b, keys_.size(), k, comp_) - b);
+}
+
+template<typename K, typename V, typename C>
+typename FlatMap<K, V, C>::const_iterator
+FlatMap<K, V, C>::upper_bound(const K& k) const
+{
+  const K* b = keys_.begin();
+  return const_iterator(this,
+                        flat_bound<true>(b, keys_.size(), k, comp_) - b);
+}
+
+template<typename K, typename V, typename C>
+const Array<K>&
+FlatMap<K, V, C>::keys() const
+{
+  return keys_;
+}
+
+template<typename K, typename V, typename C>
+const K&
+FlatMap<K, V, C>::key(size_t i) const
+{
+  assert(i < size());
+
+  return keys_.begin()[i];
+}
+
+template<typename K, typename V, typename C>
+const V&
+FlatMap<K, V, C>::value(size_t i) const
+{
+  assert(i < size());
+
+  return values_.begin()[i];
+}
+
+template<typename K, typename V, typename C>
+V&
+FlatMap<K, V, C>::value(size_t i)
+{
+  assert(i < size());
+
+  return values_.begin()[i];
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatMap mutators
+
+template<typename K, typename V, typename C>
+void
+FlatMap<K, V, C>::reserve(size_t n)
+{
+  keys_.reserve(n);
+  values_.reserve(n);
+}
+
+template<typename K, typename V, typename C>
+void
+FlatMap<K, V, C>::shrink_to_fit()
+{
+  keys_.shrink_to_fit();
+  values_.shrink_to_fit();
+}
+
+// Builds a value from args only when k is new. The value is built
+// before anything moves, and the key is taken back out if the value
+// cannot be placed.
+template<typename K, typename V, typename C>
+template<typename... Args>
+std::pair<typename FlatMap<K, V, C>::iterator, bool>
+FlatMap<K, V, C>::emplace(const K& k, Args&&... args)
+{
+  const K* b = keys_.begin();
+  const K* p = flat_bound<false>(b, keys_.size(), k, comp_);
+  size_t i = p - b;
+  if (p != keys_.end() && !comp_(k, *p))
+    return {iterator(this, i), false};
+
+  V v(std::forward<Args>(args)...);
+  keys_.insert(p, &k, &k + 1);
+  try {
+    values_.insert(values_.begin() + i, std::make_move_iterator(&v),
+                   std::make_move_iterator(&v + 1));
+  } catch (...) {
+    keys_.erase(keys_.begin() + i, keys_.begin() + i + 1);
+    throw;
+  }
+  return {iterator(this, i), true};
+}
+
+template<typename K, typename V, typename C>
+std::pair<typename FlatMap<K, V, C>::iterator, bool>
+FlatMap<K, V, C>::insert(const value_type& kv)
+{
+  return emplace(kv.first, kv.second);
+}
+
+template<typename K, typename V, typename C>
+std::pair<typename FlatMap<K, V, C>::iterator, bool>
+FlatMap<K, V, C>::insert(value_type&& kv)
+{
+  return emplace(kv.first, std::move(kv.second));
+}
+
+// The new pairs are sorted aside, by key and stably, then merged with
+// the entries already here into fresh arrays in one pass.
+template<typename K, typename V, typename C>
+template<typename I, typename>
+void
+FlatMap<K, V, C>::insert(I first, I last)
+{
+  Array<value_type> in;
+  in.append(first, last);
+  if (in.empty())
+    return;
+  std::stable_sort(in.begin(), in.end(),
+                   [this](const value_type& a, const value_type& b) {
+                     return comp_(a.first, b.first);
+                   });
+
+  size_t n = size() + in.size();
+  Array<K> keys;
+  Array<V> values;
+  keys.reserve(n);
+  values.reserve(n);
+
+  size_t i = 0;
+  value_type* q = in.begin();
+  value_type* e = in.end();
+  while (i < size() || q != e) {
+    bool old = q == e || (i < size() && !comp_(q->first, keys_[i]));
+    if (old) {
+      while (q != e && !comp_(keys_[i], q->first))
+        ++q; // the same key; ours stays
+      keys.push_back(std::move(keys_[i]));
+      values.push_back(std::move(values_[i]));
+      ++i;
+    } else {
+      keys.push_back(std::move(q->first));
+      values.push_back(std::move(q->second));
+      for (++q; q != e && !comp_(keys.back(), q->first); ++q)
+        ; // repeats of the key just taken
+    }
+  }
+  keys_.swap(keys);
+  values_.swap(values);
+}
+
+template<typename K, typename V, typename C>
+size_t
+FlatMap<K, V, C>::erase(const K& k)
+{
+  size_t i = index(k);
+  if (i == size())
+    return 0;
+  erase(const_iterator(this, i));
+  return 1;
+}
+
+template<typename K, typename V, typename C>
+typename FlatMap<K, V, C>::iterator
+FlatMap<K, V, C>::erase(const_iterator pos)
+{
+  size_t i = pos.index();
+  assert(i < size());
+
+  keys_.erase(keys_.begin() + i, keys_.begin() + i + 1);
+  values_.erase(values_.begin() + i, values_.begin() + i + 1);
+  return iterator(this, i);
+}
+
+template<typename K, typename V, typename C>
+void
+FlatMap<K, V, C>::clear()
+{
+  keys_.clear();
+  values_.clear();
+}
+
+template<typename K, typename V, typename C>
+void
+FlatMap<K, V, C>::release()
+{
+  keys_.release();
+  values_.release();
+}
+
+template<typename K, typename V, typename C>
+void
+FlatMap<K, V, C>::swap(FlatMap<K, V, C>& m)
+{
+  keys_.swap(m.keys_);
+  values_.swap(m.values_);
+  std::swap(comp_, m.comp_);
+}
+
+////////////////////////////////////////////////////////////////////////
+// FlatMap bonus
+
+template<typename K, typename V, typename C>
+typename FlatMap<K, V, C>::const_iterator
+FlatMap<K, V, C>::begin() const
+{
+  return const_iterator(this, 0);
+}
+
+template<typename K, typename V, typename C>
+typename FlatMap<K, V, C>::const_iterator
+FlatMap<K, V, C>::end() const
+{
+  return const_iterator(this, size());
+}
+
+template<typename K, typename V, typename C>
+typename FlatMap<K, V, C>::iterator
+FlatMap<K, V, C>::begin()
+{
+  return iterator(this, 0);
+}
+
+template<typename K, typename V, typename C>
+typename FlatMap<K, V, C>::iterator
+FlatMap<K, V, C>::end()
+{
+  return iterator(this, size());
+}
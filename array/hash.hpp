@@ -0,0 +1,754 @@
+// file: array/hash.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <cstdint>
+#include <functional>       // std::hash, std::equal_to
+#include <initializer_list>
+#include <iterator>         // std::forward_iterator_tag
+#include <string>
+#include <string_view>
+#include <tuple>            // std::forward_as_tuple
+#include <utility>          // std::pair, std::piecewise_construct
+
+#include "simd.hpp"
+
+#define HASH_GROUP 16 // control bytes matched at once
+#define HASH_EMPTY ((int8_t)-128)
+#define HASH_DELETED ((int8_t)-2)
+
+////////////////////////////////////////////////////////////////////////
+// hashing
+
+// The default hasher. Strings hash through std::string_view, so a map
+// keyed by std::string can be searched with a string_view or a literal
+// without building a string.
+
+template<typename K>
+struct HashOf : std::hash<K>
+{
+};
+
+template<>
+struct HashOf<std::string>
+{
+  using is_transparent = void;
+
+  size_t operator()(std::string_view s) const
+  {
+    return std::hash<std::string_view>()(s);
+  }
+};
+
+// std::hash is often the identity, which would put all of a run of
+// integers in one group; the map spreads whatever H gives over all 64
+// bits first.
+inline uint64_t
+hash_mix(uint64_t h)
+{
+  h *= 0x9e3779b97f4a7c15ull;
+  return h ^ (h >> 32);
+}
+
+////////////////////////////////////////////////////////////////////////
+// groups
+
+// Every slot has a control byte: HASH_EMPTY, HASH_DELETED, or the low 7
+// bits of the hash of the key in it, which leaves the sign bit for
+// "no key here". A group is HASH_GROUP control bytes from any position,
+// and a match is a mask with bit k set for byte k of the group. On x86
+// a whole group is one SSE2 compare and movemask; SSE2 is part of every
+// x86-64, so there is nothing to dispatch.
+
+// bytes equal to c
+inline uint32_t
+hash_match(const int8_t* g, int8_t c)
+{
+#if SIMD_X86
+  typedef char V __attribute__((vector_size(HASH_GROUP)));
+  V v;
+  std::memcpy(&v, g, sizeof(v));
+  return __builtin_ia32_pmovmskb128((V)(v == (V {} + (char)c)));
+#else
+  uint32_t m = 0;
+  for (size_t k = 0; k < HASH_GROUP; ++k)
+    m |= (uint32_t)(g[k] == c) << k;
+  return m;
+#endif
+}
+
+// bytes that hold no key, empty or deleted
+inline uint32_t
+hash_free(const int8_t* g)
+{
+#if SIMD_X86
+  typedef char V __attribute__((vector_size(HASH_GROUP)));
+  V v;
+  std::memcpy(&v, g, sizeof(v));
+  return __builtin_ia32_pmovmskb128(v);
+#else
+  uint32_t m = 0;
+  for (size_t k = 0; k < HASH_GROUP; ++k)
+    m |= (uint32_t)(g[k] < 0) << k;
+  return m;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////
+// declaration
+
+// An open-addressing hash map in the style of Google's Swiss tables.
+// Keys and values sit in one Array of slots, and a parallel Array of
+// control bytes says which slots are taken and by roughly what. A
+// lookup hashes once, uses the high bits to pick where to start and the
+// low 7 bits to match a whole group of control bytes at a time; only
+// the slots that match are compared, so most lookups compare one key
+// and touch two cache lines. Groups are probed quadratically.
+//
+// The table is a power of two of at least HASH_GROUP slots, at most 7/8
+// taken, or nothing at all until the first insertion. Erasing leaves a
+// tombstone, which a later insert may reuse; when an insert finds no
+// room, the table is rebuilt, twice the size if it is at least half
+// full and the same size otherwise, which sweeps the tombstones out. A
+// rebuild moves the elements and invalidates iterators and pointers to
+// them; nothing else does.
+//
+// Lookups take any Q that H and E take, so with the default hasher
+//
+//   HashMap<std::string, int> m;
+//   m.emplace("dup", 1);
+//   std::string_view w = next_word();
+//   if (int* v = m.get(w))  // no std::string built
+//     ...
+//
+// Iteration is in no particular order.
+
+template <typename K,
+          typename V,
+          typename H = HashOf<K>,
+          typename E = std::equal_to<>>
+class HashMap
+{
+
+public:
+  template<bool Const>
+  class Iterator;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+  using value_type = std::pair<K, V>;
+  using reference = std::pair<const K&, V&>;
+  using const_reference = std::pair<const K&, const V&>;
+
+  // constructors
+  HashMap(const H& hash = H(), const E& eq = E());
+  HashMap(size_t n, const H& hash = H(), const E& eq = E());
+  HashMap(std::initializer_list<value_type> l);
+
+  // operators
+  template<typename Q>
+  V& operator[](Q&& k);
+
+  // accessors
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+  template<typename Q>
+  const V* get(const Q& k) const;
+  template<typename Q>
+  V* get(const Q& k);
+  template<typename Q>
+  const_iterator find(const Q& k) const;
+  template<typename Q>
+  iterator find(const Q& k);
+  template<typename Q>
+  bool contains(const Q& k) const;
+  template<typename Q>
+  size_t count(const Q& k) const;
+
+  // mutators
+  void reserve(size_t n);
+  template<typename Q, typename... Args>
+  std::pair<iterator, bool> emplace(Q&& k, Args&&... args);
+  std::pair<iterator, bool> insert(const value_type& kv);
+  std::pair<iterator, bool> insert(value_type&& kv);
+  template<typename Q>
+  size_t erase(const Q& k);
+  void erase(const_iterator pos);
+  void erase(iterator pos);
+  void clear();
+  void release();
+  void swap(HashMap<K, V, H, E>& m);
+
+  // bonus
+  ~HashMap();
+  HashMap(const HashMap<K, V, H, E>& m);
+  HashMap(HashMap<K, V, H, E>&& m) noexcept;
+  HashMap<K, V, H, E>& operator=(const HashMap<K, V, H, E>& m);
+  HashMap<K, V, H, E>& operator=(HashMap<K, V, H, E>&& m) noexcept;
+  const_iterator begin() const;
+  const_iterator end() const;
+  iterator begin();
+  iterator end();
+
+private:
+  // room for one element, built only while its control byte is full
+  struct Slot
+  {
+    alignas(value_type) unsigned char raw[sizeof(value_type)];
+  };
+
+  // sized exactly, and not at all until the first insertion
+  template<typename T>
+  using storage = Array<T, std::allocator<T>, SesquiGrowth<0>>;
+
+  storage<int8_t> ctrl_; // capacity + HASH_GROUP; the last group mirrors
+                         // the first, so a group can start anywhere
+  storage<Slot> slots_;  // capacity, a power of two or zero
+  size_t size_;          // full slots
+  size_t room_;          // empty slots that may still be filled
+  H hash_;
+  E eq_;
+
+  value_type& at(size_t i);
+  const value_type& at(size_t i) const;
+  size_t mask() const;
+  void mark(size_t i, int8_t c);
+  template<typename Q>
+  uint64_t hash(const Q& k) const;
+  template<typename Q>
+  size_t index(const Q& k) const;
+  template<typename Q>
+  size_t index(const Q& k, uint64_t h) const;
+  size_t vacancy(uint64_t h) const;
+  void rebuild(size_t c);
+  void destroy();
+};
+
+////////////////////////////////////////////////////////////////////////
+// iterator
+
+// Forward over the full slots, yielding a pair of references to the
+// key and value, as FlatMap's does.
+
+template<typename K, typename V, typename H, typename E>
+template<bool Const>
+class HashMap<K, V, H, E>::Iterator
+{
+
+  using owner = typename std::conditional<Const, const HashMap<K, V, H, E>,
+                                          HashMap<K, V, H, E>>::type;
+  using value_ref = typename std::conditional<Const, const V&, V&>::type;
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = std::pair<K, V>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = std::pair<const K&, value_ref>;
+
+  Iterator() : m_(nullptr), i_(0) {}
+  Iterator(owner* m, size_t i) : m_(m), i_(i) { skip(); }
+  operator Iterator<true>() const { return Iterator<true>(m_, i_); }
+
+  reference operator*() const { return reference(key(), value()); }
+  const K& key() const { return m_->at(i_).first; }
+  value_ref value() const { return m_->at(i_).second; }
+  size_t index() const { return i_; }
+
+  Iterator& operator++()
+  {
+    ++i_;
+    skip();
+    return *this;
+  }
+
+  Iterator operator++(int)
+  {
+    Iterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+
+  bool operator==(const Iterator& it) const { return i_ == it.i_; }
+  bool operator!=(const Iterator& it) const { return i_ != it.i_; }
+
+private:
+  // on to the next full slot, a group at a time
+  void skip()
+  {
+    size_t c = m_->capacity();
+    while (i_ < c) {
+      uint32_t taken = ~hash_free(m_->ctrl_.begin() + i_) & 0xffff;
+      if (taken) {
+        i_ += __builtin_ctz(taken);
+        if (i_ > c)
+          i_ = c; // past the end, in the mirror
+        return;
+      }
+      i_ += HASH_GROUP;
+    }
+    i_ = c;
+  }
+
+  owner* m_;
+  size_t i_;
+};
+
+////////////////////////////////////////////////////////////////////////
+// slots
+
+template<typename K, typename V, typename H, typename E>
+typename HashMap<K, V, H, E>::value_type&
+HashMap<K, V, H, E>::at(size_t i)
+{
+  return *reinterpret_cast<value_type*>(slots_.begin()[i].raw);
+}
+
+template<typename K, typename V, typename H, typename E>
+const typename HashMap<K, V, H, E>::value_type&
+HashMap<K, V, H, E>::at(size_t i) const
+{
+  return *reinterpret_cast<const value_type*>(slots_.begin()[i].raw);
+}
+
+template<typename K, typename V, typename H, typename E>
+size_t
+HashMap<K, V, H, E>::mask() const
+{
+  return slots_.size() - 1;
+}
+
+// set the control byte of slot i, and its mirror
+template<typename K, typename V, typename H, typename E>
+void
+HashMap<K, V, H, E>::mark(size_t i, int8_t c)
+{
+  int8_t* g = ctrl_.begin();
+  g[i] = c;
+  if (i < HASH_GROUP)
+    g[slots_.size() + i] = c;
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+uint64_t
+HashMap<K, V, H, E>::hash(const Q& k) const
+{
+  return hash_mix(hash_(k));
+}
+
+// the slot holding k, or capacity() if there is none
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+size_t
+HashMap<K, V, H, E>::index(const Q& k) const
+{
+  return size_ ? index(k, hash(k)) : capacity();
+}
+
+// the same, for a k that hashes to h
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+size_t
+HashMap<K, V, H, E>::index(const Q& k, uint64_t h) const
+{
+  if (size_ == 0)
+    return capacity();
+
+  int8_t tag = h & 0x7f;
+  const int8_t* g = ctrl_.begin();
+  size_t i = (h >> 7) & mask();
+  for (size_t step = HASH_GROUP; ; step += HASH_GROUP) {
+    for (uint32_t m = hash_match(g + i, tag); m; m &= m - 1) {
+      size_t j = (i + __builtin_ctz(m)) & mask();
+      if (eq_(at(j).first, k))
+        return j;
+    }
+    if (hash_match(g + i, HASH_EMPTY))
+      return capacity();
+    i = (i + step) & mask();
+  }
+}
+
+// the first slot without a key along the probe sequence of h; there
+// always is one, as the table is never full
+template<typename K, typename V, typename H, typename E>
+size_t
+HashMap<K, V, H, E>::vacancy(uint64_t h) const
+{
+  const int8_t* g = ctrl_.begin();
+  size_t i = (h >> 7) & mask();
+  for (size_t step = HASH_GROUP; ; step += HASH_GROUP) {
+    if (uint32_t m = hash_free(g + i))
+      return (i + __builtin_ctz(m)) & mask();
+    i = (i + step) & mask();
+  }
+}
+
+// Move everything into a fresh table of c slots.
+template<typename K, typename V, typename H, typename E>
+void
+HashMap<K, V, H, E>::rebuild(size_t c)
+{
+  assert(c >= HASH_GROUP && (c & (c - 1)) == 0);
+
+  HashMap<K, V, H, E> t(hash_, eq_);
+  t.ctrl_.resize(c + HASH_GROUP);
+  std::memset(t.ctrl_.begin(), HASH_EMPTY, c + HASH_GROUP);
+  t.slots_.resize(c);
+  t.room_ = c - c / 8;
+
+  const int8_t* g = ctrl_.begin();
+  for (size_t i = 0; i < capacity(); ++i) {
+    if (g[i] < 0)
+      continue;
+    value_type& kv = at(i);
+    uint64_t h = t.hash(kv.first);
+    size_t j = t.vacancy(h);
+    new (t.slots_.begin()[j].raw) value_type(std::move(kv));
+    t.mark(j, h & 0x7f);
+    ++t.size_;
+    --t.room_;
+  }
+  swap(t);
+}
+
+template<typename K, typename V, typename H, typename E>
+void
+HashMap<K, V, H, E>::destroy()
+{
+  if constexpr (!std::is_trivially_destructible<value_type>::value) {
+    const int8_t* g = ctrl_.begin();
+    for (size_t i = 0; i < capacity(); ++i)
+      if (g[i] >= 0)
+        at(i).~value_type();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// constructors
+
+template<typename K, typename V, typename H, typename E>
+HashMap<K, V, H, E>::HashMap(const H& hash, const E& eq)
+  : ctrl_(), slots_(), size_(0), room_(0), hash_(hash), eq_(eq)
+{
+}
+
+template<typename K, typename V, typename H, typename E>
+HashMap<K, V, H, E>::HashMap(size_t n, const H& hash, const E& eq)
+  : HashMap(hash, eq)
+{
+  if (n)
+    reserve(n); // copies of empty maps allocate nothing either
+}
+
+template<typename K, typename V, typename H, typename E>
+HashMap<K, V, H, E>::HashMap(std::initializer_list<value_type> l)
+  : HashMap(l.size())
+{
+  for (const value_type& kv : l)
+    insert(kv);
+}
+
+////////////////////////////////////////////////////////////////////////
+// operators
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+V&
+HashMap<K, V, H, E>::operator[](Q&& k)
+{
+  return emplace(std::forward<Q>(k)).first.value();
+}
+
+////////////////////////////////////////////////////////////////////////
+// accessors
+
+template<typename K, typename V, typename H, typename E>
+size_t
+HashMap<K, V, H, E>::size() const
+{
+  return size_;
+}
+
+template<typename K, typename V, typename H, typename E>
+size_t
+HashMap<K, V, H, E>::capacity() const
+{
+  return slots_.size();
+}
+
+template<typename K, typename V, typename H, typename E>
+bool
+HashMap<K, V, H, E>::empty() const
+{
+  return size_ == 0;
+}
+
+// the value of k, or null
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+const V*
+HashMap<K, V, H, E>::get(const Q& k) const
+{
+  size_t i = index(k);
+  return i < capacity() ? &at(i).second : nullptr;
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+V*
+HashMap<K, V, H, E>::get(const Q& k)
+{
+  size_t i = index(k);
+  return i < capacity() ? &at(i).second : nullptr;
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+typename HashMap<K, V, H, E>::const_iterator
+HashMap<K, V, H, E>::find(const Q& k) const
+{
+  return const_iterator(this, index(k));
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+typename HashMap<K, V, H, E>::iterator
+HashMap<K, V, H, E>::find(const Q& k)
+{
+  return iterator(this, index(k));
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+bool
+HashMap<K, V, H, E>::contains(const Q& k) const
+{
+  return index(k) < capacity();
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+size_t
+HashMap<K, V, H, E>::count(const Q& k) const
+{
+  return contains(k);
+}
+
+////////////////////////////////////////////////////////////////////////
+// mutators
+
+// room for n elements without a rebuild
+template<typename K, typename V, typename H, typename E>
+void
+HashMap<K, V, H, E>::reserve(size_t n)
+{
+  size_t c = pow2(n + n / 7 + 1);
+  if (c < HASH_GROUP)
+    c = HASH_GROUP;
+  if (c > capacity())
+    rebuild(c);
+}
+
+// Builds a key from k and a value from args only when k is new. A slot
+// left by an erase is taken if the probe comes to one first; an empty
+// slot is only taken while there is room, otherwise the table is
+// rebuilt and probed again.
+template<typename K, typename V, typename H, typename E>
+template<typename Q, typename... Args>
+std::pair<typename HashMap<K, V, H, E>::iterator, bool>
+HashMap<K, V, H, E>::emplace(Q&& k, Args&&... args)
+{
+  uint64_t h = hash(k);
+  size_t i = index(k, h);
+  if (i < capacity())
+    return {iterator(this, i), false};
+
+  if (room_ == 0 &&
+      (capacity() == 0 || ctrl_.begin()[vacancy(h)] == HASH_EMPTY)) {
+    // built aside first, since k or args may refer into the table
+    value_type kv(std::piecewise_construct,
+                  std::forward_as_tuple(std::forward<Q>(k)),
+                  std::forward_as_tuple(std::forward<Args>(args)...));
+    size_t c = capacity();
+    rebuild(size_ < c / 2 ? c : c ? 2 * c : HASH_GROUP);
+    i = vacancy(h);
+    new (slots_.begin()[i].raw) value_type(std::move(kv));
+  } else {
+    i = vacancy(h);
+    new (slots_.begin()[i].raw)
+      value_type(std::piecewise_construct,
+                 std::forward_as_tuple(std::forward<Q>(k)),
+                 std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+  if (ctrl_.begin()[i] == HASH_EMPTY)
+    --room_;
+  mark(i, h & 0x7f);
+  ++size_;
+  return {iterator(this, i), true};
+}
+
+template<typename K, typename V, typename H, typename E>
+std::pair<typename HashMap<K, V, H, E>::iterator, bool>
+HashMap<K, V, H, E>::insert(const value_type& kv)
+{
+  return emplace(kv.first, kv.second);
+}
+
+template<typename K, typename V, typename H, typename E>
+std::pair<typename HashMap<K, V, H, E>::iterator, bool>
+HashMap<K, V, H, E>::insert(value_type&& kv)
+{
+  return emplace(std::move(kv.first), std::move(kv.second));
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+size_t
+HashMap<K, V, H, E>::erase(const Q& k)
+{
+  size_t i = index(k);
+  if (i == capacity())
+    return 0;
+  erase(const_iterator(this, i));
+  return 1;
+}
+
+// leaves a tombstone, so probes for other keys still pass through
+template<typename K, typename V, typename H, typename E>
+void
+HashMap<K, V, H, E>::erase(const_iterator pos)
+{
+  size_t i = pos.index();
+  assert(i < capacity() && ctrl_.begin()[i] >= 0);
+
+  at(i).~value_type();
+  mark(i, HASH_DELETED);
+  --size_;
+}
+
+template<typename K, typename V, typename H, typename E>
+void
+HashMap<K, V, H, E>::erase(iterator pos)
+{
+  erase(const_iterator(pos));
+}
+
+// keeps the capacity
+template<typename K, typename V, typename H, typename E>
+void
+HashMap<K, V, H, E>::clear()
+{
+  destroy();
+  if (capacity())
+    std::memset(ctrl_.begin(), HASH_EMPTY, ctrl_.size());
+  size_ = 0;
+  room_ = capacity() - capacity() / 8;
+}
+
+template<typename K, typename V, typename H, typename E>
+void
+HashMap<K, V, H, E>::release()
+{
+  HashMap<K, V, H, E> t(hash_, eq_);
+  swap(t);
+}
+
+template<typename K, typename V, typename H, typename E>
+void
+HashMap<K, V, H, E>::swap(HashMap<K, V, H, E>& m)
+{
+  ctrl_.swap(m.ctrl_);
+  slots_.swap(m.slots_);
+  std::swap(size_, m.size_);
+  std::swap(room_, m.room_);
+  std::swap(hash_, m.hash_);
+  std::swap(eq_, m.eq_);
+}
+
+////////////////////////////////////////////////////////////////////////
+// bonus
+
+//// rule of five
+
+// destructor
+template<typename K, typename V, typename H, typename E>
+HashMap<K, V, H, E>::~HashMap()
+{
+  destroy();
+}
+
+// copy constructor
+template<typename K, typename V, typename H, typename E>
+HashMap<K, V, H, E>::HashMap(const HashMap<K, V, H, E>& m)
+  : HashMap(m.size(), m.hash_, m.eq_)
+{
+  for (auto kv : m)
+    emplace(kv.first, kv.second);
+}
+
+// move constructor; m is left with no table, as if just constructed
+template<typename K, typename V, typename H, typename E>
+HashMap<K, V, H, E>::HashMap(HashMap<K, V, H, E>&& m) noexcept
+  : ctrl_(std::move(m.ctrl_)), slots_(std::move(m.slots_)),
+    size_(m.size_), room_(m.room_), hash_(m.hash_), eq_(m.eq_)
+{
+  m.size_ = 0;
+  m.room_ = 0;
+}
+
+// copy assignment
+template<typename K, typename V, typename H, typename E>
+HashMap<K, V, H, E>&
+HashMap<K, V, H, E>::operator=(const HashMap<K, V, H, E>& m)
+{
+  HashMap<K, V, H, E> tmp(m);
+  swap(tmp);
+  return *this;
+}
+
+// move assignment
+template<typename K, typename V, typename H, typename E>
+HashMap<K, V, H, E>&
+HashMap<K, V, H, E>::operator=(HashMap<K, V, H, E>&& m) noexcept
+{
+  swap(m);
+  return *this;
+}
+
+//// iterators
+
+template<typename K, typename V, typename H, typename E>
+typename HashMap<K, V, H, E>::const_iterator
+HashMap<K, V, H, E>::begin() const
+{
+  return const_iterator(this, 0);
+}
+
+template<typename K, typename V, typename H, typename E>
+typename HashMap<K, V, H, E>::const_iterator
+HashMap<K, V, H, E>::end() const
+{
+  return const_iterator(this, capacity());
+}
+
+template<typename K, typename V, typename H, typename E>
+typename HashMap<K, V, H, E>::iterator
+HashMap<K, V, H, E>::begin()
+{
+  return iterator(this, 0);
+}
+
+template<typename K, typename V, typename H, typename E>
+typename HashMap<K, V, H, E>::iterator
+HashMap<K, V, H, E>::end()
+{
+  return iterator(this, capacity());
+}
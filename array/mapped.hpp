@@ -0,0 +1,450 @@
+// file: array/mapped.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap, mremap, msync, munmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close, ftruncate
+
+#include "array.hpp"
+
+#define MAPPED_MAGIC "arraymap"
+#define MAPPED_VERSION 1
+
+////////////////////////////////////////////////////////////////////////
+// file layout
+
+// A MappedArray file is this header followed by capacity elements, of
+// which the first size are live. The header is one cache line, so the
+// elements that follow are aligned for any T that needs at most that.
+
+struct MappedHeader
+{
+  char magic[8];    // MAPPED_MAGIC, unterminated
+  uint32_t version; // MAPPED_VERSION
+  uint32_t unit;    // sizeof(T)
+  uint64_t size;    // live elements
+  char pad[40];
+};
+
+static_assert(sizeof(MappedHeader) == 64, "MappedHeader is one line");
+
+////////////////////////////////////////////////////////////////////////
+// declaration
+
+// An Array of trivially copyable T that lives in a shared mapping of a
+// file rather than on the heap. Opening an existing file maps it as it
+// is, with nothing parsed or copied; pages come in from the page cache
+// on first touch, so datasets larger than memory work and processes
+// mapping the same file share one copy. Growth extends the file with
+// ftruncate and the mapping with mremap.
+
+template <typename T, typename G = Pow2Growth<>>
+class MappedArray
+{
+
+  static_assert(std::is_trivially_copyable<T>::value,
+                "MappedArray holds raw bytes");
+  static_assert(alignof(T) <= sizeof(MappedHeader),
+                "MappedArray cannot align T");
+
+public:
+  // constructors
+  MappedArray(const char* path);
+  MappedArray(const char* path, size_t n);
+
+  // operators
+  T operator[](size_t i) const;
+  T& operator[](size_t i);
+
+  // accessors
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+  T back() const;
+  T front() const;
+  T& back();
+  T& front();
+
+  // mutators
+  void reserve(size_t n);
+  void resize(size_t n);
+  void shrink_to_fit();
+  void push_back(const T& v);
+  template<typename... Args>
+  T& emplace_back(Args&&... args);
+  void pop_back();
+  void clear();
+  void release();
+  void append(const T* p, size_t n);
+  void sync();
+
+  // bonus
+  ~MappedArray();
+  MappedArray(const MappedArray<T, G>&) = delete;
+  MappedArray(MappedArray<T, G>&& a) noexcept;
+  MappedArray<T, G>& operator=(const MappedArray<T, G>&) = delete;
+  MappedArray<T, G>& operator=(MappedArray<T, G>&& a) noexcept;
+  T const* begin() const;
+  T const* end() const;
+  T* begin();
+  T* end();
+
+private:
+  int fd_;
+  MappedHeader* head_; // start of the mapping
+  T* array_;           // right after head_
+  size_t capacity_;    // elements the file has room for
+
+  static size_t bytes(size_t c);
+  void map(size_t c);
+  [[noreturn]] static void fail(const char* what);
+};
+
+////////////////////////////////////////////////////////////////////////
+// mapping
+
+template<typename T, typename G>
+size_t
+MappedArray<T, G>::bytes(size_t c)
+{
+  return sizeof(MappedHeader) + c * sizeof(T);
+}
+
+template<typename T, typename G>
+void
+MappedArray<T, G>::fail(const char* what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Resize the file to c elements and the mapping with it.
+template<typename T, typename G>
+void
+MappedArray<T, G>::map(size_t c)
+{
+  if (ftruncate(fd_, bytes(c)) != 0)
+    fail("MappedArray: ftruncate");
+
+  void* p;
+  if (!head_) {
+    p = mmap(nullptr, bytes(c), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  } else {
+#ifdef __linux__
+    p = mremap(head_, bytes(capacity_), bytes(c), MREMAP_MAYMOVE);
+#else
+    munmap(head_, bytes(capacity_));
+    p = mmap(nullptr, bytes(c), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+#endif
+  }
+  if (p == MAP_FAILED)
+    fail("MappedArray: mmap");
+
+  head_ = static_cast<MappedHeader*>(p);
+  array_ = reinterpret_cast<T*>(head_ + 1);
+  capacity_ = c;
+}
+
+////////////////////////////////////////////////////////////////////////
+// constructors
+
+// Open path, creating an empty array there if it does not exist.
+template<typename T, typename G>
+MappedArray<T, G>::MappedArray(const char* path)
+  : fd_(-1), head_(nullptr), array_(nullptr), capacity_(0)
+{
+  fd_ = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0)
+    fail("MappedArray: open");
+
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    close(fd_);
+    fail("MappedArray: fstat");
+  }
+
+  try {
+    if (st.st_size == 0) {
+      map(G::initial);
+      std::memcpy(head_->magic, MAPPED_MAGIC, sizeof(head_->magic));
+      head_->version = MAPPED_VERSION;
+      head_->unit = sizeof(T);
+      head_->size = 0;
+      return;
+    }
+
+    size_t have = (size_t)st.st_size;
+    if (have < sizeof(MappedHeader)) {
+      errno = EINVAL;
+      fail("MappedArray: truncated header");
+    }
+    capacity_ = (have - sizeof(MappedHeader)) / sizeof(T);
+    void* p = mmap(nullptr, bytes(capacity_), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED)
+      fail("MappedArray: mmap");
+    head_ = static_cast<MappedHeader*>(p);
+    array_ = reinterpret_cast<T*>(head_ + 1);
+
+    if (std::memcmp(head_->magic, MAPPED_MAGIC, sizeof(head_->magic)) != 0 ||
+        head_->version != MAPPED_VERSION || head_->unit != sizeof(T) ||
+        head_->size > capacity_) {
+      errno = EINVAL;
+      fail("MappedArray: not an array of this type");
+    }
+  } catch (...) {
+    if (head_)
+      munmap(head_, bytes(capacity_));
+    close(fd_);
+    throw;
+  }
+}
+
+// Open path and make sure it has room for n elements.
+template<typename T, typename G>
+MappedArray<T, G>::MappedArray(const char* path, size_t n)
+  : MappedArray(path)
+{
+  reserve(n);
+}
+
+////////////////////////////////////////////////////////////////////////
+// operators
+
+template<typename T, typename G>
+T
+MappedArray<T, G>::operator[](size_t i) const
+{
+  assert(i < head_->size);
+
+  return array_[i];
+}
+
+template<typename T, typename G>
+T&
+MappedArray<T, G>::operator[](size_t i)
+{
+  assert(i < head_->size);
+
+  return array_[i];
+}
+
+////////////////////////////////////////////////////////////////////////
+// accessors
+
+template<typename T, typename G>
+size_t
+MappedArray<T, G>::size() const
+{
+  return head_->size;
+}
+
+template<typename T, typename G>
+size_t
+MappedArray<T, G>::capacity() const
+{
+  return capacity_;
+}
+
+template<typename T, typename G>
+bool
+MappedArray<T, G>::empty() const
+{
+  return head_->size == 0;
+}
+
+template<typename T, typename G>
+T
+MappedArray<T, G>::back() const
+{
+  return array_[head_->size - 1];
+}
+
+template<typename T, typename G>
+T
+MappedArray<T, G>::front() const
+{
+  return array_[0];
+}
+
+template<typename T, typename G>
+T&
+MappedArray<T, G>::back()
+{
+  return array_[head_->size - 1];
+}
+
+template<typename T, typename G>
+T&
+MappedArray<T, G>::front()
+{
+  return array_[0];
+}
+
+////////////////////////////////////////////////////////////////////////
+// mutators
+
+template<typename T, typename G>
+void
+MappedArray<T, G>::reserve(size_t n)
+{
+  if (n > capacity_)
+    map(G::grow(capacity_, n, sizeof(T)));
+}
+
+// New elements are zero, which is what ftruncate leaves in the file.
+template<typename T, typename G>
+void
+MappedArray<T, G>::resize(size_t n)
+{
+  reserve(n);
+  if (n > head_->size)
+    std::memset(array_ + head_->size, 0, (n - head_->size) * sizeof(T));
+  head_->size = n;
+}
+
+template<typename T, typename G>
+void
+MappedArray<T, G>::shrink_to_fit()
+{
+  if (head_->size != capacity_)
+    map(head_->size);
+}
+
+template<typename T, typename G>
+void
+MappedArray<T, G>::push_back(const T& v)
+{
+  emplace_back(v);
+}
+
+template<typename T, typename G>
+template<typename... Args>
+T&
+MappedArray<T, G>::emplace_back(Args&&... args)
+{
+  T v(std::forward<Args>(args)...); // args may live in the mapping
+  reserve(head_->size + 1);
+  array_[head_->size] = v;
+  return array_[head_->size++];
+}
+
+template<typename T, typename G>
+void
+MappedArray<T, G>::pop_back()
+{
+  --head_->size;
+}
+
+// The file keeps its length; the stale elements are simply past size().
+template<typename T, typename G>
+void
+MappedArray<T, G>::clear()
+{
+  head_->size = 0;
+}
+
+// clear() and truncate the file down to its header.
+template<typename T, typename G>
+void
+MappedArray<T, G>::release()
+{
+  clear();
+  shrink_to_fit();
+}
+
+template<typename T, typename G>
+void
+MappedArray<T, G>::append(const T* p, size_t n)
+{
+  assert(p + n <= array_ || p >= array_ + capacity_);
+
+  reserve(head_->size + n);
+  if (n)
+    std::memcpy(array_ + head_->size, p, n * sizeof(T));
+  head_->size += n;
+}
+
+// Write dirty pages back now rather than whenever the kernel gets to it.
+template<typename T, typename G>
+void
+MappedArray<T, G>::sync()
+{
+  if (msync(head_, bytes(capacity_), MS_SYNC) != 0)
+    fail("MappedArray: msync");
+}
+
+////////////////////////////////////////////////////////////////////////
+// bonus
+
+//// rule of five
+
+// destructor
+template<typename T, typename G>
+MappedArray<T, G>::~MappedArray()
+{
+  if (head_)
+    munmap(head_, bytes(capacity_));
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+// move constructor
+template<typename T, typename G>
+MappedArray<T, G>::MappedArray(MappedArray<T, G>&& a) noexcept
+  : fd_(a.fd_), head_(a.head_), array_(a.array_), capacity_(a.capacity_)
+{
+  a.fd_ = -1;
+  a.head_ = nullptr;
+  a.array_ = nullptr;
+  a.capacity_ = 0;
+}
+
+// move assignment
+template<typename T, typename G>
+MappedArray<T, G>&
+MappedArray<T, G>::operator=(MappedArray<T, G>&& a) noexcept
+{
+  std::swap(fd_, a.fd_);
+  std::swap(head_, a.head_);
+  std::swap(array_, a.array_);
+  std::swap(capacity_, a.capacity_);
+  return *this;
+}
+
+//// iterators
+
+template<typename T, typename G>
+T const*
+MappedArray<T, G>::begin() const {
+  return array_;
+}
+
+template<typename T, typename G>
+T const*
+MappedArray<T, G>::end() const {
+  return array_ + head_->size;
+}
+
+template<typename T, typename G>
+T*
+MappedArray<T, G>::begin() {
+  return array_;
+}
+
+template<typename T, typename G>
+T*
+MappedArray<T, G>::end() {
+  return array_ + head_->size;
+}
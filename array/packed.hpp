@@ -0,0 +1,625 @@
+// file: array/packed.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <cstdint>
+
+#include "simd.hpp"
+
+#define PACKED_CHUNK 1024 // values decoded at a time when repacking
+#define DELTA_BLOCK 128   // values per DeltaArray block
+
+////////////////////////////////////////////////////////////////////////
+// bits
+
+// Value i of a stream packed w bits each, lowest bits first, starts at
+// bit i * w and may run into the next word. Streams always end with a
+// spare word, so the next word can be read without asking whether the
+// value needs it; whatever comes from it past w bits is masked off.
+
+inline unsigned
+packed_width(uint64_t v)
+{
+  return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+inline uint64_t
+packed_mask(unsigned w)
+{
+  return w ? ~(uint64_t)0 >> (64 - w) : 0;
+}
+
+// words for n values of w bits, the spare one included
+inline size_t
+packed_words(size_t n, unsigned w)
+{
+  return (n * w + 63) / 64 + 1;
+}
+
+inline uint64_t
+packed_get(const uint64_t* in, size_t i, unsigned w)
+{
+  size_t bit = i * w;
+  size_t lo = bit / 64;
+  unsigned off = bit % 64;
+  uint64_t v = (in[lo] >> off) | ((in[lo + 1] << 1) << (63 - off));
+  return v & packed_mask(w);
+}
+
+// v must fit in w bits
+inline void
+packed_set(uint64_t* out, size_t i, unsigned w, uint64_t v)
+{
+  size_t bit = i * w;
+  size_t lo = bit / 64;
+  unsigned off = bit % 64;
+  uint64_t m = packed_mask(w);
+  out[lo] = (out[lo] & ~(m << off)) | (v << off);
+  if (off + w > 64) {
+    unsigned hi = 64 - off;
+    out[lo + 1] = (out[lo + 1] & ~(m >> hi)) | (v >> hi);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// kernel
+
+// out[k] = value first + k of in, for k < n, with w at least 1. A
+// vector of lanes works out its bit positions together, fetches the
+// two words each lane straddles, and shifts and masks them all at once.
+
+struct UnpackKernel
+{
+  using type = uint64_t;
+
+  template<size_t B>
+  static SIMD_INLINE int run(const uint64_t* in, size_t first, size_t n,
+                             unsigned w, uint64_t* out)
+  {
+    using V = typename Vec<uint64_t, B>::type;
+    constexpr size_t W = Vec<uint64_t, B>::lanes;
+
+    size_t i = 0;
+    if constexpr (W > 1) {
+      V bit {}, a {}, b {};
+      for (size_t k = 0; k < W; ++k)
+        bit[k] = (first + k) * w;
+      V step = V {} + W * w;
+      V m = V {} + packed_mask(w);
+      for (; i + W <= n; i += W) {
+        V lo = bit >> 6;
+        V off = bit & 63;
+        for (size_t k = 0; k < W; ++k) {
+          a[k] = in[lo[k]];
+          b[k] = in[lo[k] + 1];
+        }
+        V v = ((a >> off) | ((b << 1) << (63 - off))) & m;
+        vstore(out + i, v);
+        bit += step;
+      }
+    }
+    for (; i < n; ++i)
+      out[i] = packed_get(in, first + i, w);
+    return 0;
+  }
+};
+
+// out[k] = value first + k of in, for k < n
+inline void
+packed_decode(const uint64_t* in, size_t first, size_t n, unsigned w,
+              uint64_t* out)
+{
+  if (w == 0)
+    std::memset(out, 0, n * sizeof(uint64_t));
+  else
+    simd<UnpackKernel>(in, first, n, w, out);
+}
+
+////////////////////////////////////////////////////////////////////////
+// PackedArray declaration
+
+// An array of unsigned integers stored w bits each, back to back, for
+// columns whose values are all small: ids under a million take 20 bits
+// instead of 64. The width only grows. Pushing or setting a value that
+// does not fit repacks everything at the new width, which happens at
+// most 64 times, so building from a range with the narrowest width that
+// fits it is cheaper. decode() unpacks runs of values with the kernels
+// in simd.hpp; operator[] unpacks one with two loads and a shift.
+
+class PackedArray
+{
+
+public:
+  // constructors
+  explicit PackedArray(unsigned w = 0);
+  PackedArray(const uint64_t* p, size_t n);
+
+  // operators
+  uint64_t operator[](size_t i) const;
+
+  // accessors
+  size_t size() const;
+  bool empty() const;
+  unsigned width() const;
+  size_t bytes() const;
+  void decode(size_t first, size_t n, uint64_t* out) const;
+  Array<uint64_t> unpack() const;
+
+  // mutators
+  void set(size_t i, uint64_t v);
+  void push_back(uint64_t v);
+  void append(const uint64_t* p, size_t n);
+  void reserve(size_t n);
+  void resize(size_t n);
+  void widen(unsigned w);
+  void shrink_to_fit();
+  void clear();
+  void release();
+  void swap(PackedArray& a);
+
+private:
+  Array<uint64_t> words_; // packed_words(size_, width_) at least
+  size_t size_;
+  unsigned width_;
+};
+
+////////////////////////////////////////////////////////////////////////
+// PackedArray constructors
+
+inline
+PackedArray::PackedArray(unsigned w)
+  : words_(), size_(0), width_(w)
+{
+  assert(w <= 64);
+
+  words_.resize(1);
+}
+
+inline
+PackedArray::PackedArray(const uint64_t* p, size_t n)
+  : PackedArray()
+{
+  uint64_t any = 0;
+  for (size_t i = 0; i < n; ++i)
+    any |= p[i];
+  width_ = packed_width(any);
+  append(p, n);
+}
+
+////////////////////////////////////////////////////////////////////////
+// PackedArray operators
+
+inline uint64_t
+PackedArray::operator[](size_t i) const
+{
+  assert(i < size_);
+
+  return width_ ? packed_get(words_.begin(), i, width_) : 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+// PackedArray accessors
+
+inline size_t
+PackedArray::size() const
+{
+  return size_;
+}
+
+inline bool
+PackedArray::empty() const
+{
+  return size_ == 0;
+}
+
+inline unsigned
+PackedArray::width() const
+{
+  return width_;
+}
+
+inline size_t
+PackedArray::bytes() const
+{
+  return words_.capacity() * sizeof(uint64_t);
+}
+
+inline void
+PackedArray::decode(size_t first, size_t n, uint64_t* out) const
+{
+  assert(first + n <= size_);
+
+  packed_decode(words_.begin(), first, n, width_, out);
+}
+
+inline Array<uint64_t>
+PackedArray::unpack() const
+{
+  Array<uint64_t> a;
+  a.resize(size_);
+  decode(0, size_, a.begin());
+  return a;
+}
+
+////////////////////////////////////////////////////////////////////////
+// PackedArray mutators
+
+inline void
+PackedArray::set(size_t i, uint64_t v)
+{
+  assert(i < size_);
+
+  if (packed_width(v) > width_)
+    widen(packed_width(v));
+  packed_set(words_.begin(), i, width_, v);
+}
+
+inline void
+PackedArray::push_back(uint64_t v)
+{
+  if (packed_width(v) > width_)
+    widen(packed_width(v));
+  size_t need = packed_words(size_ + 1, width_);
+  if (need > words_.size())
+    words_.resize(need);
+  packed_set(words_.begin(), size_++, width_, v);
+}
+
+inline void
+PackedArray::append(const uint64_t* p, size_t n)
+{
+  uint64_t any = 0;
+  for (size_t i = 0; i < n; ++i)
+    any |= p[i];
+  if (packed_width(any) > width_)
+    widen(packed_width(any));
+
+  words_.resize(packed_words(size_ + n, width_));
+  if (width_)
+    for (size_t i = 0; i < n; ++i)
+      packed_set(words_.begin(), size_ + i, width_, p[i]);
+  size_ += n;
+}
+
+inline void
+PackedArray::reserve(size_t n)
+{
+  words_.reserve(packed_words(n, width_));
+}
+
+// new values are zero
+inline void
+PackedArray::resize(size_t n)
+{
+  if (n < size_ && width_) {
+    // zero what is cut off, so growing again reads zeros
+    size_t bit = n * width_;
+    uint64_t* w = words_.begin();
+    w[bit / 64] &= packed_mask(bit % 64);
+    std::memset(w + bit / 64 + 1, 0,
+                (words_.size() - bit / 64 - 1) * sizeof(uint64_t));
+  }
+  words_.resize(packed_words(n, width_));
+  size_ = n;
+}
+
+// Repack at width w, a chunk of values at a time.
+inline void
+PackedArray::widen(unsigned w)
+{
+  assert(w <= 64);
+
+  if (w <= width_)
+    return;
+  PackedArray a(w);
+  a.words_.resize(packed_words(size_, w));
+  uint64_t buf[PACKED_CHUNK];
+  for (size_t i = 0; i < size_; i += PACKED_CHUNK) {
+    size_t n = size_ - i < PACKED_CHUNK ? size_ - i : PACKED_CHUNK;
+    decode(i, n, buf);
+    for (size_t k = 0; k < n; ++k)
+      packed_set(a.words_.begin(), i + k, w, buf[k]);
+  }
+  a.size_ = size_;
+  swap(a);
+}
+
+inline void
+PackedArray::shrink_to_fit()
+{
+  words_.shrink_to_fit();
+}
+
+// keeps the width
+inline void
+PackedArray::clear()
+{
+  words_.clear();
+  words_.resize(1);
+  size_ = 0;
+}
+
+inline void
+PackedArray::release()
+{
+  words_.release();
+  words_.resize(1);
+  size_ = 0;
+}
+
+inline void
+PackedArray::swap(PackedArray& a)
+{
+  words_.swap(a.words_);
+  std::swap(size_, a.size_);
+  std::swap(width_, a.width_);
+}
+
+////////////////////////////////////////////////////////////////////////
+// DeltaArray declaration
+
+// An append-only array of unsigned integers for sorted or slowly
+// changing columns such as offsets and ids. Values go in blocks of
+// DELTA_BLOCK: a block keeps its first value, the smallest step between
+// neighbours, and each step's excess over that, bit-packed as narrow as
+// the block allows. A run of ids that mostly go up by one packs to a
+// bit or two per value. Each block also records where its bits start,
+// so operator[] jumps straight to the block and unpacks and sums at
+// most DELTA_BLOCK - 1 steps; decode() unpacks whole blocks and is the
+// way to scan. The last, unfinished block is kept plain until it fills
+// up.
+//
+// Steps wrap around 2^64, so any sequence works; it just packs poorly
+// if it jumps about.
+
+class DeltaArray
+{
+
+public:
+  // constructors
+  DeltaArray();
+  DeltaArray(const uint64_t* p, size_t n);
+
+  // operators
+  uint64_t operator[](size_t i) const;
+
+  // accessors
+  size_t size() const;
+  bool empty() const;
+  size_t bytes() const;
+  void decode(size_t first, size_t n, uint64_t* out) const;
+  Array<uint64_t> unpack() const;
+
+  // mutators
+  void push_back(uint64_t v);
+  void append(const uint64_t* p, size_t n);
+  void shrink_to_fit();
+  void clear();
+  void release();
+  void swap(DeltaArray& a);
+
+private:
+  struct Block
+  {
+    uint64_t base;  // first value
+    uint64_t step;  // smallest step, as a wrapping difference
+    uint64_t at;    // first word of the excesses in words_
+    uint64_t width; // bits per excess
+  };
+
+  Array<Block> blocks_;   // all full
+  Array<uint64_t> words_; // excesses of every block, then a spare word
+  Array<uint64_t> tail_;  // values after the last block, plain
+  size_t size_;
+
+  void seal();
+  void expand(size_t b, uint64_t* out) const;
+};
+
+////////////////////////////////////////////////////////////////////////
+// DeltaArray blocks
+
+// Pack the full tail into a new block. The steps are compared as signed
+// numbers, so a block that goes down as well as up still takes the
+// width of its spread.
+inline void
+DeltaArray::seal()
+{
+  assert(tail_.size() == DELTA_BLOCK);
+
+  const uint64_t* t = tail_.begin();
+  int64_t lo = (int64_t)(t[1] - t[0]);
+  for (size_t j = 2; j < DELTA_BLOCK; ++j)
+    lo = std::min(lo, (int64_t)(t[j] - t[j - 1]));
+  uint64_t any = 0;
+  for (size_t j = 1; j < DELTA_BLOCK; ++j)
+    any |= t[j] - t[j - 1] - (uint64_t)lo;
+
+  Block b {t[0], (uint64_t)lo, words_.size() - 1, packed_width(any)};
+  words_.resize(b.at + packed_words(DELTA_BLOCK - 1, b.width));
+  if (b.width)
+    for (size_t j = 1; j < DELTA_BLOCK; ++j)
+      packed_set(words_.begin() + b.at, j - 1, b.width,
+                 t[j] - t[j - 1] - b.step);
+  blocks_.push_back(b);
+  tail_.clear();
+}
+
+// all DELTA_BLOCK values of block b
+inline void
+DeltaArray::expand(size_t b, uint64_t* out) const
+{
+  const Block& k = blocks_.begin()[b];
+  packed_decode(words_.begin() + k.at, 0, DELTA_BLOCK - 1, k.width,
+                out + 1);
+  uint64_t x = k.base;
+  out[0] = x;
+  for (size_t j = 1; j < DELTA_BLOCK; ++j) {
+    x += k.step + out[j];
+    out[j] = x;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// DeltaArray constructors
+
+inline
+DeltaArray::DeltaArray()
+  : blocks_(), words_(), tail_(), size_(0)
+{
+  words_.resize(1);
+}
+
+inline
+DeltaArray::DeltaArray(const uint64_t* p, size_t n)
+  : DeltaArray()
+{
+  append(p, n);
+}
+
+////////////////////////////////////////////////////////////////////////
+// DeltaArray operators
+
+inline uint64_t
+DeltaArray::operator[](size_t i) const
+{
+  assert(i < size_);
+
+  size_t b = i / DELTA_BLOCK;
+  size_t j = i % DELTA_BLOCK;
+  if (b == blocks_.size())
+    return tail_.begin()[j];
+
+  const Block& k = blocks_.begin()[b];
+  uint64_t x = k.base + j * k.step;
+  if (k.width && j) {
+    uint64_t buf[DELTA_BLOCK];
+    packed_decode(words_.begin() + k.at, 0, j, k.width, buf);
+    x += vsum(buf, j);
+  }
+  return x;
+}
+
+////////////////////////////////////////////////////////////////////////
+// DeltaArray accessors
+
+inline size_t
+DeltaArray::size() const
+{
+  return size_;
+}
+
+inline bool
+DeltaArray::empty() const
+{
+  return size_ == 0;
+}
+
+inline size_t
+DeltaArray::bytes() const
+{
+  return blocks_.capacity() * sizeof(Block) +
+         words_.capacity() * sizeof(uint64_t) +
+         tail_.capacity() * sizeof(uint64_t);
+}
+
+// Blocks wholly inside the range are expanded in place; the ones it
+// only partly covers go through a buffer.
+inline void
+DeltaArray::decode(size_t first, size_t n, uint64_t* out) const
+{
+  assert(first + n <= size_);
+
+  uint64_t buf[DELTA_BLOCK];
+  size_t last = first + n;
+  size_t sealed = blocks_.size() * DELTA_BLOCK;
+  for (size_t i = first; i < last && i < sealed; ) {
+    size_t b = i / DELTA_BLOCK;
+    size_t j = i % DELTA_BLOCK;
+    size_t k = std::min(DELTA_BLOCK - j, last - i);
+    if (k == DELTA_BLOCK) {
+      expand(b, out);
+    } else {
+      expand(b, buf);
+      std::memcpy(out, buf + j, k * sizeof(uint64_t));
+    }
+    out += k;
+    i += k;
+  }
+  if (last > sealed) {
+    size_t from = first > sealed ? first - sealed : 0;
+    std::memcpy(out, tail_.begin() + from,
+                (last - sealed - from) * sizeof(uint64_t));
+  }
+}
+
+inline Array<uint64_t>
+DeltaArray::unpack() const
+{
+  Array<uint64_t> a;
+  a.resize(size_);
+  decode(0, size_, a.begin());
+  return a;
+}
+
+////////////////////////////////////////////////////////////////////////
+// DeltaArray mutators
+
+inline void
+DeltaArray::push_back(uint64_t v)
+{
+  tail_.push_back(v);
+  ++size_;
+  if (tail_.size() == DELTA_BLOCK)
+    seal();
+}
+
+inline void
+DeltaArray::append(const uint64_t* p, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    push_back(p[i]);
+}
+
+inline void
+DeltaArray::shrink_to_fit()
+{
+  blocks_.shrink_to_fit();
+  words_.shrink_to_fit();
+  tail_.shrink_to_fit();
+}
+
+inline void
+DeltaArray::clear()
+{
+  blocks_.clear();
+  words_.clear();
+  words_.resize(1);
+  tail_.clear();
+  size_ = 0;
+}
+
+inline void
+DeltaArray::release()
+{
+  blocks_.release();
+  words_.release();
+  words_.resize(1);
+  tail_.release();
+  size_ = 0;
+}
+
+inline void
+DeltaArray::swap(DeltaArray& a)
+{
+  blocks_.swap(a.blocks_);
+  words_.swap(a.words_);
+  tail_.swap(a.tail_);
+  std::swap(size_, a.size_);
+}
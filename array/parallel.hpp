@@ -0,0 +1,465 @@
+// file: array/parallel.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <algorithm>          // std::sort, std::merge, std::lower_bound
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>           // std::make_move_iterator
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "array.hpp"
+
+#define PARALLEL_PROBE 20000   // ns spent sizing chunks before splitting
+#define PARALLEL_CHUNK 100000  // ns of work aimed for per chunk
+#define PARALLEL_SLACK 8       // chunks per worker, at the least
+
+////////////////////////////////////////////////////////////////////////
+// pool
+
+// A fixed set of workers, each with its own deque of tasks. A worker
+// pushes and pops at the back of its own deque, which keeps recently
+// split, cache-warm work local, and when that runs dry it steals from
+// the front of another's, where the oldest and so largest pieces are.
+// Threads outside the pool push to a deque of their own that every
+// worker steals from.
+
+class ParallelPool
+{
+
+public:
+  using Task = std::function<void()>;
+
+  explicit ParallelPool(size_t n = std::thread::hardware_concurrency());
+  ~ParallelPool();
+  ParallelPool(const ParallelPool&) = delete;
+  ParallelPool& operator=(const ParallelPool&) = delete;
+
+  size_t size() const;
+  void push(Task t);
+  bool help();
+
+private:
+  struct Queue
+  {
+    std::mutex m;
+    std::deque<Task> q;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues_; // workers', then outside
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> pending_;                // tasks queued anywhere
+  std::atomic<bool> stop_;
+  std::mutex sleep_;
+  std::condition_variable wake_;
+
+  static thread_local ParallelPool* self_; // pool this thread works for
+  static thread_local size_t index_;       // its queue in there
+
+  size_t mine() const;
+  bool pop(size_t i, Task& t);
+  bool steal(size_t i, Task& t);
+  void work(size_t i);
+};
+
+inline thread_local ParallelPool* ParallelPool::self_ = nullptr;
+inline thread_local size_t ParallelPool::index_ = 0;
+
+inline
+ParallelPool::ParallelPool(size_t n)
+  : pending_(0), stop_(false)
+{
+  if (n == 0)
+    n = 1;
+  for (size_t i = 0; i <= n; ++i)
+    queues_.emplace_back(new Queue);
+  for (size_t i = 0; i < n; ++i)
+    workers_.emplace_back(&ParallelPool::work, this, i);
+}
+
+inline
+ParallelPool::~ParallelPool()
+{
+  {
+    std::lock_guard<std::mutex> l(sleep_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& w : workers_)
+    w.join();
+}
+
+inline size_t
+ParallelPool::size() const
+{
+  return workers_.size();
+}
+
+inline size_t
+ParallelPool::mine() const
+{
+  return self_ == this ? index_ : workers_.size();
+}
+
+inline void
+ParallelPool::push(Task t)
+{
+  pending_.fetch_add(1, std::memory_order_release);
+  {
+    Queue& q = *queues_[mine()];
+    std::lock_guard<std::mutex> l(q.m);
+    q.q.push_back(std::move(t));
+  }
+  std::lock_guard<std::mutex> l(sleep_);
+  wake_.notify_one();
+}
+
+inline bool
+ParallelPool::pop(size_t i, Task& t)
+{
+  Queue& q = *queues_[i];
+  std::lock_guard<std::mutex> l(q.m);
+  if (q.q.empty())
+    return false;
+  t = std::move(q.q.back());
+  q.q.pop_back();
+  return true;
+}
+
+inline bool
+ParallelPool::steal(size_t i, Task& t)
+{
+  size_t n = queues_.size();
+  for (size_t d = 1; d < n; ++d) {
+    Queue& q = *queues_[(i + d) % n];
+    std::lock_guard<std::mutex> l(q.m);
+    if (!q.q.empty()) {
+      t = std::move(q.q.front());
+      q.q.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+// Run one queued task, if there is any, on the calling thread. Waiting
+// threads call this so that they work rather than block.
+inline bool
+ParallelPool::help()
+{
+  if (pending_.load(std::memory_order_acquire) == 0)
+    return false;
+
+  size_t i = mine();
+  Task t;
+  if (!pop(i, t) && !steal(i, t))
+    return false;
+  pending_.fetch_sub(1, std::memory_order_relaxed);
+  t();
+  return true;
+}
+
+inline void
+ParallelPool::work(size_t i)
+{
+  self_ = this;
+  index_ = i;
+  while (true) {
+    if (help())
+      continue;
+    std::unique_lock<std::mutex> l(sleep_);
+    wake_.wait(l, [this] {
+      return stop_ || pending_.load(std::memory_order_acquire) > 0;
+    });
+    if (stop_)
+      return;
+  }
+}
+
+// the pool the algorithms below use unless given another
+inline ParallelPool&
+parallel_pool()
+{
+  static ParallelPool p;
+  return p;
+}
+
+////////////////////////////////////////////////////////////////////////
+// fork-join
+
+// Tasks run through a ParallelGroup can be waited for together; the first
+// exception any of them throws is rethrown by wait().
+
+class ParallelGroup
+{
+
+public:
+  explicit ParallelGroup(ParallelPool& p) : pool_(p), left_(0) {}
+  ~ParallelGroup() { wait_quietly(); }
+
+  template<typename F>
+  void run(F f)
+  {
+    left_.fetch_add(1, std::memory_order_relaxed);
+    pool_.push([this, f]() mutable {
+      try {
+        f();
+      } catch (...) {
+        std::lock_guard<std::mutex> l(m_);
+        if (!error_)
+          error_ = std::current_exception();
+      }
+      left_.fetch_sub(1, std::memory_order_release);
+    });
+  }
+
+  void wait()
+  {
+    wait_quietly();
+    if (error_)
+      std::rethrow_exception(error_);
+  }
+
+private:
+  ParallelPool& pool_;
+  std::atomic<size_t> left_;
+  std::mutex m_;
+  std::exception_ptr error_;
+
+  void wait_quietly()
+  {
+    while (left_.load(std::memory_order_acquire))
+      if (!pool_.help())
+        std::this_thread::yield();
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+// chunking
+
+// Run body(lo, hi) over growing prefixes of [0, n) until PARALLEL_PROBE
+// ns have gone by, and from the time per element pick a chunk that
+// takes about PARALLEL_CHUNK ns, but no larger than leaves every worker
+// PARALLEL_SLACK chunks. Returns how far the probe got; the chunk size
+// goes to grain.
+template<typename F>
+size_t
+parallel_probe(size_t n, size_t workers, size_t& grain, F& body)
+{
+  using clock = std::chrono::steady_clock;
+
+  size_t done = 0;
+  size_t k = 1;
+  auto t0 = clock::now();
+  double ns = 0;
+  while (done < n) {
+    size_t m = k < n - done ? k : n - done;
+    body(done, done + m);
+    done += m;
+    ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count();
+    if (ns >= PARALLEL_PROBE)
+      break;
+    k *= 2;
+  }
+
+  double each = done ? ns / done : 0;
+  size_t g = each > 0 ? (size_t)(PARALLEL_CHUNK / each) : n;
+  size_t cap = (n - done) / (workers * PARALLEL_SLACK);
+  if (g > cap)
+    g = cap;
+  grain = g ? g : 1;
+  return done;
+}
+
+template<typename F>
+void
+parallel_split(ParallelPool& p, size_t lo, size_t hi, size_t grain, F& body)
+{
+  ParallelGroup g(p);
+  while (hi - lo > grain) {
+    size_t mid = lo + (hi - lo) / 2;
+    g.run([&p, mid, hi, grain, &body] {
+      parallel_split(p, mid, hi, grain, body);
+    });
+    hi = mid;
+  }
+  body(lo, hi);
+  g.wait();
+}
+
+// body(lo, hi) over [0, n), in chunks sized by parallel_probe()
+template<typename F>
+void
+parallel_range(size_t n, F body, ParallelPool& p = parallel_pool())
+{
+  size_t grain;
+  size_t done = parallel_probe(n, p.size(), grain, body);
+  if (done < n)
+    parallel_split(p, done, n, grain, body);
+}
+
+////////////////////////////////////////////////////////////////////////
+// algorithms
+
+// f(x) for every element x
+template<typename T, typename A, typename G, typename F>
+void
+parallel_for(Array<T, A, G>& a, F f, ParallelPool& p = parallel_pool())
+{
+  T* x = a.begin();
+  parallel_range(a.size(), [x, &f](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i)
+      f(x[i]);
+  }, p);
+}
+
+// out[i] = f(in[i]); out is resized to match
+template<typename T, typename A, typename G,
+         typename U, typename B, typename H, typename F>
+void
+parallel_transform(const Array<T, A, G>& in, Array<U, B, H>& out, F f,
+                   ParallelPool& p = parallel_pool())
+{
+  out.resize(in.size());
+  const T* x = in.begin();
+  U* y = out.begin();
+  parallel_range(in.size(), [x, y, &f](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i)
+      y[i] = f(x[i]);
+  }, p);
+}
+
+// init op x0 op x1 op ... for an associative op; chunks are combined in
+// order, so op need not be commutative
+template<typename T, typename A, typename G, typename Op>
+T
+parallel_reduce(const Array<T, A, G>& a, T init, Op op,
+                ParallelPool& p = parallel_pool())
+{
+  const T* x = a.begin();
+  size_t n = a.size();
+  if (n == 0)
+    return init;
+
+  auto serial = [x, &op](size_t lo, size_t hi) {
+    T r = x[lo];
+    for (size_t i = lo + 1; i < hi; ++i)
+      r = op(r, x[i]);
+    return r;
+  };
+
+  std::optional<T> head;
+  size_t grain;
+  auto first = [&head, &serial, &op](size_t lo, size_t hi) {
+    head = head ? op(*head, serial(lo, hi)) : serial(lo, hi);
+  };
+  size_t done = parallel_probe(n, p.size(), grain, first);
+  if (done == n)
+    return op(init, *head);
+
+  std::function<T(size_t, size_t)> reduce = [&](size_t lo, size_t hi) {
+    if (hi - lo <= grain)
+      return serial(lo, hi);
+    size_t mid = lo + (hi - lo) / 2;
+    std::optional<T> right;
+    ParallelGroup g(p);
+    g.run([&] { right = reduce(mid, hi); });
+    T left = reduce(lo, mid);
+    g.wait();
+    return op(left, *right);
+  };
+  return op(op(init, *head), reduce(done, n));
+}
+
+//// sort
+
+// Merge [a0, a1) and [b0, b1) into out, splitting at the middle of the
+// longer run and the matching point of the other until pieces are small.
+// Equal elements from the first run go first.
+template<typename T, typename C>
+void
+parallel_merge(T* a0, T* a1, T* b0, T* b1, T* out, size_t grain, C& cmp,
+               ParallelPool& p)
+{
+  size_t na = a1 - a0;
+  size_t nb = b1 - b0;
+  if (na + nb <= grain) {
+    std::merge(std::make_move_iterator(a0), std::make_move_iterator(a1),
+               std::make_move_iterator(b0), std::make_move_iterator(b1),
+               out, cmp);
+    return;
+  }
+
+  T* am;
+  T* bm;
+  if (na >= nb) {
+    am = a0 + na / 2;
+    bm = std::lower_bound(b0, b1, *am, cmp);
+  } else {
+    bm = b0 + nb / 2;
+    am = std::upper_bound(a0, a1, *bm, cmp);
+  }
+  T* om = out + (am - a0) + (bm - b0);
+
+  ParallelGroup g(p);
+  g.run([=, &cmp, &p] { parallel_merge(am, a1, bm, b1, om, grain, cmp, p); });
+  parallel_merge(a0, am, b0, bm, out, grain, cmp, p);
+  g.wait();
+}
+
+template<typename T, typename C>
+void
+parallel_msort(T* x, T* buf, size_t n, size_t grain, C& cmp, ParallelPool& p)
+{
+  if (n <= grain) {
+    std::sort(x, x + n, cmp);
+    return;
+  }
+
+  size_t h = n / 2;
+  ParallelGroup g(p);
+  g.run([=, &cmp, &p] {
+    parallel_msort(x + h, buf + h, n - h, grain, cmp, p);
+  });
+  parallel_msort(x, buf, h, grain, cmp, p);
+  g.wait();
+
+  parallel_merge(x, x + h, x + h, x + n, buf, grain, cmp, p);
+  parallel_range(n, [x, buf](size_t lo, size_t hi) {
+    std::move(buf + lo, buf + hi, x + lo);
+  }, p);
+}
+
+// Merge sort: chunks are sorted with std::sort, then merged pairwise in
+// parallel through a scratch Array of the same size. T has to be default
+// constructible for the scratch space. With one worker the merging is
+// pure overhead, so the whole array goes to std::sort.
+template<typename T, typename A, typename G, typename C = std::less<T>>
+void
+parallel_sort(Array<T, A, G>& a, C cmp = C(), ParallelPool& p = parallel_pool())
+{
+  size_t n = a.size();
+  size_t grain = n / (p.size() * PARALLEL_SLACK);
+  if (grain < 4096)
+    grain = 4096;
+  if (n <= grain || p.size() < 2) {
+    std::sort(a.begin(), a.end(), cmp);
+    return;
+  }
+
+  Array<T> buf(n);
+  parallel_msort(a.begin(), buf.begin(), n, grain, cmp, p);
+}
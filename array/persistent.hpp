@@ -0,0 +1,755 @@
+// file: array/persistent.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <atomic>
+
+#include "array.hpp"
+
+#define PERSISTENT_BITS 5                         // log2 of the fan-out
+#define PERSISTENT_WIDTH (1 << PERSISTENT_BITS)   // children per node
+#define PERSISTENT_MASK (PERSISTENT_WIDTH - 1)
+
+////////////////////////////////////////////////////////////////////////
+// declaration
+
+// An Array whose copies share their storage. The elements sit in leaves
+// of PERSISTENT_WIDTH, under a radix tree of the same fan-out, and the
+// last leaf, the tail, hangs off the array itself so pushing and
+// popping at the back rarely touch the tree. Every node is reference
+// counted, so copying the array is O(1): the copy, a snapshot, just
+// holds the same root and tail.
+//
+// Writes copy on demand. A node that only this array holds is updated
+// in place; a shared one is copied first, along with the path above
+// it, and the copy replaces it here while the other holders keep the
+// original. So a write costs O(log32 n), and a run of writes after a
+// snapshot copies each path it touches once and then works in place,
+// like a transient batch edit, with nothing to switch on or off.
+//
+// Snapshots may be read from other threads while this array goes on
+// changing, since a writer never touches a shared node. The array
+// object itself, like an Array, is not to be used by two threads at
+// once. A reference from the non-const operator[] (or back(), front())
+// is only good until the next copy is made.
+
+template <typename T>
+class PersistentArray
+{
+
+public:
+  class Iterator;
+  using const_iterator = Iterator;
+
+  // constructors
+  PersistentArray();
+  PersistentArray(size_t n);
+  PersistentArray(size_t n, const T& v);
+
+  // operators
+  const T& operator[](size_t i) const;
+  T& operator[](size_t i);
+
+  // accessors
+  size_t size() const;
+  bool empty() const;
+  const T& back() const;
+  const T& front() const;
+  T& back();
+  T& front();
+  PersistentArray<T> snapshot() const;
+
+  // mutators
+  void set(size_t i, const T& v);
+  void set(size_t i, T&& v);
+  void resize(size_t n);
+  void push_back(const T& v);
+  void push_back(T&& v);
+  template<typename... Args>
+  T& emplace_back(Args&&... args);
+  void pop_back();
+  void clear();
+  void release();
+  void swap(PersistentArray<T>& a);
+  void append(const T* p, size_t n);
+
+  // bonus
+  ~PersistentArray();
+  PersistentArray(const PersistentArray<T>& a);
+  PersistentArray(PersistentArray<T>&& a) noexcept;
+  PersistentArray<T>& operator=(const PersistentArray<T>& a);
+  PersistentArray<T>& operator=(PersistentArray<T>&& a) noexcept;
+  const_iterator begin() const;
+  const_iterator end() const;
+
+private:
+  struct Node
+  {
+    std::atomic<size_t> refs;
+    Node() : refs(1) {}
+  };
+
+  struct Inner : Node
+  {
+    Node* kids[PERSISTENT_WIDTH]; // null past the last one
+    Inner() : kids() {}
+  };
+
+  struct Leaf : Node
+  {
+    alignas(T) unsigned char raw[PERSISTENT_WIDTH * sizeof(T)];
+    T* items() { return reinterpret_cast<T*>(raw); }
+  };
+
+  Node* root_;   // leaves before the tail, or null
+  Leaf* tail_;   // 1 to PERSISTENT_WIDTH elements, null when empty
+  size_t size_;  // elements
+  size_t shift_; // level of root_ times PERSISTENT_BITS; leaves are 0
+
+  // nodes
+  static Inner* inner(Node* n);
+  static Leaf* leaf(Node* n);
+  static Node* share(Node* n);
+  static void drop(Node* n, size_t shift, size_t count);
+  static Node* clone(Node* n, size_t shift, size_t count);
+  static void own(Node*& n, size_t shift, size_t count);
+  static Node* path(size_t shift, Node* l);
+
+  // tree
+  size_t tail_offset() const;
+  size_t tail_size() const;
+  Leaf* leaf_at(size_t i) const;
+  Leaf* own_leaf(size_t i);
+  void push_tail();
+  void pop_tail();
+  Node* pop_from(Node* n, size_t shift, size_t i);
+};
+
+////////////////////////////////////////////////////////////////////////
+// iterator
+
+// Walks a leaf by pointer and looks up the next one at its end.
+
+template<typename T>
+class PersistentArray<T>::Iterator
+{
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const T*;
+  using reference = const T&;
+
+  Iterator(const PersistentArray<T>* a, size_t i)
+    : a_(a), i_(i), p_(nullptr), last_(nullptr)
+  {
+    locate();
+  }
+
+  reference operator*() const { return *p_; }
+  pointer operator->() const { return p_; }
+
+  Iterator& operator++()
+  {
+    ++i_;
+    if (++p_ == last_)
+      locate();
+    return *this;
+  }
+
+  Iterator operator++(int)
+  {
+    Iterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+
+  bool operator==(const Iterator& it) const { return i_ == it.i_; }
+  bool operator!=(const Iterator& it) const { return i_ != it.i_; }
+
+private:
+  void locate()
+  {
+    if (i_ >= a_->size_)
+      return;
+    T* l = a_->leaf_at(i_)->items();
+    p_ = l + (i_ & PERSISTENT_MASK);
+    last_ = l + PERSISTENT_WIDTH;
+  }
+
+  const PersistentArray<T>* a_;
+  size_t i_;     // index
+  pointer p_;    // element i_
+  pointer last_; // end of its leaf
+};
+
+////////////////////////////////////////////////////////////////////////
+// nodes
+
+template<typename T>
+typename PersistentArray<T>::Inner*
+PersistentArray<T>::inner(Node* n)
+{
+  return static_cast<Inner*>(n);
+}
+
+template<typename T>
+typename PersistentArray<T>::Leaf*
+PersistentArray<T>::leaf(Node* n)
+{
+  return static_cast<Leaf*>(n);
+}
+
+template<typename T>
+typename PersistentArray<T>::Node*
+PersistentArray<T>::share(Node* n)
+{
+  if (n)
+    n->refs.fetch_add(1, std::memory_order_relaxed);
+  return n;
+}
+
+// Let go of n, and free it with whatever only it held if this was the
+// last hold. A leaf holds count elements; leaves below an inner node are
+// always full.
+template<typename T>
+void
+PersistentArray<T>::drop(Node* n, size_t shift, size_t count)
+{
+  if (!n || n->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+
+  if (shift == 0) {
+    T* p = leaf(n)->items();
+    for (size_t k = 0; k < count; ++k)
+      p[k].~T();
+    delete leaf(n);
+    return;
+  }
+  Inner* in = inner(n);
+  for (size_t k = 0; k < PERSISTENT_WIDTH && in->kids[k]; ++k)
+    drop(in->kids[k], shift - PERSISTENT_BITS, PERSISTENT_WIDTH);
+  delete in;
+}
+
+// an unshared copy of n; the children of an inner node gain a holder
+template<typename T>
+typename PersistentArray<T>::Node*
+PersistentArray<T>::clone(Node* n, size_t shift, size_t count)
+{
+  if (shift) {
+    Inner* c = new Inner;
+    for (size_t k = 0; k < PERSISTENT_WIDTH; ++k)
+      c->kids[k] = share(inner(n)->kids[k]);
+    return c;
+  }
+
+  Leaf* c = new Leaf;
+  T* from = leaf(n)->items();
+  T* to = c->items();
+  size_t k = 0;
+  try {
+    for (; k < count; ++k)
+      new (to + k) T(from[k]);
+  } catch (...) {
+    while (k)
+      to[--k].~T();
+    delete c;
+    throw;
+  }
+  return c;
+}
+
+// Make n one that only this array holds, copying it if it is shared.
+// The acquire pairs with the release in drop(), so whatever the last
+// other holder did with n is done before n is written here.
+template<typename T>
+void
+PersistentArray<T>::own(Node*& n, size_t shift, size_t count)
+{
+  if (n->refs.load(std::memory_order_acquire) == 1)
+    return;
+  Node* c = clone(n, shift, count);
+  drop(n, shift, count);
+  n = c;
+}
+
+// a chain of single-child inner nodes from level shift down to leaf l
+template<typename T>
+typename PersistentArray<T>::Node*
+PersistentArray<T>::path(size_t shift, Node* l)
+{
+  if (shift == 0)
+    return l;
+  Inner* in = new Inner;
+  try {
+    in->kids[0] = path(shift - PERSISTENT_BITS, l);
+  } catch (...) {
+    delete in;
+    throw;
+  }
+  return in;
+}
+
+////////////////////////////////////////////////////////////////////////
+// tree
+
+// index of the first element in the tail
+template<typename T>
+size_t
+PersistentArray<T>::tail_offset() const
+{
+  return size_ ? (size_ - 1) & ~(size_t)PERSISTENT_MASK : 0;
+}
+
+template<typename T>
+size_t
+PersistentArray<T>::tail_size() const
+{
+  return size_ - tail_offset();
+}
+
+template<typename T>
+typename PersistentArray<T>::Leaf*
+PersistentArray<T>::leaf_at(size_t i) const
+{
+  if (i >= tail_offset())
+    return tail_;
+
+  Node* n = root_;
+  for (size_t s = shift_; s > 0; s -= PERSISTENT_BITS)
+    n = inner(n)->kids[(i >> s) & PERSISTENT_MASK];
+  return leaf(n);
+}
+
+// the leaf of element i, owned along with every node above it
+template<typename T>
+typename PersistentArray<T>::Leaf*
+PersistentArray<T>::own_leaf(size_t i)
+{
+  if (i >= tail_offset()) {
+    Node* t = tail_;
+    own(t, 0, tail_size());
+    tail_ = leaf(t);
+    return tail_;
+  }
+
+  own(root_, shift_, PERSISTENT_WIDTH);
+  Node* n = root_;
+  for (size_t s = shift_; s > 0; s -= PERSISTENT_BITS) {
+    Node*& k = inner(n)->kids[(i >> s) & PERSISTENT_MASK];
+    own(k, s - PERSISTENT_BITS, PERSISTENT_WIDTH);
+    n = k;
+  }
+  return leaf(n);
+}
+
+// Move the full tail into the tree, adding a level when the tree is
+// full.
+template<typename T>
+void
+PersistentArray<T>::push_tail()
+{
+  size_t i = size_ - PERSISTENT_WIDTH; // index of the tail's first
+
+  if (!root_) {
+    root_ = tail_;
+    shift_ = 0;
+    return;
+  }
+
+  if (i == (size_t)1 << (shift_ + PERSISTENT_BITS)) {
+    Inner* r = new Inner;
+    try {
+      r->kids[1] = path(shift_, tail_);
+    } catch (...) {
+      delete r;
+      throw;
+    }
+    r->kids[0] = root_;
+    root_ = r;
+    shift_ += PERSISTENT_BITS;
+    return;
+  }
+
+  own(root_, shift_, PERSISTENT_WIDTH);
+  Node* n = root_;
+  for (size_t s = shift_; ; s -= PERSISTENT_BITS) {
+    Node*& k = inner(n)->kids[(i >> s) & PERSISTENT_MASK];
+    if (s == PERSISTENT_BITS) {
+      k = tail_;
+      return;
+    }
+    if (!k) {
+      k = path(s - PERSISTENT_BITS, tail_);
+      return;
+    }
+    own(k, s - PERSISTENT_BITS, PERSISTENT_WIDTH);
+    n = k;
+  }
+}
+
+// Take the last leaf out of the tree to be the new tail, dropping
+// levels left with a single child.
+template<typename T>
+void
+PersistentArray<T>::pop_tail()
+{
+  size_t i = size_ - PERSISTENT_WIDTH; // index of the leaf's first
+
+  Node* l = root_;
+  for (size_t s = shift_; s > 0; s -= PERSISTENT_BITS)
+    l = inner(l)->kids[(i >> s) & PERSISTENT_MASK];
+  tail_ = leaf(share(l));
+  if (shift_ == 0) {
+    drop(root_, 0, PERSISTENT_WIDTH);
+    root_ = nullptr;
+    return;
+  }
+
+  root_ = pop_from(root_, shift_, i);
+  assert(root_);
+  while (shift_ > 0 && !inner(root_)->kids[1]) {
+    Node* k = share(inner(root_)->kids[0]);
+    drop(root_, shift_, PERSISTENT_WIDTH);
+    root_ = k;
+    shift_ -= PERSISTENT_BITS;
+  }
+}
+
+// n without its leaf of element i, the last one below it; null if that
+// leaves n empty
+template<typename T>
+typename PersistentArray<T>::Node*
+PersistentArray<T>::pop_from(Node* n, size_t shift, size_t i)
+{
+  own(n, shift, PERSISTENT_WIDTH);
+  size_t j = (i >> shift) & PERSISTENT_MASK;
+  Node*& k = inner(n)->kids[j];
+  if (shift == PERSISTENT_BITS) {
+    drop(k, 0, PERSISTENT_WIDTH);
+    k = nullptr;
+  } else {
+    k = pop_from(k, shift - PERSISTENT_BITS, i);
+  }
+
+  if (j == 0 && !k) {
+    drop(n, shift, PERSISTENT_WIDTH);
+    return nullptr;
+  }
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////
+// constructors
+
+template<typename T>
+PersistentArray<T>::PersistentArray()
+  : root_(nullptr), tail_(nullptr), size_(0), shift_(0)
+{
+}
+
+template<typename T>
+PersistentArray<T>::PersistentArray(size_t n)
+  : PersistentArray()
+{
+  resize(n);
+}
+
+template<typename T>
+PersistentArray<T>::PersistentArray(size_t n, const T& v)
+  : PersistentArray()
+{
+  for (size_t i = 0; i < n; ++i)
+    push_back(v);
+}
+
+////////////////////////////////////////////////////////////////////////
+// operators
+
+template<typename T>
+const T&
+PersistentArray<T>::operator[](size_t i) const
+{
+  assert(i < size_);
+
+  return leaf_at(i)->items()[i & PERSISTENT_MASK];
+}
+
+template<typename T>
+T&
+PersistentArray<T>::operator[](size_t i)
+{
+  assert(i < size_);
+
+  return own_leaf(i)->items()[i & PERSISTENT_MASK];
+}
+
+////////////////////////////////////////////////////////////////////////
+// accessors
+
+template<typename T>
+size_t
+PersistentArray<T>::size() const
+{
+  return size_;
+}
+
+template<typename T>
+bool
+PersistentArray<T>::empty() const
+{
+  return size_ == 0;
+}
+
+template<typename T>
+const T&
+PersistentArray<T>::back() const
+{
+  assert(size_ > 0);
+
+  return tail_->items()[tail_size() - 1];
+}
+
+template<typename T>
+const T&
+PersistentArray<T>::front() const
+{
+  return (*this)[0];
+}
+
+template<typename T>
+T&
+PersistentArray<T>::back()
+{
+  return (*this)[size_ - 1];
+}
+
+template<typename T>
+T&
+PersistentArray<T>::front()
+{
+  return (*this)[0];
+}
+
+// same as a copy, named for what it is used for
+template<typename T>
+PersistentArray<T>
+PersistentArray<T>::snapshot() const
+{
+  return *this;
+}
+
+////////////////////////////////////////////////////////////////////////
+// mutators
+
+template<typename T>
+void
+PersistentArray<T>::set(size_t i, const T& v)
+{
+  (*this)[i] = v;
+}
+
+template<typename T>
+void
+PersistentArray<T>::set(size_t i, T&& v)
+{
+  (*this)[i] = std::move(v);
+}
+
+template<typename T>
+void
+PersistentArray<T>::resize(size_t n)
+{
+  while (size_ > n)
+    pop_back();
+  while (size_ < n)
+    emplace_back();
+}
+
+template<typename T>
+void
+PersistentArray<T>::push_back(const T& v)
+{
+  emplace_back(v);
+}
+
+template<typename T>
+void
+PersistentArray<T>::push_back(T&& v)
+{
+  emplace_back(std::move(v));
+}
+
+// With room in the tail, the element goes there. Otherwise it is built
+// in a fresh leaf before the full tail moves into the tree, so args may
+// refer to elements of this array.
+template<typename T>
+template<typename... Args>
+T&
+PersistentArray<T>::emplace_back(Args&&... args)
+{
+  if (tail_ && tail_size() < PERSISTENT_WIDTH) {
+    size_t t = tail_size();
+    Node* n = tail_;
+    own(n, 0, t);
+    tail_ = leaf(n);
+    T* p = tail_->items() + t;
+    new (p) T(std::forward<Args>(args)...);
+    ++size_;
+    return *p;
+  }
+
+  Leaf* l = new Leaf;
+  try {
+    new (l->items()) T(std::forward<Args>(args)...);
+  } catch (...) {
+    delete l;
+    throw;
+  }
+  if (tail_) {
+    try {
+      push_tail();
+    } catch (...) {
+      drop(l, 0, 1);
+      throw;
+    }
+  }
+  tail_ = l;
+  ++size_;
+  return l->items()[0];
+}
+
+template<typename T>
+void
+PersistentArray<T>::pop_back()
+{
+  assert(size_ > 0);
+
+  size_t t = tail_size();
+  if (t > 1) {
+    Node* n = tail_;
+    own(n, 0, t);
+    tail_ = leaf(n);
+    tail_->items()[t - 1].~T();
+    --size_;
+    return;
+  }
+
+  drop(tail_, 0, 1);
+  tail_ = nullptr;
+  if (--size_)
+    pop_tail();
+}
+
+template<typename T>
+void
+PersistentArray<T>::clear()
+{
+  drop(root_, shift_, PERSISTENT_WIDTH);
+  drop(tail_, 0, tail_size());
+  root_ = nullptr;
+  tail_ = nullptr;
+  size_ = 0;
+  shift_ = 0;
+}
+
+// there is no spare capacity to give back, so this is clear()
+template<typename T>
+void
+PersistentArray<T>::release()
+{
+  clear();
+}
+
+template<typename T>
+void
+PersistentArray<T>::swap(PersistentArray<T>& a)
+{
+  std::swap(root_, a.root_);
+  std::swap(tail_, a.tail_);
+  std::swap(size_, a.size_);
+  std::swap(shift_, a.shift_);
+}
+
+template<typename T>
+void
+PersistentArray<T>::append(const T* p, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    emplace_back(p[i]);
+}
+
+////////////////////////////////////////////////////////////////////////
+// bonus
+
+//// rule of five
+
+// destructor
+template<typename T>
+PersistentArray<T>::~PersistentArray()
+{
+  clear();
+}
+
+// copy constructor: a snapshot, sharing everything
+template<typename T>
+PersistentArray<T>::PersistentArray(const PersistentArray<T>& a)
+  : root_(share(a.root_)), tail_(leaf(share(a.tail_))),
+    size_(a.size_), shift_(a.shift_)
+{
+}
+
+// move constructor
+template<typename T>
+PersistentArray<T>::PersistentArray(PersistentArray<T>&& a) noexcept
+  : root_(a.root_), tail_(a.tail_), size_(a.size_), shift_(a.shift_)
+{
+  a.root_ = nullptr;
+  a.tail_ = nullptr;
+  a.size_ = 0;
+  a.shift_ = 0;
+}
+
+// copy assignment
+template<typename T>
+PersistentArray<T>&
+PersistentArray<T>::operator=(const PersistentArray<T>& a)
+{
+  PersistentArray<T> tmp(a);
+  swap(tmp);
+  return *this;
+}
+
+// move assignment
+template<typename T>
+PersistentArray<T>&
+PersistentArray<T>::operator=(PersistentArray<T>&& a) noexcept
+{
+  PersistentArray<T> tmp(std::move(a));
+  swap(tmp);
+  return *this;
+}
+
+//// iterators
+
+template<typename T>
+typename PersistentArray<T>::const_iterator
+PersistentArray<T>::begin() const
+{
+  return const_iterator(this, 0);
+}
+
+template<typename T>
+typename PersistentArray<T>::const_iterator
+PersistentArray<T>::end() const
+{
+  return const_iterator(this, size_);
+}
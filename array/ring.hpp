@@ -0,0 +1,908 @@
+// file: array/ring.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <atomic>
+#include <initializer_list>
+#include <iterator>         // std::random_access_iterator_tag
+#include <utility>          // std::pair
+
+#include "soa.hpp"          // Span
+
+#define RING_MAGNITUDE 16 // slots in the first allocation
+
+////////////////////////////////////////////////////////////////////////
+// declaration
+
+// A double-ended queue on one power-of-two block of slots. The elements
+// run from head_ around the end of the block and back to its start, so
+// element i lives in slot (head_ + i) & mask(): indexing is an add and
+// an and, and pushing or popping at either end moves nothing else. The
+// block only changes when it is full, and then doubles, laying the
+// elements out from slot 0 again; that invalidates pointers and
+// iterators, as growing an Array does, and nothing else does.
+//
+// spans() hands out the elements as at most two contiguous runs, front
+// first, for loops and memcpy that would rather not mask every index.
+// append() and pop_front(out, n) move whole runs at a time, which is
+// how a FIFO should be filled and drained.
+
+template <typename T>
+class RingArray
+{
+
+public:
+  template<bool Const>
+  class Iterator;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  // constructors
+  RingArray();
+  explicit RingArray(size_t n);
+  RingArray(std::initializer_list<T> l);
+
+  // operators
+  const T& operator[](size_t i) const;
+  T& operator[](size_t i);
+
+  // accessors
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+  const T& back() const;
+  const T& front() const;
+  T& back();
+  T& front();
+  std::pair<Span<const T>, Span<const T>> spans() const;
+  std::pair<Span<T>, Span<T>> spans();
+
+  // mutators
+  void reserve(size_t n);
+  void push_back(const T& v);
+  void push_back(T&& v);
+  void push_front(const T& v);
+  void push_front(T&& v);
+  template<typename... Args>
+  T& emplace_back(Args&&... args);
+  template<typename... Args>
+  T& emplace_front(Args&&... args);
+  void pop_back();
+  void pop_front();
+  void pop_back(size_t n);
+  void pop_front(size_t n);
+  size_t pop_front(T* out, size_t n);
+  void append(const T* p, size_t n);
+  void clear();
+  void release();
+  void swap(RingArray<T>& r);
+
+  // bonus
+  ~RingArray();
+  RingArray(const RingArray<T>& r);
+  RingArray(RingArray<T>&& r) noexcept;
+  RingArray<T>& operator=(const RingArray<T>& r);
+  RingArray<T>& operator=(RingArray<T>&& r) noexcept;
+  const_iterator begin() const;
+  const_iterator end() const;
+  iterator begin();
+  iterator end();
+
+private:
+  // room for one element, built only while it is in the ring
+  struct Slot
+  {
+    alignas(T) unsigned char raw[sizeof(T)];
+  };
+
+  // sized exactly, and not at all until the first push
+  Array<Slot, std::allocator<Slot>, SesquiGrowth<0>> slots_;
+  size_t head_; // slot of the front
+  size_t size_; // elements
+
+  T* at(size_t i) const;
+  size_t mask() const;
+  void room(size_t n);
+  void rebuild(size_t c);
+  void destroy();
+};
+
+////////////////////////////////////////////////////////////////////////
+// iterator
+
+// Random access by position from the front, so it stays valid across
+// pushes and pops at the back, though not across growth.
+
+template<typename T>
+template<bool Const>
+class RingArray<T>::Iterator
+{
+
+  using owner =
+    typename std::conditional<Const, const RingArray<T>, RingArray<T>>::type;
+
+public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = typename std::conditional<Const, const T*, T*>::type;
+  using reference = typename std::conditional<Const, const T&, T&>::type;
+
+  Iterator() : r_(nullptr), i_(0) {}
+  Iterator(owner* r, size_t i) : r_(r), i_(i) {}
+  operator Iterator<true>() const { return Iterator<true>(r_, i_); }
+
+  reference operator*() const { return (*r_)[i_]; }
+  pointer operator->() const { return &(*r_)[i_]; }
+  reference operator[](difference_type n) const { return (*r_)[i_ + n]; }
+
+  Iterator& operator++()
+  {
+    ++i_;
+    return *this;
+  }
+
+  Iterator& operator--()
+  {
+    --i_;
+    return *this;
+  }
+
+  Iterator& operator+=(difference_type n)
+  {
+    i_ += n;
+    return *this;
+  }
+
+  Iterator& operator-=(difference_type n)
+  {
+    i_ -= n;
+    return *this;
+  }
+
+  Iterator operator++(int)
+  {
+    Iterator tmp = *this;
+    ++i_;
+    return tmp;
+  }
+
+  Iterator operator--(int)
+  {
+    Iterator tmp = *this;
+    --i_;
+    return tmp;
+  }
+
+  Iterator operator+(difference_type n) const { return Iterator(r_, i_ + n); }
+  Iterator operator-(difference_type n) const { return Iterator(r_, i_ - n); }
+  friend Iterator operator+(difference_type n, const Iterator& it)
+  {
+    return it + n;
+  }
+  difference_type operator-(const Iterator& it) const
+  {
+    return (difference_type)(i_ - it.i_);
+  }
+
+  bool operator==(const Iterator& it) const { return i_ == it.i_; }
+  bool operator!=(const Iterator& it) const { return i_ != it.i_; }
+  bool operator<(const Iterator& it) const { return i_ < it.i_; }
+  bool operator>(const Iterator& it) const { return i_ > it.i_; }
+  bool operator<=(const Iterator& it) const { return i_ <= it.i_; }
+  bool operator>=(const Iterator& it) const { return i_ >= it.i_; }
+
+private:
+  owner* r_;
+  size_t i_;
+};
+
+////////////////////////////////////////////////////////////////////////
+// slots
+
+// the element in slot i, which need not be built yet
+template<typename T>
+T*
+RingArray<T>::at(size_t i) const
+{
+  Slot* s = const_cast<Slot*>(slots_.begin());
+  return reinterpret_cast<T*>(s[i].raw);
+}
+
+template<typename T>
+size_t
+RingArray<T>::mask() const
+{
+  return slots_.size() - 1;
+}
+
+// make room for n more elements
+template<typename T>
+void
+RingArray<T>::room(size_t n)
+{
+  size_t c = capacity();
+  if (size_ + n <= c)
+    return;
+  c = c ? c : RING_MAGNITUDE;
+  while (c < size_ + n)
+    c *= 2;
+  rebuild(c);
+}
+
+// Move the elements into a block of c slots, from slot 0. A copy is
+// made instead when moving might throw, so that a throw leaves the ring
+// as it was; t then holds, and destroys, whatever was already copied.
+// As with std::move_if_noexcept, a T that cannot be copied is moved
+// anyway, and a throw then leaves the elements moved from.
+template<typename T>
+void
+RingArray<T>::rebuild(size_t c)
+{
+  assert(c >= size_ && (c & (c - 1)) == 0);
+
+  RingArray<T> t;
+  t.slots_.resize(c);
+  auto halves = spans();
+  T* to = t.at(0);
+  for (Span<T> s : {halves.first, halves.second}) {
+    if constexpr (std::is_nothrow_move_constructible<T>::value ||
+                  !std::is_copy_constructible<T>::value)
+      std::uninitialized_move(s.begin(), s.end(), to);
+    else
+      std::uninitialized_copy(s.begin(), s.end(), to);
+    to += s.size();
+    t.size_ += s.size();
+  }
+  swap(t);
+}
+
+template<typename T>
+void
+RingArray<T>::destroy()
+{
+  if constexpr (!std::is_trivially_destructible<T>::value) {
+    auto halves = spans();
+    std::destroy(halves.first.begin(), halves.first.end());
+    std::destroy(halves.second.begin(), halves.second.end());
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// constructors
+
+template<typename T>
+RingArray<T>::RingArray()
+  : head_(0), size_(0)
+{}
+
+// empty, with room for n
+template<typename T>
+RingArray<T>::RingArray(size_t n)
+  : RingArray()
+{
+  reserve(n);
+}
+
+template<typename T>
+RingArray<T>::RingArray(std::initializer_list<T> l)
+  : RingArray()
+{
+  append(l.begin(), l.size());
+}
+
+////////////////////////////////////////////////////////////////////////
+// operators
+
+template<typename T>
+const T&
+RingArray<T>::operator[](size_t i) const
+{
+  assert(i < size_);
+
+  return *at((head_ + i) & mask());
+}
+
+template<typename T>
+T&
+RingArray<T>::operator[](size_t i)
+{
+  assert(i < size_);
+
+  return *at((head_ + i) & mask());
+}
+
+////////////////////////////////////////////////////////////////////////
+// accessors
+
+template<typename T>
+size_t
+RingArray<T>::size() const
+{
+  return size_;
+}
+
+template<typename T>
+size_t
+RingArray<T>::capacity() const
+{
+  return slots_.size();
+}
+
+template<typename T>
+bool
+RingArray<T>::empty() const
+{
+  return size_ == 0;
+}
+
+template<typename T>
+const T&
+RingArray<T>::back() const
+{
+  return (*this)[size_ - 1];
+}
+
+template<typename T>
+const T&
+RingArray<T>::front() const
+{
+  return (*this)[0];
+}
+
+template<typename T>
+T&
+RingArray<T>::back()
+{
+  return (*this)[size_ - 1];
+}
+
+template<typename T>
+T&
+RingArray<T>::front()
+{
+  return (*this)[0];
+}
+
+// the elements from the front to the end of the block, then the rest
+template<typename T>
+std::pair<Span<const T>, Span<const T>>
+RingArray<T>::spans() const
+{
+  auto s = const_cast<RingArray<T>*>(this)->spans();
+  return {Span<const T>(s.first.data(), s.first.size()),
+          Span<const T>(s.second.data(), s.second.size())};
+}
+
+template<typename T>
+std::pair<Span<T>, Span<T>>
+RingArray<T>::spans()
+{
+  if (size_ == 0)
+    return {Span<T>(nullptr, 0), Span<T>(nullptr, 0)};
+  size_t n = capacity() - head_;
+  if (size_ <= n)
+    return {Span<T>(at(head_), size_), Span<T>(at(0), 0)};
+  return {Span<T>(at(head_), n), Span<T>(at(0), size_ - n)};
+}
+
+////////////////////////////////////////////////////////////////////////
+// mutators
+
+// room for n elements in all, without growing again
+template<typename T>
+void
+RingArray<T>::reserve(size_t n)
+{
+  if (n > capacity())
+    rebuild(pow2(n < RING_MAGNITUDE ? RING_MAGNITUDE : n));
+}
+
+template<typename T>
+void
+RingArray<T>::push_back(const T& v)
+{
+  emplace_back(v);
+}
+
+template<typename T>
+void
+RingArray<T>::push_back(T&& v)
+{
+  emplace_back(std::move(v));
+}
+
+template<typename T>
+void
+RingArray<T>::push_front(const T& v)
+{
+  emplace_front(v);
+}
+
+template<typename T>
+void
+RingArray<T>::push_front(T&& v)
+{
+  emplace_front(std::move(v));
+}
+
+// Growing first could move an element args refers to, so when full the
+// new element is built aside and moved in. Either way the element is
+// only counted once it is built, so a throw leaves the ring as it was.
+template<typename T>
+template<typename... Args>
+T&
+RingArray<T>::emplace_back(Args&&... args)
+{
+  if (size_ == capacity()) {
+    T v(std::forward<Args>(args)...);
+    room(1);
+    T* p = new (at((head_ + size_) & mask())) T(std::move(v));
+    ++size_;
+    return *p;
+  }
+  T* p = new (at((head_ + size_) & mask())) T(std::forward<Args>(args)...);
+  ++size_;
+  return *p;
+}
+
+template<typename T>
+template<typename... Args>
+T&
+RingArray<T>::emplace_front(Args&&... args)
+{
+  if (size_ == capacity()) {
+    T v(std::forward<Args>(args)...);
+    room(1);
+    size_t h = (head_ - 1) & mask();
+    T* p = new (at(h)) T(std::move(v));
+    head_ = h;
+    ++size_;
+    return *p;
+  }
+  size_t h = (head_ - 1) & mask();
+  T* p = new (at(h)) T(std::forward<Args>(args)...);
+  head_ = h;
+  ++size_;
+  return *p;
+}
+
+template<typename T>
+void
+RingArray<T>::pop_back()
+{
+  assert(size_ > 0);
+
+  back().~T();
+  --size_;
+}
+
+template<typename T>
+void
+RingArray<T>::pop_front()
+{
+  assert(size_ > 0);
+
+  front().~T();
+  head_ = (head_ + 1) & mask();
+  --size_;
+}
+
+// drop the last n
+template<typename T>
+void
+RingArray<T>::pop_back(size_t n)
+{
+  assert(n <= size_);
+
+  if constexpr (!std::is_trivially_destructible<T>::value)
+    for (size_t i = size_ - n; i < size_; ++i)
+      (*this)[i].~T();
+  size_ -= n;
+}
+
+// drop the first n
+template<typename T>
+void
+RingArray<T>::pop_front(size_t n)
+{
+  assert(n <= size_);
+
+  if constexpr (!std::is_trivially_destructible<T>::value)
+    for (size_t i = 0; i < n; ++i)
+      (*this)[i].~T();
+  head_ = (head_ + n) & mask();
+  size_ -= n;
+}
+
+// Move up to n from the front to out, a run at a time; returns how many.
+template<typename T>
+size_t
+RingArray<T>::pop_front(T* out, size_t n)
+{
+  if (n > size_)
+    n = size_;
+  auto halves = spans();
+  size_t k = n < halves.first.size() ? n : halves.first.size();
+  std::move(halves.first.begin(), halves.first.begin() + k, out);
+  std::move(halves.second.begin(), halves.second.begin() + (n - k),
+            out + k);
+  pop_front(n);
+  return n;
+}
+
+// Copy n to the back, in at most two runs. p may point into the ring
+// itself; if the ring has to grow first, it is copied aside.
+template<typename T>
+void
+RingArray<T>::append(const T* p, size_t n)
+{
+  if (n == 0)
+    return;
+  if (size_ + n > capacity() && size_ &&
+      p >= at(0) && p < at(0) + capacity()) {
+    Array<T> t;
+    t.append(p, n);
+    append(t.begin(), n);
+    return;
+  }
+  room(n);
+  size_t t = (head_ + size_) & mask();
+  size_t k = capacity() - t;
+  k = n < k ? n : k;
+  std::uninitialized_copy(p, p + k, at(t));
+  size_ += k;
+  std::uninitialized_copy(p + k, p + n, at(0));
+  size_ += n - k;
+}
+
+// keeps the capacity
+template<typename T>
+void
+RingArray<T>::clear()
+{
+  destroy();
+  head_ = 0;
+  size_ = 0;
+}
+
+// gives back the capacity too
+template<typename T>
+void
+RingArray<T>::release()
+{
+  RingArray<T> t;
+  swap(t);
+}
+
+template<typename T>
+void
+RingArray<T>::swap(RingArray<T>& r)
+{
+  slots_.swap(r.slots_);
+  std::swap(head_, r.head_);
+  std::swap(size_, r.size_);
+}
+
+////////////////////////////////////////////////////////////////////////
+// bonus
+
+//// rule of five
+
+// destructor
+template<typename T>
+RingArray<T>::~RingArray()
+{
+  destroy();
+}
+
+// copy constructor
+template<typename T>
+RingArray<T>::RingArray(const RingArray<T>& r)
+  : RingArray()
+{
+  reserve(r.size_);
+  auto halves = r.spans();
+  append(halves.first.data(), halves.first.size());
+  append(halves.second.data(), halves.second.size());
+}
+
+// move constructor
+template<typename T>
+RingArray<T>::RingArray(RingArray<T>&& r) noexcept
+  : slots_(std::move(r.slots_)), head_(r.head_), size_(r.size_)
+{
+  r.head_ = 0;
+  r.size_ = 0;
+}
+
+// copy assignment
+template<typename T>
+RingArray<T>&
+RingArray<T>::operator=(const RingArray<T>& r)
+{
+  if (this != &r) {
+    RingArray<T> t(r);
+    swap(t);
+  }
+  return *this;
+}
+
+// move assignment
+template<typename T>
+RingArray<T>&
+RingArray<T>::operator=(RingArray<T>&& r) noexcept
+{
+  swap(r);
+  return *this;
+}
+
+//// iterators
+
+template<typename T>
+typename RingArray<T>::const_iterator
+RingArray<T>::begin() const
+{
+  return const_iterator(this, 0);
+}
+
+template<typename T>
+typename RingArray<T>::const_iterator
+RingArray<T>::end() const
+{
+  return const_iterator(this, size_);
+}
+
+template<typename T>
+typename RingArray<T>::iterator
+RingArray<T>::begin()
+{
+  return iterator(this, 0);
+}
+
+template<typename T>
+typename RingArray<T>::iterator
+RingArray<T>::end()
+{
+  return iterator(this, size_);
+}
+
+////////////////////////////////////////////////////////////////////////
+// spsc declaration
+
+// A bounded FIFO between one producing thread and one consuming thread,
+// with no lock. Positions are counters that only grow, an element
+// living in slot pos & mask_; the producer alone moves tail_ and the
+// consumer alone moves head_, each with a release store once the slots
+// it covers are built or vacated. Each side also keeps its last look at
+// the other's counter and only loads it again when that look says the
+// ring is full, or empty, so a steady stream of pushes and pops does
+// not bounce the counters' lines between the two cores. The bulk
+// try_push and try_pop publish a whole run with one store.
+//
+// The capacity is fixed at construction: there is no moment at which
+// both threads could agree to move the slots. size() and empty() are a
+// snapshot, exact only while the other thread keeps still.
+
+template <typename T>
+class SpscRing
+{
+
+public:
+  // constructors
+  explicit SpscRing(size_t n);
+
+  // accessors
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+
+  // mutators, producer only
+  bool try_push(const T& v);
+  bool try_push(T&& v);
+  template<typename... Args>
+  bool try_emplace(Args&&... args);
+  size_t try_push(const T* p, size_t n);
+
+  // mutators, consumer only
+  bool try_pop(T& out);
+  size_t try_pop(T* out, size_t n);
+
+  // bonus
+  ~SpscRing();
+  SpscRing(const SpscRing<T>&) = delete;
+  SpscRing<T>& operator=(const SpscRing<T>&) = delete;
+
+private:
+  struct Slot
+  {
+    alignas(T) unsigned char raw[sizeof(T)];
+  };
+
+  Array<Slot, std::allocator<Slot>, SesquiGrowth<0>> slots_;
+  size_t mask_;
+
+  // apart, so that each side writes only its own line
+  alignas(CACHE_LINE) std::atomic<size_t> head_; // next to pop
+  size_t tail_seen_;                             // consumer's tail_
+  alignas(CACHE_LINE) std::atomic<size_t> tail_; // next to push
+  size_t head_seen_;                             // producer's head_
+
+  T* at(size_t pos) const;
+  size_t vacant(size_t t, size_t n);
+  size_t ready(size_t h, size_t n);
+};
+
+////////////////////////////////////////////////////////////////////////
+// spsc slots
+
+template<typename T>
+T*
+SpscRing<T>::at(size_t pos) const
+{
+  Slot* s = const_cast<Slot*>(slots_.begin());
+  return reinterpret_cast<T*>(s[pos & mask_].raw);
+}
+
+// how many of n slots from tail t the producer may fill
+template<typename T>
+size_t
+SpscRing<T>::vacant(size_t t, size_t n)
+{
+  size_t k = capacity() - (t - head_seen_);
+  if (k < n) {
+    head_seen_ = head_.load(std::memory_order_acquire);
+    k = capacity() - (t - head_seen_);
+  }
+  return k < n ? k : n;
+}
+
+// how many of n elements from head h the consumer may take
+template<typename T>
+size_t
+SpscRing<T>::ready(size_t h, size_t n)
+{
+  size_t k = tail_seen_ - h;
+  if (k < n) {
+    tail_seen_ = tail_.load(std::memory_order_acquire);
+    k = tail_seen_ - h;
+  }
+  return k < n ? k : n;
+}
+
+////////////////////////////////////////////////////////////////////////
+// spsc constructors
+
+// room for n, rounded up to a power of two
+template<typename T>
+SpscRing<T>::SpscRing(size_t n)
+  : mask_(pow2(n) - 1), head_(0), tail_seen_(0), tail_(0), head_seen_(0)
+{
+  assert(n > 0);
+
+  slots_.resize(mask_ + 1);
+}
+
+////////////////////////////////////////////////////////////////////////
+// spsc accessors
+
+template<typename T>
+size_t
+SpscRing<T>::size() const
+{
+  size_t h = head_.load(std::memory_order_acquire);
+  return tail_.load(std::memory_order_acquire) - h;
+}
+
+template<typename T>
+size_t
+SpscRing<T>::capacity() const
+{
+  return mask_ + 1;
+}
+
+template<typename T>
+bool
+SpscRing<T>::empty() const
+{
+  return size() == 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+// spsc mutators
+
+template<typename T>
+bool
+SpscRing<T>::try_push(const T& v)
+{
+  return try_emplace(v);
+}
+
+template<typename T>
+bool
+SpscRing<T>::try_push(T&& v)
+{
+  return try_emplace(std::move(v));
+}
+
+// false, building nothing, when the ring is full
+template<typename T>
+template<typename... Args>
+bool
+SpscRing<T>::try_emplace(Args&&... args)
+{
+  size_t t = tail_.load(std::memory_order_relaxed);
+  if (vacant(t, 1) == 0)
+    return false;
+  new (at(t)) T(std::forward<Args>(args)...);
+  tail_.store(t + 1, std::memory_order_release);
+  return true;
+}
+
+// Copy as many of n as fit, a run at a time; returns how many.
+template<typename T>
+size_t
+SpscRing<T>::try_push(const T* p, size_t n)
+{
+  size_t t = tail_.load(std::memory_order_relaxed);
+  n = vacant(t, n);
+  size_t k = capacity() - (t & mask_);
+  k = n < k ? n : k;
+  std::uninitialized_copy(p, p + k, at(t));
+  tail_.store(t + k, std::memory_order_release);
+  if (k < n) {
+    std::uninitialized_copy(p + k, p + n, at(t + k));
+    tail_.store(t + n, std::memory_order_release);
+  }
+  return n;
+}
+
+// false, leaving out alone, when the ring is empty
+template<typename T>
+bool
+SpscRing<T>::try_pop(T& out)
+{
+  size_t h = head_.load(std::memory_order_relaxed);
+  if (ready(h, 1) == 0)
+    return false;
+  T* p = at(h);
+  out = std::move(*p);
+  p->~T();
+  head_.store(h + 1, std::memory_order_release);
+  return true;
+}
+
+// Move up to n to out, a run at a time; returns how many.
+template<typename T>
+size_t
+SpscRing<T>::try_pop(T* out, size_t n)
+{
+  size_t h = head_.load(std::memory_order_relaxed);
+  n = ready(h, n);
+  size_t k = capacity() - (h & mask_);
+  k = n < k ? n : k;
+  std::move(at(h), at(h) + k, out);
+  std::destroy(at(h), at(h) + k);
+  std::move(at(h + k), at(h + k) + (n - k), out + k);
+  std::destroy(at(h + k), at(h + k) + (n - k));
+  head_.store(h + n, std::memory_order_release);
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////
+// spsc bonus
+
+// destructor
+template<typename T>
+SpscRing<T>::~SpscRing()
+{
+  size_t t = tail_.load(std::memory_order_acquire);
+  for (size_t h = head_.load(std::memory_order_relaxed); h != t; ++h)
+    at(h)->~T();
+}
@@ -0,0 +1,490 @@
+// file: array/segmented.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <iterator> // std::forward_iterator_tag
+
+#include "array.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// segment arithmetic
+
+// Segment k holds B << k elements, starting at index B * (2^k - 1), so
+// that i + B has its highest bit at k + log2(B) and the rest of its bits
+// are the offset into the segment. B must be a power of two.
+
+template<size_t B>
+struct Segments
+{
+  static_assert(B && !(B & (B - 1)), "segment base must be a power of two");
+
+  static constexpr size_t shift = msb(B);
+  static constexpr size_t count = sizeof(size_t) * 8 - shift;
+
+  static size_t segment(size_t i)
+  {
+    return msb(i + B) - shift;
+  }
+  static size_t offset(size_t i, size_t k)
+  {
+    return i + B - (B << k);
+  }
+  static size_t length(size_t k)
+  {
+    return B << k;
+  }
+  static size_t start(size_t k)
+  {
+    return (B << k) - B;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+// declaration
+
+// An Array that grows by adding segments of doubling size instead of
+// reallocating: existing elements are never copied or moved, so pointers
+// and references to them stay valid for as long as they are live, and no
+// single growth step costs more than one allocation.
+
+template <typename T, size_t B = DEFAULT_MAGNITUDE>
+class SegmentedArray
+{
+
+  using seg = Segments<B>;
+
+public:
+  template<bool C>
+  class Iterator;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  // constructors
+  SegmentedArray();
+  SegmentedArray(size_t n);
+  SegmentedArray(size_t n, const T& v);
+
+  // operators
+  T operator[](size_t i) const;
+  T& operator[](size_t i);
+
+  // accessors
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+  T back() const;
+  T front() const;
+  T& back();
+  T& front();
+
+  // mutators
+  void reserve(size_t n);
+  void resize(size_t n);
+  void shrink_to_fit();
+  void push_back(const T& v);
+  void push_back(T&& v);
+  template<typename... Args>
+  T& emplace_back(Args&&... args);
+  void pop_back();
+  void clear();
+  void release();
+  void swap(SegmentedArray<T, B>& a);
+  void append(SegmentedArray<T, B>& a);
+
+  // bonus
+  ~SegmentedArray();
+  SegmentedArray(const SegmentedArray<T, B>& a);
+  SegmentedArray(SegmentedArray<T, B>&& a) noexcept;
+  SegmentedArray<T, B>& operator=(const SegmentedArray<T, B>& a);
+  SegmentedArray<T, B>& operator=(SegmentedArray<T, B>&& a) noexcept;
+  const_iterator begin() const;
+  const_iterator end() const;
+  iterator begin();
+  iterator end();
+
+private:
+  T* segments_[seg::count]; // allocated up to used_
+  size_t used_;             // segments allocated
+  size_t size_;             // constructed
+
+  T* slot(size_t i) const;
+  void add();
+};
+
+////////////////////////////////////////////////////////////////////////
+// iterator
+
+// Walks a segment with a plain pointer and only looks up the next
+// segment at its end.
+
+template<typename T, size_t B>
+template<bool C>
+class SegmentedArray<T, B>::Iterator
+{
+
+  using owner = typename std::conditional<C, const SegmentedArray<T, B>,
+                                          SegmentedArray<T, B>>::type;
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = typename std::conditional<C, const T*, T*>::type;
+  using reference = typename std::conditional<C, const T&, T&>::type;
+
+  Iterator(owner* a, size_t i)
+    : a_(a), i_(i), k_(0), p_(nullptr), last_(nullptr)
+  {
+    if (i_ < a_->size_) {
+      k_ = seg::segment(i_);
+      p_ = a_->segments_[k_] + seg::offset(i_, k_);
+      last_ = a_->segments_[k_] + seg::length(k_);
+    }
+  }
+
+  reference operator*() const { return *p_; }
+  pointer operator->() const { return p_; }
+
+  Iterator& operator++()
+  {
+    ++i_;
+    if (++p_ == last_ && i_ < a_->size_) {
+      ++k_;
+      p_ = a_->segments_[k_];
+      last_ = p_ + seg::length(k_);
+    }
+    return *this;
+  }
+
+  Iterator operator++(int)
+  {
+    Iterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+
+  bool operator==(const Iterator& it) const { return i_ == it.i_; }
+  bool operator!=(const Iterator& it) const { return i_ != it.i_; }
+
+private:
+  owner* a_;
+  size_t i_;     // index
+  size_t k_;     // segment of i_
+  pointer p_;    // slot of i_
+  pointer last_; // end of segment k_
+};
+
+////////////////////////////////////////////////////////////////////////
+// storage
+
+template<typename T, size_t B>
+T*
+SegmentedArray<T, B>::slot(size_t i) const
+{
+  size_t k = seg::segment(i);
+  return segments_[k] + seg::offset(i, k);
+}
+
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::add()
+{
+  assert(used_ < seg::count);
+
+  segments_[used_] =
+    static_cast<T*>(raw_alloc(seg::length(used_) * sizeof(T), alignof(T)));
+  ++used_;
+}
+
+////////////////////////////////////////////////////////////////////////
+// constructors
+
+template<typename T, size_t B>
+SegmentedArray<T, B>::SegmentedArray()
+  : used_(0), size_(0)
+{
+}
+
+template<typename T, size_t B>
+SegmentedArray<T, B>::SegmentedArray(size_t n)
+  : SegmentedArray()
+{
+  resize(n);
+}
+
+template<typename T, size_t B>
+SegmentedArray<T, B>::SegmentedArray(size_t n, const T& v)
+  : SegmentedArray()
+{
+  reserve(n);
+  while (size_ < n)
+    push_back(v);
+}
+
+////////////////////////////////////////////////////////////////////////
+// operators
+
+template<typename T, size_t B>
+T
+SegmentedArray<T, B>::operator[](size_t i) const
+{
+  assert(i < size_);
+
+  return *slot(i);
+}
+
+template<typename T, size_t B>
+T&
+SegmentedArray<T, B>::operator[](size_t i)
+{
+  assert(i < size_);
+
+  return *slot(i);
+}
+
+////////////////////////////////////////////////////////////////////////
+// accessors
+
+template<typename T, size_t B>
+size_t
+SegmentedArray<T, B>::size() const
+{
+  return size_;
+}
+
+template<typename T, size_t B>
+size_t
+SegmentedArray<T, B>::capacity() const
+{
+  return seg::start(used_);
+}
+
+template<typename T, size_t B>
+bool
+SegmentedArray<T, B>::empty() const
+{
+  return size_ == 0;
+}
+
+template<typename T, size_t B>
+T
+SegmentedArray<T, B>::back() const
+{
+  return *slot(size_ - 1);
+}
+
+template<typename T, size_t B>
+T
+SegmentedArray<T, B>::front() const
+{
+  return *segments_[0];
+}
+
+template<typename T, size_t B>
+T&
+SegmentedArray<T, B>::back()
+{
+  return *slot(size_ - 1);
+}
+
+template<typename T, size_t B>
+T&
+SegmentedArray<T, B>::front()
+{
+  return *segments_[0];
+}
+
+////////////////////////////////////////////////////////////////////////
+// mutators
+
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::reserve(size_t n)
+{
+  while (capacity() < n)
+    add();
+}
+
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::resize(size_t n)
+{
+  reserve(n);
+  while (size_ < n)
+    emplace_back();
+  while (size_ > n)
+    pop_back();
+}
+
+// Only segments wholly past size() are released.
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::shrink_to_fit()
+{
+  while (used_ && seg::start(used_ - 1) >= size_) {
+    --used_;
+    raw_free(segments_[used_], seg::length(used_) * sizeof(T), alignof(T));
+  }
+}
+
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::push_back(const T& v)
+{
+  emplace_back(v);
+}
+
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::push_back(T&& v)
+{
+  emplace_back(std::move(v));
+}
+
+// Growth adds a segment and leaves the others alone, so args may safely
+// refer to an element.
+template<typename T, size_t B>
+template<typename... Args>
+T&
+SegmentedArray<T, B>::emplace_back(Args&&... args)
+{
+  if (size_ == capacity())
+    add();
+
+  T* p = slot(size_);
+  new (p) T(std::forward<Args>(args)...);
+  ++size_;
+  return *p;
+}
+
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::pop_back()
+{
+  --size_;
+  slot(size_)->~T();
+}
+
+// The segments stay, so refilling up to capacity() allocates nothing.
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::clear()
+{
+  if constexpr (std::is_trivially_destructible<T>::value)
+    size_ = 0;
+  while (size_)
+    pop_back();
+}
+
+// clear() and free every segment.
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::release()
+{
+  clear();
+  shrink_to_fit();
+}
+
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::swap(SegmentedArray<T, B>& a)
+{
+  size_t n = used_ > a.used_ ? used_ : a.used_;
+  for (size_t k = 0; k < n; k++)
+    std::swap(segments_[k], a.segments_[k]);
+  std::swap(used_, a.used_);
+  std::swap(size_, a.size_);
+}
+
+template<typename T, size_t B>
+void
+SegmentedArray<T, B>::append(SegmentedArray<T, B>& a)
+{
+  size_t n = a.size_; // a may be *this
+  reserve(size_ + n);
+  for (size_t i = 0; i < n; i++)
+    push_back(*a.slot(i));
+}
+
+////////////////////////////////////////////////////////////////////////
+// bonus
+
+//// rule of five
+
+// destructor
+template<typename T, size_t B>
+SegmentedArray<T, B>::~SegmentedArray()
+{
+  release();
+}
+
+// copy constructor
+template<typename T, size_t B>
+SegmentedArray<T, B>::SegmentedArray(const SegmentedArray<T, B>& a)
+  : SegmentedArray()
+{
+  reserve(a.size_);
+  for (const T& v : a)
+    push_back(v);
+}
+
+// move constructor
+template<typename T, size_t B>
+SegmentedArray<T, B>::SegmentedArray(SegmentedArray<T, B>&& a) noexcept
+  : SegmentedArray()
+{
+  swap(a);
+}
+
+// copy assignment
+template<typename T, size_t B>
+SegmentedArray<T, B>&
+SegmentedArray<T, B>::operator=(const SegmentedArray<T, B>& a)
+{
+  if (this != &a) {
+    SegmentedArray<T, B> tmp(a);
+    swap(tmp);
+  }
+  return *this;
+}
+
+// move assignment
+template<typename T, size_t B>
+SegmentedArray<T, B>&
+SegmentedArray<T, B>::operator=(SegmentedArray<T, B>&& a) noexcept
+{
+  swap(a);
+  return *this;
+}
+
+//// iterators
+
+template<typename T, size_t B>
+typename SegmentedArray<T, B>::const_iterator
+SegmentedArray<T, B>::begin() const {
+  return const_iterator(this, 0);
+}
+
+template<typename T, size_t B>
+typename SegmentedArray<T, B>::const_iterator
+SegmentedArray<T, B>::end() const {
+  return const_iterator(this, size_);
+}
+
+template<typename T, size_t B>
+typename SegmentedArray<T, B>::iterator
+SegmentedArray<T, B>::begin() {
+  return iterator(this, 0);
+}
+
+template<typename T, size_t B>
+typename SegmentedArray<T, B>::iterator
+SegmentedArray<T, B>::end() {
+  return iterator(this, size_);
+}
@@ -0,0 +1,411 @@
+// file: array/serial.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close, read, write
+
+#include "array.hpp"
+
+#define SERIAL_MAGIC "arraybin"
+#define SERIAL_VERSION 1
+#define SERIAL_CHUNK (1 << 30) // most bytes per read or write call
+
+////////////////////////////////////////////////////////////////////////
+// file layout
+
+// A saved array is this header followed by its size elements, byte for
+// byte as they were in memory. The header is one cache line, so a
+// mapping of the file has the elements aligned for any T that needs at
+// most that. The file is only meant to be read back on a machine of the
+// same endianness and with the same layout for T; unit catches most
+// mismatches of the latter.
+
+struct SerialHeader
+{
+  char magic[8];     // SERIAL_MAGIC, unterminated
+  uint32_t version;  // SERIAL_VERSION
+  uint32_t unit;     // sizeof(T)
+  uint64_t size;     // elements
+  uint64_t checksum; // serial_checksum() of the elements
+  char pad[32];
+};
+
+static_assert(sizeof(SerialHeader) == 64, "SerialHeader is one line");
+
+////////////////////////////////////////////////////////////////////////
+// checksum
+
+// A 64-bit hash of n bytes that goes a word at a time over four
+// independent lanes, so it keeps up with reading from memory. It is
+// there to catch truncated and damaged files, not tampering.
+
+inline uint64_t
+serial_mix(uint64_t h, uint64_t w)
+{
+  h ^= w * 0x9e3779b97f4a7c15ull;
+  h = (h << 31) | (h >> 33);
+  return h * 0xc2b2ae3d27d4eb4full;
+}
+
+inline uint64_t
+serial_checksum(const void* p, size_t n)
+{
+  const unsigned char* b = static_cast<const unsigned char*>(p);
+  uint64_t h[4] = {1, 2, 3, 4};
+  uint64_t w[4];
+  size_t i = 0;
+  for (; i + sizeof(w) <= n; i += sizeof(w)) {
+    std::memcpy(w, b + i, sizeof(w));
+    for (size_t k = 0; k < 4; ++k)
+      h[k] = serial_mix(h[k], w[k]);
+  }
+  for (; i + 8 <= n; i += 8) {
+    std::memcpy(w, b + i, 8);
+    h[0] = serial_mix(h[0], w[0]);
+  }
+  uint64_t t = 0;
+  for (size_t k = 0; i + k < n; ++k)
+    t |= (uint64_t)b[i + k] << (8 * k);
+  h[1] = serial_mix(h[1], t);
+
+  uint64_t s = n;
+  for (size_t k = 0; k < 4; ++k)
+    s = serial_mix(s, h[k]);
+  return s ^ (s >> 29);
+}
+
+////////////////////////////////////////////////////////////////////////
+// files
+
+[[noreturn]] inline void
+serial_fail(const char* what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+inline void
+serial_write(int fd, const void* p, size_t n)
+{
+  const char* b = static_cast<const char*>(p);
+  while (n) {
+    ssize_t k = write(fd, b, n < SERIAL_CHUNK ? n : SERIAL_CHUNK);
+    if (k < 0) {
+      if (errno == EINTR)
+        continue;
+      serial_fail("save: write");
+    }
+    b += k;
+    n -= k;
+  }
+}
+
+inline void
+serial_read(int fd, void* p, size_t n)
+{
+  char* b = static_cast<char*>(p);
+  while (n) {
+    ssize_t k = read(fd, b, n < SERIAL_CHUNK ? n : SERIAL_CHUNK);
+    if (k < 0) {
+      if (errno == EINTR)
+        continue;
+      serial_fail("load: read");
+    }
+    if (k == 0) {
+      errno = EINVAL;
+      serial_fail("load: truncated");
+    }
+    b += k;
+    n -= k;
+  }
+}
+
+// Whether h heads a file of have bytes holding elements of unit bytes.
+inline bool
+serial_fits(const SerialHeader& h, size_t unit, size_t have)
+{
+  return std::memcmp(h.magic, SERIAL_MAGIC, sizeof(h.magic)) == 0 &&
+         h.version == SERIAL_VERSION && h.unit == unit &&
+         h.size <= (have - sizeof(SerialHeader)) / unit;
+}
+
+////////////////////////////////////////////////////////////////////////
+// save and load
+
+// Write a to path, replacing whatever was there.
+template<typename T, typename A, typename G>
+void
+save(const Array<T, A, G>& a, const char* path)
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "save() writes raw bytes");
+
+  size_t bytes = a.size() * sizeof(T);
+  SerialHeader h = {};
+  std::memcpy(h.magic, SERIAL_MAGIC, sizeof(h.magic));
+  h.version = SERIAL_VERSION;
+  h.unit = sizeof(T);
+  h.size = a.size();
+  h.checksum = serial_checksum(a.begin(), bytes);
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    serial_fail("save: open");
+  try {
+    serial_write(fd, &h, sizeof(h));
+    serial_write(fd, a.begin(), bytes);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  if (close(fd) != 0)
+    serial_fail("save: close");
+}
+
+// Replace the contents of a with what save() wrote to path. The
+// elements are read straight into a's storage, with nothing to parse,
+// and a is only touched once the header and checksum have checked out.
+template<typename T, typename A, typename G>
+void
+load(Array<T, A, G>& a, const char* path)
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "load() reads raw bytes");
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    serial_fail("load: open");
+
+  Array<T, A, G> in(a.get_allocator());
+  try {
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+      serial_fail("load: fstat");
+    SerialHeader h;
+    serial_read(fd, &h, sizeof(h));
+    if (!serial_fits(h, sizeof(T), st.st_size)) {
+      errno = EINVAL;
+      serial_fail("load: not an array of this type");
+    }
+    in.resize(h.size);
+    serial_read(fd, in.begin(), h.size * sizeof(T));
+    if (serial_checksum(in.begin(), h.size * sizeof(T)) != h.checksum) {
+      errno = EIO;
+      serial_fail("load: checksum mismatch");
+    }
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+  a.swap(in);
+}
+
+////////////////////////////////////////////////////////////////////////
+// view declaration
+
+// A read-only array over a file written by save(), mapped rather than
+// read: opening it costs one mmap however big the file is, pages come
+// in from the page cache as they are touched, and every process viewing
+// the same file shares them. The header is checked on opening; the
+// checksum is not, since that would read the whole file, so call
+// verify() when the file may be damaged.
+
+template <typename T>
+class ArrayView
+{
+
+  static_assert(std::is_trivially_copyable<T>::value,
+                "ArrayView holds raw bytes");
+  static_assert(alignof(T) <= sizeof(SerialHeader),
+                "ArrayView cannot align T");
+
+public:
+  // constructors
+  ArrayView(const char* path);
+
+  // operators
+  const T& operator[](size_t i) const;
+
+  // accessors
+  size_t size() const;
+  bool empty() const;
+  const T& back() const;
+  const T& front() const;
+  const T* data() const;
+  bool verify() const;
+
+  // bonus
+  ~ArrayView();
+  ArrayView(const ArrayView<T>&) = delete;
+  ArrayView(ArrayView<T>&& v) noexcept;
+  ArrayView<T>& operator=(const ArrayView<T>&) = delete;
+  ArrayView<T>& operator=(ArrayView<T>&& v) noexcept;
+  const T* begin() const;
+  const T* end() const;
+
+private:
+  const SerialHeader* head_; // start of the mapping
+  const T* array_;           // right after head_
+  size_t bytes_;             // of the mapping
+};
+
+////////////////////////////////////////////////////////////////////////
+// view constructors
+
+// The descriptor is closed once the file is mapped; the mapping keeps
+// the file open.
+template<typename T>
+ArrayView<T>::ArrayView(const char* path)
+  : head_(nullptr), array_(nullptr), bytes_(0)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    serial_fail("ArrayView: open");
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    serial_fail("ArrayView: fstat");
+  }
+  if ((size_t)st.st_size < sizeof(SerialHeader)) {
+    close(fd);
+    errno = EINVAL;
+    serial_fail("ArrayView: truncated header");
+  }
+
+  bytes_ = st.st_size;
+  void* p = mmap(nullptr, bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    serial_fail("ArrayView: mmap");
+  head_ = static_cast<const SerialHeader*>(p);
+  array_ = reinterpret_cast<const T*>(head_ + 1);
+
+  if (!serial_fits(*head_, sizeof(T), bytes_)) {
+    munmap(p, bytes_);
+    errno = EINVAL;
+    serial_fail("ArrayView: not an array of this type");
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// view operators
+
+template<typename T>
+const T&
+ArrayView<T>::operator[](size_t i) const
+{
+  assert(i < size());
+
+  return array_[i];
+}
+
+////////////////////////////////////////////////////////////////////////
+// view accessors
+
+template<typename T>
+size_t
+ArrayView<T>::size() const
+{
+  return head_ ? head_->size : 0;
+}
+
+template<typename T>
+bool
+ArrayView<T>::empty() const
+{
+  return size() == 0;
+}
+
+template<typename T>
+const T&
+ArrayView<T>::back() const
+{
+  return (*this)[size() - 1];
+}
+
+template<typename T>
+const T&
+ArrayView<T>::front() const
+{
+  return (*this)[0];
+}
+
+template<typename T>
+const T*
+ArrayView<T>::data() const
+{
+  return array_;
+}
+
+// whether the elements still hash to what save() recorded
+template<typename T>
+bool
+ArrayView<T>::verify() const
+{
+  return !head_ ||
+         serial_checksum(array_, size() * sizeof(T)) == head_->checksum;
+}
+
+////////////////////////////////////////////////////////////////////////
+// view bonus
+
+//// rule of five
+
+// destructor
+template<typename T>
+ArrayView<T>::~ArrayView()
+{
+  if (head_)
+    munmap(const_cast<SerialHeader*>(head_), bytes_);
+}
+
+// move constructor
+template<typename T>
+ArrayView<T>::ArrayView(ArrayView<T>&& v) noexcept
+  : head_(v.head_), array_(v.array_), bytes_(v.bytes_)
+{
+  v.head_ = nullptr;
+  v.array_ = nullptr;
+  v.bytes_ = 0;
+}
+
+// move assignment
+template<typename T>
+ArrayView<T>&
+ArrayView<T>::operator=(ArrayView<T>&& v) noexcept
+{
+  std::swap(head_, v.head_);
+  std::swap(array_, v.array_);
+  std::swap(bytes_, v.bytes_);
+  return *this;
+}
+
+//// iterators
+
+template<typename T>
+const T*
+ArrayView<T>::begin() const
+{
+  return array_;
+}
+
+template<typename T>
+const T*
+ArrayView<T>::end() const
+{
+  return array_ + size();
+}
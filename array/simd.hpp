@@ -0,0 +1,480 @@
+// file: array/simd.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <cstdint>
+
+#include "array.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+
+#define SIMD_UNROLL 4 // independent accumulators per reduction
+
+////////////////////////////////////////////////////////////////////////
+// dispatch
+
+// Each kernel below is written once over GCC vector extensions, with the
+// vector width in bytes as a template parameter. It is instantiated
+// inside one wrapper per instruction set, whose target attribute lets
+// the compiler use that set's registers, and the wrapper is picked once
+// per call from what the cpu reports. Without x86 and GCC, everything
+// runs one lane wide, where the reductions fall back to plain loops.
+
+enum class Simd { scalar, sse2, avx2, avx512 };
+
+inline Simd&
+simd_cap()
+{
+  static Simd cap = Simd::avx512;
+  return cap;
+}
+
+// the widest set both the cpu and simd_cap() allow
+inline Simd
+simd_level()
+{
+#if SIMD_X86
+  static const Simd cpu =
+    __builtin_cpu_supports("avx512f") ? Simd::avx512 :
+    __builtin_cpu_supports("avx2") ? Simd::avx2 : Simd::sse2;
+#else
+  static const Simd cpu = Simd::scalar;
+#endif
+  return cpu < simd_cap() ? cpu : simd_cap();
+}
+
+template<typename K, typename... Args>
+auto
+simd_scalar(Args... args)
+{
+  return K::template run<sizeof(typename K::type)>(args...);
+}
+
+#if SIMD_X86
+template<typename K, typename... Args>
+auto
+simd_sse2(Args... args)
+{
+  return K::template run<16>(args...);
+}
+
+template<typename K, typename... Args>
+__attribute__((target("avx2"))) auto
+simd_avx2(Args... args)
+{
+  return K::template run<32>(args...);
+}
+
+template<typename K, typename... Args>
+__attribute__((target("avx512f"))) auto
+simd_avx512(Args... args)
+{
+  return K::template run<64>(args...);
+}
+#endif
+
+template<typename K, typename... Args>
+auto
+simd(Args... args)
+{
+#if SIMD_X86
+  switch (simd_level()) {
+  case Simd::avx512: return simd_avx512<K>(args...);
+  case Simd::avx2:   return simd_avx2<K>(args...);
+  case Simd::sse2:   return simd_sse2<K>(args...);
+  default:           break;
+  }
+#endif
+  return simd_scalar<K>(args...);
+}
+
+////////////////////////////////////////////////////////////////////////
+// vectors
+
+// T repeated over B bytes; loads and stores go through memcpy, so the
+// data need not be aligned. Vectors only cross these helpers by
+// reference, which keeps them out of the calling convention of whatever
+// target the helpers themselves are built for.
+
+template<typename T, size_t B>
+struct Vec
+{
+  static constexpr size_t lanes = B / sizeof(T);
+  typedef T type __attribute__((vector_size(B)));
+};
+
+#define SIMD_INLINE __attribute__((always_inline)) inline
+
+// Signed lanes that overflow are undefined, where the sums should wrap,
+// so integer kernels do their arithmetic on the unsigned lanes of the
+// same width and only the result goes back to T.
+
+template<typename T, bool = std::is_integral<T>::value>
+struct Wrap
+{
+  using type = T;
+};
+
+template<typename T>
+struct Wrap<T, true>
+{
+  using type = typename std::make_unsigned<T>::type;
+};
+
+// a b in U, with narrow lanes promoted to unsigned rather than int
+template<typename U>
+SIMD_INLINE U
+wmul(U a, U b)
+{
+  return U(1u * a * b);
+}
+
+template<typename V, typename T>
+SIMD_INLINE void
+vload(V& v, const T* p)
+{
+  std::memcpy(&v, p, sizeof(V));
+}
+
+template<typename V, typename T>
+SIMD_INLINE void
+vstore(T* p, const V& v)
+{
+  std::memcpy(p, &v, sizeof(V));
+}
+
+////////////////////////////////////////////////////////////////////////
+// kernels
+
+template<typename T>
+struct SumKernel
+{
+  using type = T;
+
+  template<size_t B>
+  static SIMD_INLINE T run(const T* p, size_t n)
+  {
+    using U = typename Wrap<T>::type;
+    using V = typename Vec<U, B>::type;
+    constexpr size_t W = Vec<U, B>::lanes;
+
+    if constexpr (W == 1) {
+      U s = 0;
+      for (size_t i = 0; i < n; ++i)
+        s += U(p[i]);
+      return T(s);
+    }
+
+    V acc[SIMD_UNROLL] = {};
+    size_t i = 0;
+    V x;
+    for (; i + SIMD_UNROLL * W <= n; i += SIMD_UNROLL * W)
+      for (size_t u = 0; u < SIMD_UNROLL; ++u) {
+        vload(x, p + i + u * W);
+        acc[u] += x;
+      }
+    for (; i + W <= n; i += W) {
+      vload(x, p + i);
+      acc[0] += x;
+    }
+
+    for (size_t u = 1; u < SIMD_UNROLL; ++u)
+      acc[0] += acc[u];
+    U s = 0;
+    for (size_t j = 0; j < W; ++j)
+      s += acc[0][j];
+    for (; i < n; ++i)
+      s += U(p[i]);
+    return T(s);
+  }
+};
+
+template<typename T, bool Max>
+struct ExtremeKernel
+{
+  using type = T;
+
+  template<size_t B>
+  static SIMD_INLINE T run(const T* p, size_t n)
+  {
+    using V = typename Vec<T, B>::type;
+    constexpr size_t W = Vec<T, B>::lanes;
+
+    T m = p[0];
+    size_t i = 0;
+    if (n >= W) {
+      V acc, x;
+      vload(acc, p);
+      for (i = W; i + W <= n; i += W) {
+        vload(x, p + i);
+        acc = Max ? (x > acc ? x : acc) : (x < acc ? x : acc);
+      }
+      m = acc[0];
+      for (size_t j = 1; j < W; ++j)
+        if (Max ? acc[j] > m : acc[j] < m)
+          m = acc[j];
+    }
+    for (; i < n; ++i)
+      if (Max ? p[i] > m : p[i] < m)
+        m = p[i];
+    return m;
+  }
+};
+
+template<typename T>
+struct DotKernel
+{
+  using type = T;
+
+  template<size_t B>
+  static SIMD_INLINE T run(const T* x, const T* y, size_t n)
+  {
+    using U = typename Wrap<T>::type;
+    using V = typename Vec<U, B>::type;
+    constexpr size_t W = Vec<U, B>::lanes;
+
+    if constexpr (W == 1) {
+      U s = 0;
+      for (size_t i = 0; i < n; ++i)
+        s += wmul(U(x[i]), U(y[i]));
+      return T(s);
+    }
+
+    V acc[SIMD_UNROLL] = {};
+    size_t i = 0;
+    V a, b;
+    for (; i + SIMD_UNROLL * W <= n; i += SIMD_UNROLL * W)
+      for (size_t u = 0; u < SIMD_UNROLL; ++u) {
+        vload(a, x + i + u * W);
+        vload(b, y + i + u * W);
+        acc[u] += a * b;
+      }
+    for (; i + W <= n; i += W) {
+      vload(a, x + i);
+      vload(b, y + i);
+      acc[0] += a * b;
+    }
+
+    for (size_t u = 1; u < SIMD_UNROLL; ++u)
+      acc[0] += acc[u];
+    U s = 0;
+    for (size_t j = 0; j < W; ++j)
+      s += acc[0][j];
+    for (; i < n; ++i)
+      s += wmul(U(x[i]), U(y[i]));
+    return T(s);
+  }
+};
+
+// y = a x + y
+template<typename T>
+struct AxpyKernel
+{
+  using type = T;
+
+  template<size_t B>
+  static SIMD_INLINE int run(T a, const T* x, T* y, size_t n)
+  {
+    using U = typename Wrap<T>::type;
+    using V = typename Vec<U, B>::type;
+    constexpr size_t W = Vec<U, B>::lanes;
+
+    V va = V {} + U(a), vx, vy;
+    size_t i = 0;
+    for (; i + W <= n; i += W) {
+      vload(vx, x + i);
+      vload(vy, y + i);
+      vy += va * vx;
+      vstore(y + i, vy);
+    }
+    for (; i < n; ++i)
+      y[i] = T(wmul(U(a), U(x[i])) + U(y[i]));
+    return 0;
+  }
+};
+
+template<typename T>
+struct ScaleKernel
+{
+  using type = T;
+
+  template<size_t B>
+  static SIMD_INLINE int run(T a, T* x, size_t n)
+  {
+    using U = typename Wrap<T>::type;
+    using V = typename Vec<U, B>::type;
+    constexpr size_t W = Vec<U, B>::lanes;
+
+    V va = V {} + U(a), vx;
+    size_t i = 0;
+    for (; i + W <= n; i += W) {
+      vload(vx, x + i);
+      vx *= va;
+      vstore(x + i, vx);
+    }
+    for (; i < n; ++i)
+      x[i] = T(wmul(U(a), U(x[i])));
+    return 0;
+  }
+};
+
+// m[i] = x[i] < v, one byte of 0 or 1 per element
+template<typename T>
+struct LessKernel
+{
+  using type = T;
+
+  template<size_t B>
+  static SIMD_INLINE int run(const T* x, T v, uint8_t* m, size_t n)
+  {
+    using V = typename Vec<T, B>::type;
+    constexpr size_t W = Vec<T, B>::lanes;
+    using M = typename Vec<uint8_t, W>::type;
+
+    V vv = V {} + v, vx;
+    M one = M {} + 1;
+    size_t i = 0;
+    for (; i + W <= n; i += W) {
+      vload(vx, x + i);
+      M c = __builtin_convertvector(vx < vv, M); // all ones or zero
+      c &= one;
+      vstore(m + i, c);
+    }
+    for (; i < n; ++i)
+      m[i] = x[i] < v;
+    return 0;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+// interface
+
+// Integer sums wrap in T, as they would in a plain loop. Floating point
+// sums are reassociated across lanes, so they may differ from a plain
+// loop in the last bits.
+
+template<typename T>
+T
+vsum(const T* p, size_t n)
+{
+  static_assert(std::is_arithmetic<T>::value, "vsum needs numbers");
+  return simd<SumKernel<T>>(p, n);
+}
+
+template<typename T>
+T
+vmin(const T* p, size_t n)
+{
+  static_assert(std::is_arithmetic<T>::value, "vmin needs numbers");
+  assert(n > 0);
+  return simd<ExtremeKernel<T, false>>(p, n);
+}
+
+template<typename T>
+T
+vmax(const T* p, size_t n)
+{
+  static_assert(std::is_arithmetic<T>::value, "vmax needs numbers");
+  assert(n > 0);
+  return simd<ExtremeKernel<T, true>>(p, n);
+}
+
+template<typename T>
+T
+vdot(const T* x, const T* y, size_t n)
+{
+  static_assert(std::is_arithmetic<T>::value, "vdot needs numbers");
+  return simd<DotKernel<T>>(x, y, n);
+}
+
+template<typename T>
+void
+vaxpy(T a, const T* x, T* y, size_t n)
+{
+  static_assert(std::is_arithmetic<T>::value, "vaxpy needs numbers");
+  simd<AxpyKernel<T>>(a, x, y, n);
+}
+
+template<typename T>
+void
+vscale(T a, T* x, size_t n)
+{
+  static_assert(std::is_arithmetic<T>::value, "vscale needs numbers");
+  simd<ScaleKernel<T>>(a, x, n);
+}
+
+template<typename T>
+void
+vless(const T* x, T v, uint8_t* m, size_t n)
+{
+  static_assert(std::is_arithmetic<T>::value, "vless needs numbers");
+  simd<LessKernel<T>>(x, v, m, n);
+}
+
+//// Array
+
+template<typename T, typename A, typename G>
+T
+vsum(const Array<T, A, G>& a)
+{
+  return vsum(a.begin(), a.size());
+}
+
+template<typename T, typename A, typename G>
+T
+vmin(const Array<T, A, G>& a)
+{
+  return vmin(a.begin(), a.size());
+}
+
+template<typename T, typename A, typename G>
+T
+vmax(const Array<T, A, G>& a)
+{
+  return vmax(a.begin(), a.size());
+}
+
+template<typename T, typename A, typename G>
+T
+vdot(const Array<T, A, G>& x, const Array<T, A, G>& y)
+{
+  assert(x.size() == y.size());
+
+  return vdot(x.begin(), y.begin(), x.size());
+}
+
+template<typename T, typename A, typename G>
+void
+vaxpy(T a, const Array<T, A, G>& x, Array<T, A, G>& y)
+{
+  assert(x.size() == y.size());
+
+  vaxpy(a, x.begin(), y.begin(), x.size());
+}
+
+template<typename T, typename A, typename G>
+void
+vscale(T a, Array<T, A, G>& x)
+{
+  vscale(a, x.begin(), x.size());
+}
+
+template<typename T, typename A, typename G>
+Array<uint8_t>
+vless(const Array<T, A, G>& x, T v)
+{
+  Array<uint8_t> m;
+  m.resize(x.size());
+  vless(x.begin(), v, m.begin(), x.size());
+  return m;
+}
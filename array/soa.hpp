@@ -0,0 +1,540 @@
+// file: array/soa.hpp
+// by  : jooh@cuni.cz
+// for : nprg041
+// lic.: mit
+
+////////////////////////////////////////////////////////////////////////
+// preproc
+
+#pragma once
+
+#include <iterator> // std::random_access_iterator_tag
+#include <tuple>
+
+#include "array.hpp"
+
+////////////////////////////////////////////////////////////////////////
+// span
+
+// A view of n contiguous elements, which is what a column is.
+
+template<typename T>
+class Span
+{
+
+public:
+  Span(T* p, size_t n) : data_(p), size_(n) {}
+
+  T& operator[](size_t i) const
+  {
+    assert(i < size_);
+
+    return data_[i];
+  }
+
+  T* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  T* begin() const { return data_; }
+  T* end() const { return data_ + size_; }
+
+private:
+  T* data_;
+  size_t size_;
+};
+
+////////////////////////////////////////////////////////////////////////
+// row proxy
+
+// One row of a SoAArray: a tuple of references into its columns.
+// Assigning to it writes through to the columns, and it converts to a
+// tuple of values, so rows can be read, written, swapped and sorted as
+// if they were structs. std::get and structured bindings work on it.
+
+template<typename... Fields>
+class SoARef : public std::tuple<Fields&...>
+{
+
+  using base = std::tuple<Fields&...>;
+
+public:
+  using base::base;
+  using base::operator=;
+
+  SoARef(const SoARef&) = default;
+
+  // the referents, not the references
+  SoARef& operator=(const SoARef& r)
+  {
+    base::operator=(static_cast<const base&>(r));
+    return *this;
+  }
+
+  template<size_t K>
+  auto& get() const
+  {
+    return std::get<K>(static_cast<const base&>(*this));
+  }
+};
+
+template<typename... Fields, size_t... K>
+void
+swap_fields(SoARef<Fields...>& a, SoARef<Fields...>& b,
+            std::index_sequence<K...>)
+{
+  using std::swap;
+  (swap(std::get<K>(a), std::get<K>(b)), ...);
+}
+
+// field by field, so that each can move
+template<typename... Fields>
+void
+swap(SoARef<Fields...> a, SoARef<Fields...> b)
+{
+  swap_fields(a, b, std::index_sequence_for<Fields...>());
+}
+
+namespace std
+{
+template<typename... Fields>
+struct tuple_size<SoARef<Fields...>>
+  : tuple_size<tuple<Fields&...>>
+{
+};
+
+template<size_t K, typename... Fields>
+struct tuple_element<K, SoARef<Fields...>>
+  : tuple_element<K, tuple<Fields&...>>
+{
+};
+}
+
+////////////////////////////////////////////////////////////////////////
+// declaration
+
+// A table stored column by column: each field lives in its own Array,
+// so a loop over one field streams only that field's bytes through the
+// cache. Rows are pushed and indexed as a whole, through SoARef; whole
+// columns come out as Spans on CACHE_LINE boundaries, ready for the
+// kernels in simd.hpp:
+//
+//   SoAArray<float, float, int> ps;  // x, y, id
+//   ps.push_back(1.5f, 2.5f, 7);
+//   auto xs = ps.column<0>();
+//   float sum = vsum(xs.data(), xs.size());
+//
+// Every column has the same capacity, since they grow in lockstep.
+
+template <typename... Fields>
+class SoAArray
+{
+
+  static_assert(sizeof...(Fields) > 0, "SoAArray needs a field");
+
+  template<typename F>
+  using column_t = AlignedArray<F>;
+  using seq = std::index_sequence_for<Fields...>;
+
+public:
+  template<bool C>
+  class Iterator;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+  using value_type = std::tuple<Fields...>;
+  using reference = SoARef<Fields...>;
+  using const_reference = SoARef<const Fields...>;
+  template<size_t K>
+  using field_t = typename std::tuple_element<K, value_type>::type;
+
+  // constructors
+  SoAArray();
+  SoAArray(size_t n);
+
+  // operators
+  value_type operator[](size_t i) const;
+  reference operator[](size_t i);
+
+  // accessors
+  size_t size() const;
+  size_t capacity() const;
+  bool empty() const;
+  value_type back() const;
+  value_type front() const;
+  reference back();
+  reference front();
+  template<size_t K>
+  Span<const field_t<K>> column() const;
+  template<size_t K>
+  Span<field_t<K>> column();
+
+  // mutators
+  void reserve(size_t n);
+  void resize(size_t n);
+  void shrink_to_fit();
+  void push_back(const Fields&... v);
+  void push_back(const value_type& v);
+  template<typename... Args>
+  reference emplace_back(Args&&... args);
+  void pop_back();
+  void clear();
+  void release();
+  void swap(SoAArray<Fields...>& a);
+  void append(const SoAArray<Fields...>& a);
+
+  // bonus
+  const_iterator begin() const;
+  const_iterator end() const;
+  iterator begin();
+  iterator end();
+
+private:
+  std::tuple<column_t<Fields>...> columns_;
+
+  template<size_t... K>
+  reference row(size_t i, std::index_sequence<K...>);
+  template<size_t... K>
+  const_reference row(size_t i, std::index_sequence<K...>) const;
+  template<size_t... K, typename... Args>
+  void emplace(std::index_sequence<K...>, Args&&... args);
+  template<typename F>
+  void each(F f);
+};
+
+////////////////////////////////////////////////////////////////////////
+// iterator
+
+// Random access over rows, yielding a SoARef per row.
+
+template<typename... Fields>
+template<bool C>
+class SoAArray<Fields...>::Iterator
+{
+
+  using owner = typename std::conditional<C, const SoAArray<Fields...>,
+                                          SoAArray<Fields...>>::type;
+
+public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = std::tuple<Fields...>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = typename std::conditional<C, const_reference,
+                                              SoARef<Fields...>>::type;
+
+  Iterator() : a_(nullptr), i_(0) {}
+  Iterator(owner* a, size_t i) : a_(a), i_(i) {}
+
+  reference operator*() const { return a_->row(i_, seq()); }
+  reference operator[](difference_type d) const
+  {
+    return a_->row(i_ + d, seq());
+  }
+
+  Iterator& operator++() { ++i_; return *this; }
+  Iterator& operator--() { --i_; return *this; }
+  Iterator operator++(int) { Iterator t = *this; ++i_; return t; }
+  Iterator operator--(int) { Iterator t = *this; --i_; return t; }
+  Iterator& operator+=(difference_type d) { i_ += d; return *this; }
+  Iterator& operator-=(difference_type d) { i_ -= d; return *this; }
+  Iterator operator+(difference_type d) const { return Iterator(a_, i_ + d); }
+  Iterator operator-(difference_type d) const { return Iterator(a_, i_ - d); }
+  friend Iterator operator+(difference_type d, const Iterator& it)
+  {
+    return it + d;
+  }
+  difference_type operator-(const Iterator& it) const
+  {
+    return (difference_type)i_ - (difference_type)it.i_;
+  }
+
+  bool operator==(const Iterator& it) const { return i_ == it.i_; }
+  bool operator!=(const Iterator& it) const { return i_ != it.i_; }
+  bool operator<(const Iterator& it) const { return i_ < it.i_; }
+  bool operator>(const Iterator& it) const { return i_ > it.i_; }
+  bool operator<=(const Iterator& it) const { return i_ <= it.i_; }
+  bool operator>=(const Iterator& it) const { return i_ >= it.i_; }
+
+private:
+  owner* a_;
+  size_t i_;
+};
+
+////////////////////////////////////////////////////////////////////////
+// columns
+
+template<typename... Fields>
+template<size_t... K>
+typename SoAArray<Fields...>::reference
+SoAArray<Fields...>::row(size_t i, std::index_sequence<K...>)
+{
+  return reference(std::get<K>(columns_).begin()[i]...);
+}
+
+template<typename... Fields>
+template<size_t... K>
+typename SoAArray<Fields...>::const_reference
+SoAArray<Fields...>::row(size_t i, std::index_sequence<K...>) const
+{
+  return const_reference(std::get<K>(columns_).begin()[i]...);
+}
+
+// Room is made in every column before anything is built, so no column
+// moves halfway through; a throwing field unbuilds the ones before it.
+// When that means growing, the row is built aside first, since args may
+// refer into the columns.
+template<typename... Fields>
+template<size_t... K, typename... Args>
+void
+SoAArray<Fields...>::emplace(std::index_sequence<K...>, Args&&... args)
+{
+  static_assert(sizeof...(Args) == sizeof...(Fields), "one value a field");
+
+  if (size() == capacity()) {
+    value_type v(std::forward<Args>(args)...);
+    reserve(size() + 1);
+    emplace(seq(), std::move(std::get<K>(v))...);
+    return;
+  }
+
+  size_t built = 0;
+  try {
+    ((std::get<K>(columns_).emplace_back(std::forward<Args>(args)),
+      ++built), ...);
+  } catch (...) {
+    size_t k = 0;
+    ((k++ < built ? std::get<K>(columns_).pop_back() : void()), ...);
+    throw;
+  }
+}
+
+template<typename... Fields>
+template<typename F>
+void
+SoAArray<Fields...>::each(F f)
+{
+  std::apply([&f](auto&... c) { (f(c), ...); }, columns_);
+}
+
+////////////////////////////////////////////////////////////////////////
+// constructors
+
+template<typename... Fields>
+SoAArray<Fields...>::SoAArray()
+{
+}
+
+template<typename... Fields>
+SoAArray<Fields...>::SoAArray(size_t n)
+{
+  resize(n);
+}
+
+////////////////////////////////////////////////////////////////////////
+// operators
+
+template<typename... Fields>
+typename SoAArray<Fields...>::value_type
+SoAArray<Fields...>::operator[](size_t i) const
+{
+  assert(i < size());
+
+  return row(i, seq());
+}
+
+template<typename... Fields>
+typename SoAArray<Fields...>::reference
+SoAArray<Fields...>::operator[](size_t i)
+{
+  assert(i < size());
+
+  return row(i, seq());
+}
+
+////////////////////////////////////////////////////////////////////////
+// accessors
+
+template<typename... Fields>
+size_t
+SoAArray<Fields...>::size() const
+{
+  return std::get<0>(columns_).size();
+}
+
+template<typename... Fields>
+size_t
+SoAArray<Fields...>::capacity() const
+{
+  return std::get<0>(columns_).capacity();
+}
+
+template<typename... Fields>
+bool
+SoAArray<Fields...>::empty() const
+{
+  return size() == 0;
+}
+
+template<typename... Fields>
+typename SoAArray<Fields...>::value_type
+SoAArray<Fields...>::back() const
+{
+  return row(size() - 1, seq());
+}
+
+template<typename... Fields>
+typename SoAArray<Fields...>::value_type
+SoAArray<Fields...>::front() const
+{
+  return row(0, seq());
+}
+
+template<typename... Fields>
+typename SoAArray<Fields...>::reference
+SoAArray<Fields...>::back()
+{
+  return row(size() - 1, seq());
+}
+
+template<typename... Fields>
+typename SoAArray<Fields...>::reference
+SoAArray<Fields...>::front()
+{
+  return row(0, seq());
+}
+
+template<typename... Fields>
+template<size_t K>
+Span<const typename SoAArray<Fields...>::template field_t<K>>
+SoAArray<Fields...>::column() const
+{
+  auto& c = std::get<K>(columns_);
+  return Span<const field_t<K>>(c.begin(), c.size());
+}
+
+template<typename... Fields>
+template<size_t K>
+Span<typename SoAArray<Fields...>::template field_t<K>>
+SoAArray<Fields...>::column()
+{
+  auto& c = std::get<K>(columns_);
+  return Span<field_t<K>>(c.begin(), c.size());
+}
+
+////////////////////////////////////////////////////////////////////////
+// mutators
+
+template<typename... Fields>
+void
+SoAArray<Fields...>::reserve(size_t n)
+{
+  each([n](auto& c) { c.reserve(n); });
+}
+
+template<typename... Fields>
+void
+SoAArray<Fields...>::resize(size_t n)
+{
+  reserve(n);
+  each([n](auto& c) { c.resize(n); });
+}
+
+template<typename... Fields>
+void
+SoAArray<Fields...>::shrink_to_fit()
+{
+  each([](auto& c) { c.shrink_to_fit(); });
+}
+
+template<typename... Fields>
+void
+SoAArray<Fields...>::push_back(const Fields&... v)
+{
+  emplace(seq(), v...);
+}
+
+template<typename... Fields>
+void
+SoAArray<Fields...>::push_back(const value_type& v)
+{
+  std::apply([this](const Fields&... f) { emplace(seq(), f...); }, v);
+}
+
+template<typename... Fields>
+template<typename... Args>
+typename SoAArray<Fields...>::reference
+SoAArray<Fields...>::emplace_back(Args&&... args)
+{
+  emplace(seq(), std::forward<Args>(args)...);
+  return back();
+}
+
+template<typename... Fields>
+void
+SoAArray<Fields...>::pop_back()
+{
+  each([](auto& c) { c.pop_back(); });
+}
+
+template<typename... Fields>
+void
+SoAArray<Fields...>::clear()
+{
+  each([](auto& c) { c.clear(); });
+}
+
+template<typename... Fields>
+void
+SoAArray<Fields...>::release()
+{
+  each([](auto& c) { c.release(); });
+}
+
+template<typename... Fields>
+void
+SoAArray<Fields...>::swap(SoAArray<Fields...>& a)
+{
+  columns_.swap(a.columns_);
+}
+
+// Column by column, each in bulk.
+template<typename... Fields>
+void
+SoAArray<Fields...>::append(const SoAArray<Fields...>& a)
+{
+  size_t n = a.size(); // a may be *this
+  reserve(size() + n);
+  std::apply([&a, n](auto&... c) {
+    std::apply([&c..., n](const auto&... d) {
+      (c.append(d.begin(), n), ...);
+    }, a.columns_);
+  }, columns_);
+}
+
+////////////////////////////////////////////////////////////////////////
+// bonus
+
+//// iterators
+
+template<typename... Fields>
+typename SoAArray<Fields...>::const_iterator
+SoAArray<Fields...>::begin() const {
+  return const_iterator(this, 0);
+}
+
+template<typename... Fields>
+typename SoAArray<Fields...>::const_iterator
+SoAArray<Fields...>::end() const {
+  return const_iterator(this, size());
+}
+
+template<typename... Fields>
+typename SoAArray<Fields...>::iterator
+SoAArray<Fields...>::begin() {
+  return iterator(this, 0);
+}
+
+template<typename... Fields>
+typename SoAArray<Fields...>::iterator
+SoAArray<Fields...>::end() {
+  return iterator(this, size());
+}